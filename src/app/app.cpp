@@ -12,6 +12,8 @@
 #include "app/app.h"
 
 #include "app/app_options.h"
+#include "app/batch_jobs.h"
+#include "app/batch_server.h"
 #include "app/color_utils.h"
 #include "app/commands/cmd_save_file.h"
 #include "app/commands/cmd_sprite_size.h"
@@ -21,8 +23,12 @@
 #include "app/crash/data_recovery.h"
 #include "app/document_exporter.h"
 #include "app/document_undo.h"
+#include "app/export_cache.h"
+#include "app/file/ase_options.h"
+#include "app/file/png_options.h"
 #include "app/file/file.h"
 #include "app/file/file_formats_manager.h"
+#include "app/file/palette_file.h"
 #include "app/file_system.h"
 #include "app/filename_formatter.h"
 #include "app/gui_xml.h"
@@ -38,6 +44,7 @@
 #include "app/script/app_scripting.h"
 #include "app/send_crash.h"
 #include "app/shell.h"
+#include "app/startup_profile.h"
 #include "app/tools/active_tool.h"
 #include "app/tools/tool_box.h"
 #include "app/ui/color_bar.h"
@@ -90,8 +97,10 @@ class App::Modules {
 public:
   LoggerModule m_loggerModule;
   FileSystemModule m_file_system_module;
-  tools::ToolBox m_toolbox;
-  tools::ActiveToolManager m_activeToolManager;
+  // The tools are created the first time they are used (batch mode
+  // doesn't need them to convert files).
+  std::unique_ptr<tools::ToolBox> m_toolbox;
+  std::unique_ptr<tools::ActiveToolManager> m_activeToolManager;
   CommandsModule m_commands_modules;
   UIContext m_ui_context;
   RecentFiles m_recent_files;
@@ -102,10 +111,23 @@ public:
 
   Modules(bool createLogInDesktop)
     : m_loggerModule(createLogInDesktop)
-    , m_activeToolManager(&m_toolbox)
     , m_recovery(nullptr) {
   }
 
+  tools::ToolBox* toolBox() {
+    if (!m_toolbox) {
+      StartupProfile::Scope profile("tools (lazy)");
+      m_toolbox.reset(new tools::ToolBox);
+    }
+    return m_toolbox.get();
+  }
+
+  tools::ActiveToolManager* activeToolManager() {
+    if (!m_activeToolManager)
+      m_activeToolManager.reset(new tools::ActiveToolManager(toolBox()));
+    return m_activeToolManager.get();
+  }
+
   app::crash::DataRecovery* recovery() {
     return m_recovery;
   }
@@ -132,6 +154,8 @@ App::App()
   , m_legacy(nullptr)
   , m_isGui(false)
   , m_isShell(false)
+  , m_isServer(false)
+  , m_exitCode(0)
   , m_exporter(nullptr)
 {
   ASSERT(m_instance == NULL);
@@ -142,10 +166,19 @@ void App::initialize(const AppOptions& options)
 {
   m_isGui = options.startUI();
   m_isShell = options.startShell();
-  if (m_isGui)
+  m_isServer = options.startServer();
+  m_socketPath = options.socketPath();
+  StartupProfile::setEnabled(options.profileStartup());
+
+  if (m_isGui) {
+    StartupProfile::Scope profile("ui system");
     m_uiSystem.reset(new ui::UISystem);
+  }
 
-  m_coreModules = std::make_unique<CoreModules>();
+  {
+    StartupProfile::Scope profile("config/preferences");
+    m_coreModules = std::make_unique<CoreModules>();
+  }
 
   bool createLogInDesktop = false;
   switch (options.verboseLevel()) {
@@ -161,27 +194,40 @@ void App::initialize(const AppOptions& options)
       break;
   }
 
-  m_modules = std::make_unique<Modules>(createLogInDesktop);
-  m_legacy = std::make_unique<LegacyModules>(isGui() ? REQUIRE_INTERFACE: 0);
-  m_brushes.reset(new AppBrushes);
-
-  if (options.hasExporterParams())
-    m_exporter.reset(new DocumentExporter);
+  {
+    StartupProfile::Scope profile("modules");
+    m_modules = std::make_unique<Modules>(createLogInDesktop);
+  }
+  // The only legacy module in batch mode is the palette one, which
+  // just allocates the default/current palettes (the default palette
+  // file is loaded lazily below).
+  {
+    StartupProfile::Scope profile("legacy modules");
+    m_legacy = std::make_unique<LegacyModules>(isGui() ? REQUIRE_INTERFACE: 0);
+  }
 
   // Data recovery is enabled only in GUI mode
-  if (isGui() && preferences().general.dataRecovery())
+  if (isGui() && preferences().general.dataRecovery()) {
+    StartupProfile::Scope profile("data recovery");
     m_modules->createDataRecovery();
+  }
 
   if (isPortable())
     LOG("Running in portable mode\n");
 
   // Load or create the default palette, or migrate the default
-  // palette from an old format palette to the new one, etc.
-  load_default_palette(options.paletteFileName());
+  // palette from an old format palette to the new one, etc. In batch
+  // mode it's loaded only if something uses it.
+  if (isGui()) {
+    StartupProfile::Scope profile("default palette");
+    load_default_palette(options.paletteFileName());
+  }
+  else
+    load_default_palette_lazily(options.paletteFileName());
 
   // Initialize GUI interface
-  UIContext* ctx = UIContext::instance();
   if (isGui()) {
+    StartupProfile::Scope profile("main window");
     LOG("GUI mode\n");
     script::EngineDelegate::setDefault("gui");
 
@@ -211,22 +257,140 @@ void App::initialize(const AppOptions& options)
     ui::Manager::getDefault()->invalidate();
   }
 
-  // Procress options
+  {
+    StartupProfile::Scope profile("command line");
+    processOptions(options);
+  }
+
+  she::instance()->finishLaunching();
+
+  // In GUI mode the profile is printed when the scripts menu is
+  // built (see AppMenus::reload()).
+  if (!isGui())
+    StartupProfile::print(stderr);
+}
+
+// Processes the files and options given in the command line (or in
+// a job of the batch server).
+void App::processOptions(const AppOptions& options)
+{
+  if (!isGui() && !options.exportCacheDir().empty())
+    processCachedOptions(options);
+  else
+    processCommandLine(options);
+}
+
+// Processes the command line skipping the exports that are up to date
+// (--export-cache). Each input file is processed as a separated job
+// (if it's possible) so only the modified ones are exported again.
+void App::processCachedOptions(const AppOptions& options)
+{
+  BatchJobs batchJobs;
+  if (options.parallelJobs() == 1 && batchJobs.split(options)) {
+    int exitCode = 0;
+    for (const auto& args : batchJobs.jobs()) {
+      std::vector<const char*> argv = { "libresprite" };
+      for (const auto& arg : args)
+        argv.push_back(arg.c_str());
+
+      int result = processJob(AppOptions(int(argv.size()), &argv[0]));
+      if (exitCode == 0)
+        exitCode = result;
+    }
+    m_exitCode = exitCode;
+    return;
+  }
+
+  // Options that print something cannot be skipped
+  std::vector<std::string> args, inputFiles;
+  bool dataFile = false;
+  for (const auto& value : options.values()) {
+    const AppOptions::Option* opt = value.option();
+    if (opt == &options.script() ||
+        opt == &options.listLayers() ||
+        opt == &options.listTags()) {
+      processCommandLine(options);
+      return;
+    }
+    else if (opt == &options.data())
+      dataFile = true;
+    else if (opt == &options.exportCache())
+      continue;
+    else if (!opt)
+      inputFiles.push_back(value.value());
+
+    AppOptions::valueToArgs(value, args);
+  }
+  if (options.hasExporterParams() && !dataFile) {
+    processCommandLine(options);
+    return;
+  }
+  if (!options.paletteFileName().empty())
+    inputFiles.push_back(options.paletteFileName());
+
+  // Settings of the configuration file that change the written files
+  static const char* configKeys[][2] = {
+    { "ASE", "Compression" },
+    { "PNG", "CompressionLevel" },
+    { "PNG", "Filter" }
+  };
+  for (const auto& key : configKeys)
+    args.push_back(std::string("[") + key[0] + "]" + key[1] + "=" +
+                   get_config_string(key[0], key[1], ""));
+
+  ExportCache cache(options.exportCacheDir());
+  cache.beginJob(args, inputFiles);
+  if (cache.isJobUpToDate()) {
+    LOG("Skipping the export of \"%s\" (up to date)\n",
+        inputFiles.empty() ? "": inputFiles[0].c_str());
+    cache.endJob();
+    return;
+  }
+
+  try {
+    processCommandLine(options);
+  }
+  catch (...) {
+    cache.setFailed();
+    cache.endJob();
+    throw;
+  }
+  if (m_exitCode != 0)
+    cache.setFailed();
+  cache.endJob();
+}
+
+void App::processCommandLine(const AppOptions& options)
+{
   LOG("Processing options...\n");
 
+  UIContext* ctx = UIContext::instance();
+  if (options.hasExporterParams())
+    m_exporter.reset(new DocumentExporter);
+
   bool ignoreEmpty = false;
+  bool mergeDuplicates = false;
   bool trim = false;
   Params cropParams;
   SpriteSheetType sheetType = SpriteSheetType::None;
 
+  // Process each file in its own process (--jobs)
+  BatchJobs batchJobs;
+  if (!isGui() &&
+      options.parallelJobs() != 1 &&
+      batchJobs.split(options)) {
+    LOG("Processing %d files in parallel...\n", int(batchJobs.jobs().size()));
+    m_exitCode = batchJobs.run(options.parallelJobs());
+  }
   // Open file specified in the command line
-  if (!options.values().empty()) {
+  else if (!options.values().empty()) {
     Console console;
     bool splitLayers = false;
     bool splitLayersSaveAs = false;
     bool allLayers = false;
     bool listLayers = false;
     bool listTags = false;
+    bool compactGif = false;
     std::string importLayer;
     std::string importLayerSaveAs;
     std::string filenameFormat;
@@ -271,6 +435,20 @@ void App::initialize(const AppOptions& options)
           if (m_exporter)
             m_exporter->setTextureHeight(strtol(value.value().c_str(), NULL, 0));
         }
+        // --sheet-max-size <width,height>
+        else if (opt == &options.sheetMaxSize()) {
+          std::vector<std::string> dimensions;
+          base::split_string(value.value(), dimensions, ",");
+          if (dimensions.size() < 2)
+            throw std::runtime_error("--sheet-max-size needs two parameters separated by comma (,)\n"
+                                     "Usage: --sheet-max-size width,height\n"
+                                     "E.g. --sheet-max-size 4096,4096");
+
+          if (m_exporter)
+            m_exporter->setMaxTextureSize(
+              gfx::Size(base::convert_to<int>(dimensions[0]),
+                        base::convert_to<int>(dimensions[1])));
+        }
         // --sheet-pack
         else if (opt == &options.sheetType()) {
           if (value.value() == "horizontal")
@@ -310,10 +488,18 @@ void App::initialize(const AppOptions& options)
         else if (opt == &options.frameRange()) {
           frameRange = value.value();
         }
+        // --compact-gif
+        else if (opt == &options.compactGif()) {
+          compactGif = true;
+        }
         // --ignore-empty
         else if (opt == &options.ignoreEmpty()) {
           ignoreEmpty = true;
         }
+        // --merge-duplicates
+        else if (opt == &options.mergeDuplicates()) {
+          mergeDuplicates = true;
+        }
         // --border-padding
         else if (opt == &options.borderPadding()) {
           if (m_exporter)
@@ -520,6 +706,33 @@ void App::initialize(const AppOptions& options)
           if (m_exporter)
             m_exporter->setListFrameTags(true);
         }
+        // --ase-compression <level>
+        else if (opt == &options.aseCompression()) {
+          AseOptions::Compression compression;
+          if (!AseOptions::parseCompression(value.value(), compression))
+            throw std::runtime_error("--ase-compression needs one of these values: fast, default, max\n"
+                                     "E.g. --ase-compression fast");
+
+          AseOptions::setDefaultCompression(compression);
+        }
+        // --png-compression <level>
+        else if (opt == &options.pngCompression()) {
+          int level;
+          if (!PngOptions::parseCompressionLevel(value.value(), level))
+            throw std::runtime_error("--png-compression needs a level from 0 to 9\n"
+                                     "E.g. --png-compression 9");
+
+          PngOptions::setDefaultCompressionLevel(level);
+        }
+        // --png-filter <filter>
+        else if (opt == &options.pngFilter()) {
+          PngOptions::Filter filter;
+          if (!PngOptions::parseFilter(value.value(), filter))
+            throw std::runtime_error("--png-filter needs one of these values: none, sub, up, average, paeth, adaptive\n"
+                                     "E.g. --png-filter paeth");
+
+          PngOptions::setDefaultFilter(filter);
+        }
       }
       // File names aren't associated to any option
       else {
@@ -530,14 +743,18 @@ void App::initialize(const AppOptions& options)
         Command* openCommand = CommandsModule::instance()->getCommandByName(CommandId::OpenFile);
         Params params;
         params.set("filename", filename.c_str());
+        if (compactGif)
+          params.set("compact", "true");
         ctx->executeCommand(openCommand, params);
 
         app::Document* doc = ctx->activeDocument();
 
         // If the active document is equal to the previous one, it
         // means that we couldn't open this specific document.
-        if (doc == oldDoc)
+        if (doc == oldDoc) {
           doc = nullptr;
+          setFileOperationFailed();
+        }
 
         // List layers and/or tags
         if (doc) {
@@ -626,16 +843,20 @@ void App::initialize(const AppOptions& options)
     if (ignoreEmpty)
       m_exporter->setIgnoreEmptyCels(true);
 
+    if (mergeDuplicates)
+      m_exporter->setMergeDuplicates(true);
+
     if (trim)
       m_exporter->setTrimCels(true);
 
+    // The sheet document is discarded, so we can avoid creating it
+    m_exporter->setStreamTexture(true);
+
     std::unique_ptr<Document> spriteSheet(m_exporter->exportSheet());
     m_exporter.reset(NULL);
 
     LOG("Export sprite sheet: Done\n");
   }
-
-  she::instance()->finishLaunching();
 }
 
 void App::run()
@@ -665,7 +886,83 @@ void App::run()
     shell.run(engine);
   }
 
+  // Process jobs until stdin (or the socket) is closed.
+  if (m_isServer) {
+    LOG("Batch server mode\n");
+    BatchServer server(
+      [this](const AppOptions& options) {
+        return processJob(options);
+      });
+
+    if (m_socketPath.empty())
+      server.serveStdio();
+    else if (!server.serveSocket(m_socketPath))
+      m_exitCode = 1;
+  }
+
   // Destroy all documents in the UIContext.
+  closeAllDocuments();
+
+  if (isGui()) {
+    // Destroy the window.
+    m_mainWindow.reset(nullptr);
+  }
+
+  // Delete backups (this is a normal shutdown, we are not handling
+  // exceptions, and we are not in a destructor).
+  m_modules->deleteDataRecovery();
+}
+
+// Processes a job of the batch server, all documents are closed and
+// the default options for files (and the default palette) are
+// restored after it.
+int App::processJob(const AppOptions& options)
+{
+  AseOptions::Compression aseCompression = AseOptions::defaultCompression();
+  int pngCompressionLevel = PngOptions::defaultCompressionLevel();
+  PngOptions::Filter pngFilter = PngOptions::defaultFilter();
+
+  // The --palette of the job is the default palette only for this job
+  std::unique_ptr<Palette> oldPalette;
+  if (!options.paletteFileName().empty()) {
+    std::shared_ptr<Palette> pal = load_palette(options.paletteFileName().c_str());
+    if (!pal) {
+      std::cout << "Error loading palette " << options.paletteFileName() << "\n";
+      return 1;
+    }
+    oldPalette.reset(new Palette(*get_default_palette()));
+    set_default_palette(pal.get());
+    set_current_palette(nullptr, true);
+  }
+
+  int exitCode;
+  try {
+    m_exitCode = 0;
+    processOptions(options);
+    exitCode = m_exitCode;
+  }
+  catch (const std::exception& ex) {
+    std::cout << ex.what() << "\n";
+    exitCode = 1;
+  }
+  m_exitCode = 0;
+  m_exporter.reset();
+
+  closeAllDocuments();
+
+  AseOptions::setDefaultCompression(aseCompression);
+  PngOptions::setDefaultCompressionLevel(pngCompressionLevel);
+  PngOptions::setDefaultFilter(pngFilter);
+
+  if (oldPalette) {
+    set_default_palette(oldPalette.get());
+    set_current_palette(nullptr, true);
+  }
+  return exitCode;
+}
+
+void App::closeAllDocuments()
+{
   const doc::Documents& docs = m_modules->m_ui_context.documents();
   while (!docs.empty()) {
     doc::Document* doc = docs.back();
@@ -684,15 +981,6 @@ void App::run()
     doc->close();
     delete doc;
   }
-
-  if (isGui()) {
-    // Destroy the window.
-    m_mainWindow.reset(nullptr);
-  }
-
-  // Delete backups (this is a normal shutdown, we are not handling
-  // exceptions, and we are not in a destructor).
-  m_modules->deleteDataRecovery();
 }
 
 // Finishes the LibreSprite application.
@@ -749,17 +1037,26 @@ bool App::isPortable()
 tools::ToolBox* App::toolBox() const
 {
   ASSERT(m_modules != NULL);
-  return &m_modules->m_toolbox;
+  return m_modules->toolBox();
 }
 
 tools::Tool* App::activeTool() const
 {
-  return m_modules->m_activeToolManager.activeTool();
+  return m_modules->activeToolManager()->activeTool();
 }
 
 tools::ActiveToolManager* App::activeToolManager() const
 {
-  return &m_modules->m_activeToolManager;
+  return m_modules->activeToolManager();
+}
+
+AppBrushes& App::brushes()
+{
+  if (!m_brushes) {
+    StartupProfile::Scope profile("brushes (lazy)");
+    m_brushes.reset(new AppBrushes);
+  }
+  return *m_brushes;
 }
 
 RecentFiles* App::recentFiles() const
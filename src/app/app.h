@@ -66,6 +66,16 @@ namespace app {
     void initialize(const AppOptions& options);
     void run();
 
+    // Exit code of the program (e.g. non-zero if a batch job failed).
+    int exitCode() const { return m_exitCode; }
+
+    // Called when a file cannot be opened or saved from the command
+    // line, so the program (or the current job) fails.
+    void setFileOperationFailed() {
+      if (m_exitCode == 0)
+        m_exitCode = 1;
+    }
+
     tools::ToolBox* toolBox() const;
     tools::Tool* activeTool() const;
     tools::ActiveToolManager* activeToolManager() const;
@@ -76,10 +86,8 @@ namespace app {
     Timeline* timeline() const;
     Preferences& preferences() const;
 
-    AppBrushes& brushes() {
-      ASSERT(m_brushes.get());
-      return *m_brushes;
-    }
+    // Brushes are loaded the first time they are used.
+    AppBrushes& brushes();
 
     void showNotification(INotificationDelegate* del);
     void updateDisplayTitleBar();
@@ -92,6 +100,13 @@ namespace app {
 
   private:
     typedef std::vector<std::string> FileList;
+
+    void processOptions(const AppOptions& options);
+    void processCachedOptions(const AppOptions& options);
+    void processCommandLine(const AppOptions& options);
+    int processJob(const AppOptions& options);
+    void closeAllDocuments();
+
     class CoreModules;
     class Modules;
 
@@ -103,6 +118,9 @@ namespace app {
     std::unique_ptr<LegacyModules> m_legacy;
     bool m_isGui;
     bool m_isShell;
+    bool m_isServer;
+    std::string m_socketPath;
+    int m_exitCode;
     std::unique_ptr<MainWindow> m_mainWindow;
     FileList m_files;
     std::unique_ptr<DocumentExporter> m_exporter;
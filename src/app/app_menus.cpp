@@ -21,6 +21,7 @@
 #include "app/console.h"
 #include "app/gui_xml.h"
 #include "app/resource_finder.h"
+#include "app/startup_profile.h"
 #include "app/tools/tool_box.h"
 #include "app/ui/app_menuitem.h"
 #include "app/ui/keyboard_shortcuts.h"
@@ -73,7 +74,23 @@ void AppMenus::reload()
 
   LOG("Main menu loaded.\n");
 
-  rebuildScriptsList();
+  // Scanning the scripts folders can take a while (each script is
+  // read), so it's done once the main window is visible.
+  if (!m_scanScriptsTimer) {
+    m_scanScriptsTimer.reset(new ui::Timer(1));
+    m_scanScriptsTimer->Tick.connect(
+      [this]{
+        m_scanScriptsTimer->stop();
+        {
+          StartupProfile::Scope profile("scripts menu (lazy)");
+          rebuildScriptsList();
+        }
+
+        // This is the last part of the startup in GUI mode
+        StartupProfile::print(stderr);
+      });
+  }
+  m_scanScriptsTimer->start();
 
   ////////////////////////////////////////
   // Load keyboard shortcuts for commands
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <memory>
 #include <unordered_map>
 #include "base/connection.h"
 #include "base/disable_copying.h"
@@ -15,6 +16,7 @@
 #include "script/script_menu.h"
 #include "ui/base.h"
 #include "ui/menu.h"
+#include "ui/timer.h"
 
 namespace tinyxml2 {
   class XMLHandle;
@@ -70,6 +72,7 @@ namespace app {
     void clearIdentifiedWidgets();
     RecentFilesMenu m_recentFilesMenu;
     ScriptMenu m_scriptMenu;
+    std::unique_ptr<ui::Timer> m_scanScriptsTimer;
     std::unordered_map<std::string, Widget*> m_identifiedWidgets;
   };
 
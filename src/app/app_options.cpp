@@ -13,6 +13,7 @@
 
 #include "base/path.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 
@@ -22,12 +23,22 @@ typedef base::ProgramOptions::Option Option;
 
 AppOptions::AppOptions(int argc, const char* argv[])
   : m_exeName(base::get_file_name(argv[0]))
+  , m_valid(true)
   , m_startUI(true)
   , m_startShell(false)
+  , m_startServer(false)
+  , m_connectToServer(false)
+  , m_profileStartup(false)
   , m_verboseLevel(kNoVerbose)
+  , m_parallelJobs(1)
   , m_palette(m_po.add("palette").requiresValue("<filename>").description("Use a specific palette by default"))
   , m_shell(m_po.add("shell").description("Start an interactive console to execute scripts"))
   , m_batch(m_po.add("batch").mnemonic('b').description("Do not start the UI"))
+  , m_jobs(m_po.add("jobs").mnemonic('j').requiresValue("<n>").description("Process the given files in <n> processes\nat the same time (0 = one per CPU core)"))
+  , m_serve(m_po.add("serve").description("Do not start the UI, process jobs (command\nlines) from stdin and reply with JSON lines"))
+  , m_socket(m_po.add("socket").requiresValue("<path>").description("UNIX socket used by --serve and --connect"))
+  , m_connect(m_po.add("connect").description("Send the command line as a job to the server\nstarted with --serve --socket <path>"))
+  , m_exportCache(m_po.add("export-cache").requiresValue("<dir>").description("Remember exported files in the given directory\nto skip exports whose input files didn't change"))
   , m_saveAs(m_po.add("save-as").requiresValue("<filename>").description("Save the last given document with other format"))
   , m_scale(m_po.add("scale").requiresValue("<factor>").description("Resize all previous opened documents"))
   , m_shrinkTo(m_po.add("shrink-to").requiresValue("width,height").description("Shrink each sprite if it is\nlarger than width or height"))
@@ -36,6 +47,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_sheet(m_po.add("sheet").requiresValue("<filename.png>").description("Image file to save the texture"))
   , m_sheetWidth(m_po.add("sheet-width").requiresValue("<pixels>").description("Sprite sheet width"))
   , m_sheetHeight(m_po.add("sheet-height").requiresValue("<pixels>").description("Sprite sheet height"))
+  , m_sheetMaxSize(m_po.add("sheet-max-size").requiresValue("width,height").description("Maximum size of the sprite sheet, frames\nthat don't fit are saved in more sheets\n(sheet-0.png, sheet-1.png, etc.)"))
   , m_sheetType(m_po.add("sheet-type").requiresValue("<type>").description("Algorithm to create the sprite sheet:\n  horizontal\n  vertical\n  rows\n  columns\n  packed"))
   , m_sheetPack(m_po.add("sheet-pack").description("Same as --sheet-type packed"))
   , m_splitLayers(m_po.add("split-layers").description("Import each layer of the next given sprite as\na separated image in the sheet"))
@@ -44,6 +56,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_frameTag(m_po.add("frame-tag").requiresValue("<name>").description("Include tagged frames in the sheet"))
   , m_frameRange(m_po.add("frame-range").requiresValue("from,to").description("Only export frames in the [from,to] range"))
   , m_ignoreEmpty(m_po.add("ignore-empty").description("Do not export empty frames/cels"))
+  , m_mergeDuplicates(m_po.add("merge-duplicates").description("Use the same place of the sheet for\nframes/cels with the same pixels"))
   , m_borderPadding(m_po.add("border-padding").requiresValue("<value>").description("Add padding on the texture borders"))
   , m_shapePadding(m_po.add("shape-padding").requiresValue("<value>").description("Add padding between frames"))
   , m_innerPadding(m_po.add("inner-padding").requiresValue("<value>").description("Add padding inside each frame"))
@@ -53,8 +66,13 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_script(m_po.add("script").requiresValue("<filename>").description("Execute a specific script"))
   , m_listLayers(m_po.add("list-layers").description("List layers of the next given sprite\nor include layers in JSON data"))
   , m_listTags(m_po.add("list-tags").description("List tags of the next given sprite sprite\nor include frame tags in JSON data"))
+  , m_compactGif(m_po.add("compact-gif").description("Load the next GIF files with cels cropped\nto their content, and linked when they repeat"))
+  , m_aseCompression(m_po.add("ase-compression").requiresValue("<level>").description("Compression level to save .ase files:\n  fast\n  default\n  max"))
+  , m_pngCompression(m_po.add("png-compression").requiresValue("<level>").description("zlib compression level (0-9) to\nsave .png files"))
+  , m_pngFilter(m_po.add("png-filter").requiresValue("<filter>").description("Filter for rows of .png files:\n  none\n  sub\n  up\n  average\n  paeth\n  adaptive"))
   , m_verbose(m_po.add("verbose").mnemonic('v').description("Explain what is being done"))
   , m_debug(m_po.add("debug").description("Extreme verbose mode and\ncopy log to desktop"))
+  , m_startupProfile(m_po.add("startup-profile").description("Print the time spent initializing\neach part of the program"))
   , m_help(m_po.add("help").mnemonic('?').description("Display this help and exits"))
   , m_version(m_po.add("version").description("Output version information and exit"))
 {
@@ -67,7 +85,15 @@ AppOptions::AppOptions(int argc, const char* argv[])
       m_verboseLevel = kVerbose;
 
     m_paletteFileName = m_po.value_of(m_palette);
+
+    if (m_po.enabled(m_jobs))
+      m_parallelJobs = std::max(0, std::atoi(m_po.value_of(m_jobs).c_str()));
     m_startShell = m_po.enabled(m_shell);
+    m_startServer = m_po.enabled(m_serve);
+    m_connectToServer = m_po.enabled(m_connect);
+    m_profileStartup = m_po.enabled(m_startupProfile);
+    m_socketPath = m_po.value_of(m_socket);
+    m_exportCacheDir = m_po.value_of(m_exportCache);
 
     if (m_po.enabled(m_help)) {
       showHelp();
@@ -78,13 +104,15 @@ AppOptions::AppOptions(int argc, const char* argv[])
       m_startUI = false;
     }
 
-    if (m_po.enabled(m_shell) || m_po.enabled(m_batch)) {
+    if (m_po.enabled(m_shell) || m_po.enabled(m_batch) ||
+        m_startServer || m_connectToServer) {
       m_startUI = false;
     }
   }
   catch (const std::runtime_error& parseError) {
     std::cerr << m_exeName << ": " << parseError.what() << '\n'
               << "Try \"" << m_exeName << " --help\" for more information.\n";
+    m_valid = false;
     m_startUI = false;
   }
 }
@@ -96,6 +124,19 @@ bool AppOptions::hasExporterParams() const
     m_po.enabled(m_sheet);
 }
 
+void AppOptions::valueToArgs(const ValueList::value_type& value,
+                             std::vector<std::string>& args)
+{
+  const Option* opt = value.option();
+  if (opt) {
+    args.push_back("--" + opt->name());
+    if (opt->doesRequireValue())
+      args.push_back(value.value());
+  }
+  else
+    args.push_back(value.value());
+}
+
 void AppOptions::showHelp()
 {
   std::cout
@@ -29,16 +29,40 @@ public:
 
   AppOptions(int argc, const char* argv[]);
 
+  // False if the command line couldn't be parsed.
+  bool isValid() const { return m_valid; }
   bool startUI() const { return m_startUI; }
   bool startShell() const { return m_startShell; }
+  bool startServer() const { return m_startServer; }
+  bool connectToServer() const { return m_connectToServer; }
+  bool profileStartup() const { return m_profileStartup; }
   VerboseLevel verboseLevel() const { return m_verboseLevel; }
 
   const std::string& paletteFileName() const { return m_paletteFileName; }
 
+  // Number of processes to use with the input files (--jobs), 0 means
+  // one process per CPU core.
+  int parallelJobs() const { return m_parallelJobs; }
+
+  // UNIX socket of the batch server (--socket), if it's empty the
+  // server uses stdin/stdout.
+  const std::string& socketPath() const { return m_socketPath; }
+
+  // Directory to remember the exported files (--export-cache), empty
+  // if exports aren't cached.
+  const std::string& exportCacheDir() const { return m_exportCacheDir; }
+
   const ValueList& values() const {
     return m_po.values();
   }
 
+  const Option& batch() const { return m_batch; }
+  const Option& jobs() const { return m_jobs; }
+  const Option& serve() const { return m_serve; }
+  const Option& socket() const { return m_socket; }
+  const Option& connect() const { return m_connect; }
+  const Option& exportCache() const { return m_exportCache; }
+
   // Export options
   const Option& saveAs() const { return m_saveAs; }
   const Option& scale() const { return m_scale; }
@@ -48,6 +72,7 @@ public:
   const Option& sheet() const { return m_sheet; }
   const Option& sheetWidth() const { return m_sheetWidth; }
   const Option& sheetHeight() const { return m_sheetHeight; }
+  const Option& sheetMaxSize() const { return m_sheetMaxSize; }
   const Option& sheetType() const { return m_sheetType; }
   const Option& sheetPack() const { return m_sheetPack; }
   const Option& splitLayers() const { return m_splitLayers; }
@@ -56,6 +81,7 @@ public:
   const Option& frameTag() const { return m_frameTag; }
   const Option& frameRange() const { return m_frameRange; }
   const Option& ignoreEmpty() const { return m_ignoreEmpty; }
+  const Option& mergeDuplicates() const { return m_mergeDuplicates; }
   const Option& borderPadding() const { return m_borderPadding; }
   const Option& shapePadding() const { return m_shapePadding; }
   const Option& innerPadding() const { return m_innerPadding; }
@@ -65,23 +91,44 @@ public:
   const Option& script() const { return m_script; }
   const Option& listLayers() const { return m_listLayers; }
   const Option& listTags() const { return m_listTags; }
+  const Option& compactGif() const { return m_compactGif; }
+  const Option& aseCompression() const { return m_aseCompression; }
+  const Option& pngCompression() const { return m_pngCompression; }
+  const Option& pngFilter() const { return m_pngFilter; }
 
   bool hasExporterParams() const;
 
+  // Adds the given value as it was specified in the command line
+  // (e.g. "--save-as" and "file.png", or just "file.ase").
+  static void valueToArgs(const ValueList::value_type& value,
+                          std::vector<std::string>& args);
+
 private:
   void showHelp();
   void showVersion();
 
   std::string m_exeName;
   base::ProgramOptions m_po;
+  bool m_valid;
   bool m_startUI;
   bool m_startShell;
+  bool m_startServer;
+  bool m_connectToServer;
+  bool m_profileStartup;
   VerboseLevel m_verboseLevel;
   std::string m_paletteFileName;
+  int m_parallelJobs;
+  std::string m_socketPath;
+  std::string m_exportCacheDir;
 
   Option& m_palette;
   Option& m_shell;
   Option& m_batch;
+  Option& m_jobs;
+  Option& m_serve;
+  Option& m_socket;
+  Option& m_connect;
+  Option& m_exportCache;
   Option& m_saveAs;
   Option& m_scale;
   Option& m_shrinkTo;
@@ -90,6 +137,7 @@ private:
   Option& m_sheet;
   Option& m_sheetWidth;
   Option& m_sheetHeight;
+  Option& m_sheetMaxSize;
   Option& m_sheetType;
   Option& m_sheetPack;
   Option& m_splitLayers;
@@ -98,6 +146,7 @@ private:
   Option& m_frameTag;
   Option& m_frameRange;
   Option& m_ignoreEmpty;
+  Option& m_mergeDuplicates;
   Option& m_borderPadding;
   Option& m_shapePadding;
   Option& m_innerPadding;
@@ -107,9 +156,14 @@ private:
   Option& m_script;
   Option& m_listLayers;
   Option& m_listTags;
+  Option& m_compactGif;
+  Option& m_aseCompression;
+  Option& m_pngCompression;
+  Option& m_pngFilter;
 
   Option& m_verbose;
   Option& m_debug;
+  Option& m_startupProfile;
   Option& m_help;
   Option& m_version;
 
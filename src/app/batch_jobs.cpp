@@ -0,0 +1,153 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/batch_jobs.h"
+
+#include "app/app_options.h"
+#include "base/fs.h"
+#include "base/process.h"
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+
+namespace app {
+
+namespace {
+
+struct JobResult {
+  std::string out;
+  std::string err;
+  int exitCode = 0;
+  base::process_status status = base::process_status::exited;
+  bool done = false;
+};
+
+} // anonymous namespace
+
+bool BatchJobs::split(const AppOptions& options)
+{
+  m_jobs.clear();
+
+  if (options.startShell() || options.hasExporterParams())
+    return false;
+
+  const AppOptions::ValueList& values = options.values();
+  std::vector<std::size_t> files;
+  for (std::size_t i=0; i<values.size(); ++i) {
+    const AppOptions::Option* opt = values[i].option();
+    if (!opt)
+      files.push_back(i);
+    // Scripts can do anything with all documents
+    else if (opt == &options.script())
+      return false;
+  }
+  if (files.size() < 2)
+    return false;
+
+  auto addValue = [&options](Args& args, const AppOptions::ValueList::value_type& value) {
+    const AppOptions::Option* opt = value.option();
+    if (opt != &options.batch() &&
+        opt != &options.jobs())
+      AppOptions::valueToArgs(value, args);
+  };
+
+  for (std::size_t k=0; k<files.size(); ++k) {
+    Args args;
+
+    // Options before the file
+    for (std::size_t i=0; i<files[k]; ++i) {
+      const AppOptions::Option* opt = values[i].option();
+      if (k > 0) {
+        // Skip other files and the options that act on them
+        if (!opt ||
+            opt == &options.saveAs() ||
+            opt == &options.scale() ||
+            opt == &options.shrinkTo())
+          continue;
+
+        // Options that are used just for the next file
+        if ((opt == &options.listLayers() ||
+             opt == &options.listTags()) && i < files[k-1])
+          continue;
+      }
+      addValue(args, values[i]);
+    }
+
+    // The file and its options
+    std::size_t end = (k+1 < files.size() ? files[k+1]: values.size());
+    for (std::size_t i=files[k]; i<end; ++i)
+      addValue(args, values[i]);
+
+    m_jobs.push_back(args);
+  }
+  return true;
+}
+
+int BatchJobs::run(int n) const
+{
+  const std::string exe = base::get_app_path();
+  std::vector<JobResult> results(m_jobs.size());
+  std::mutex mutex;
+  std::condition_variable jobDone;
+
+  std::size_t threads = (n > 0 ? std::size_t(n): base::thread_pool::default_size());
+  base::thread_pool pool(std::min(threads, m_jobs.size()));
+
+  for (std::size_t i=0; i<m_jobs.size(); ++i) {
+    pool.execute(
+      [&, i]{
+        Args args = { exe, "--batch" };
+        args.insert(args.end(), m_jobs[i].begin(), m_jobs[i].end());
+
+        JobResult result;
+        result.exitCode = base::run_process(args, result.out, result.err,
+                                            &result.status);
+        result.done = true;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        results[i] = std::move(result);
+        jobDone.notify_all();
+      });
+  }
+
+  // Print the output of each job in order
+  int exitCode = 0;
+  for (std::size_t i=0; i<results.size(); ++i) {
+    JobResult result;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      jobDone.wait(lock, [&]{ return results[i].done; });
+      result = std::move(results[i]);
+    }
+
+    std::cout << result.out << std::flush;
+    std::cerr << result.err << std::flush;
+
+    if (result.status == base::process_status::cannot_execute) {
+      std::cerr << "Cannot execute \"" << exe << "\"\n";
+      result.exitCode = 1;
+    }
+    else if (result.status == base::process_status::signaled) {
+      std::cerr << "The process of job " << (i+1) << " was terminated by signal "
+                << (result.exitCode - 128) << "\n";
+    }
+    if (exitCode == 0)
+      exitCode = result.exitCode;
+  }
+
+  pool.wait_all();
+  return exitCode;
+}
+
+} // namespace app
@@ -0,0 +1,44 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace app {
+  class AppOptions;
+
+  // Processes each input file of the command line (with its options)
+  // in a separate process, so independent files are processed in
+  // parallel (--jobs <n>). Each process has its own context and
+  // documents.
+  class BatchJobs {
+  public:
+    typedef std::vector<std::string> Args;
+
+    // Splits the command line in one job per input file. Each job
+    // gets the options given before its file (except the ones that
+    // affect the previous files, e.g. --save-as) and all the options
+    // until the next file. Returns false if the command line cannot
+    // be split (e.g. a sprite sheet is created from all files, or a
+    // script is executed).
+    bool split(const AppOptions& options);
+
+    const std::vector<Args>& jobs() const { return m_jobs; }
+
+    // Runs all jobs with up to "n" processes at the same time (or one
+    // per CPU core if "n" is 0). The output of each job is printed in
+    // the same order of the input files. Returns the exit code of the
+    // first job that failed, or 0 if all jobs succeeded.
+    int run(int n) const;
+
+  private:
+    std::vector<Args> m_jobs;
+  };
+
+} // namespace app
@@ -0,0 +1,56 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/test.h"
+
+#include "app/app_options.h"
+#include "app/batch_jobs.h"
+
+using namespace app;
+
+typedef BatchJobs::Args Args;
+
+TEST(BatchJobs, OneJobPerFile)
+{
+  const char* argv[] = {
+    "libresprite", "-b", "--jobs", "4",
+    "--trim", "a.ase", "--save-as", "a.png",
+    "--list-layers", "b.ase", "--scale", "2", "--save-as", "b.png",
+    "c.ase", "--save-as", "c.png" };
+  AppOptions options(sizeof(argv)/sizeof(argv[0]), argv);
+
+  BatchJobs jobs;
+  ASSERT_TRUE(jobs.split(options));
+  ASSERT_EQ(3u, jobs.jobs().size());
+  EXPECT_EQ(Args({ "--trim", "a.ase", "--save-as", "a.png", "--list-layers" }),
+            jobs.jobs()[0]);
+  EXPECT_EQ(Args({ "--trim", "--list-layers", "b.ase",
+                   "--scale", "2", "--save-as", "b.png" }),
+            jobs.jobs()[1]);
+  EXPECT_EQ(Args({ "--trim", "c.ase", "--save-as", "c.png" }),
+            jobs.jobs()[2]);
+}
+
+TEST(BatchJobs, CannotSplit)
+{
+  BatchJobs jobs;
+  {
+    // Just one file
+    const char* argv[] = { "libresprite", "-b", "--jobs", "4", "a.ase", "--save-as", "a.png" };
+    EXPECT_FALSE(jobs.split(AppOptions(sizeof(argv)/sizeof(argv[0]), argv)));
+  }
+  {
+    // One sprite sheet for all files
+    const char* argv[] = { "libresprite", "-b", "--jobs", "4", "a.ase", "b.ase", "--sheet", "c.png" };
+    EXPECT_FALSE(jobs.split(AppOptions(sizeof(argv)/sizeof(argv[0]), argv)));
+  }
+  {
+    // Scripts can use all documents
+    const char* argv[] = { "libresprite", "-b", "--jobs", "4", "a.ase", "b.ase", "--script", "s.js" };
+    EXPECT_FALSE(jobs.split(AppOptions(sizeof(argv)/sizeof(argv[0]), argv)));
+  }
+}
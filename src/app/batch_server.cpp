@@ -0,0 +1,405 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/batch_server.h"
+
+#include "app/app_options.h"
+#include "base/chrono.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+  #include <io.h>
+  #define dup _dup
+  #define dup2 _dup2
+  #define fileno _fileno
+  #define close _close
+  #define STDOUT_FILENO 1
+#else
+  #include <sys/socket.h>
+  #include <sys/stat.h>
+  #include <sys/un.h>
+  #include <unistd.h>
+#endif
+
+namespace app {
+
+namespace {
+
+std::string escape_json(const std::string& str)
+{
+  std::string res;
+  for (unsigned char chr : str) {
+    switch (chr) {
+      case '"': res += "\\\""; break;
+      case '\\': res += "\\\\"; break;
+      case '\n': res += "\\n"; break;
+      case '\r': res += "\\r"; break;
+      case '\t': res += "\\t"; break;
+      default:
+        if (chr < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", chr);
+          res += buf;
+        }
+        else
+          res.push_back(chr);
+        break;
+    }
+  }
+  return res;
+}
+
+// Returns the string value of the given field in a JSON reply of the
+// server (it doesn't support \u escapes of non-ASCII characters, as
+// the server doesn't generate them).
+std::string get_json_string(const std::string& json, const std::string& field)
+{
+  std::string res;
+  std::size_t i = json.find("\"" + field + "\": \"");
+  if (i == std::string::npos)
+    return res;
+
+  for (i += field.size()+5; i<json.size() && json[i] != '"'; ++i) {
+    if (json[i] == '\\' && i+1 < json.size()) {
+      switch (json[++i]) {
+        case 'n': res.push_back('\n'); break;
+        case 'r': res.push_back('\r'); break;
+        case 't': res.push_back('\t'); break;
+        case 'u':
+          res.push_back(char(std::strtol(json.substr(i+1, 4).c_str(), nullptr, 16)));
+          i += 4;
+          break;
+        default: res.push_back(json[i]); break;
+      }
+    }
+    else
+      res.push_back(json[i]);
+  }
+  return res;
+}
+
+int get_json_int(const std::string& json, const std::string& field)
+{
+  std::size_t i = json.find("\"" + field + "\": ");
+  if (i == std::string::npos)
+    return -1;
+  return std::atoi(json.c_str() + i + field.size() + 4);
+}
+
+bool read_line(std::FILE* in, std::string& line)
+{
+  line.clear();
+  int chr;
+  while ((chr = std::fgetc(in)) != EOF) {
+    if (chr == '\n')
+      return true;
+    line.push_back(chr);
+  }
+  return !line.empty();
+}
+
+} // anonymous namespace
+
+BatchServer::BatchServer(const JobFunc& func)
+  : m_func(func)
+  , m_lastId(0)
+{
+}
+
+void BatchServer::serveStdio()
+{
+  serve(stdin, stdout);
+}
+
+#ifdef _WIN32
+
+bool BatchServer::serveSocket(const std::string& path)
+{
+  std::cerr << "UNIX sockets are not supported, use --serve without --socket\n";
+  return false;
+}
+
+int run_batch_client(const AppOptions& options)
+{
+  std::cerr << "UNIX sockets are not supported\n";
+  return 1;
+}
+
+#else
+
+bool BatchServer::serveSocket(const std::string& path)
+{
+  sockaddr_un addr;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path too long: " << path << "\n";
+    return false;
+  }
+
+  int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0) {
+    std::perror("socket");
+    return false;
+  }
+
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::strcpy(addr.sun_path, path.c_str());
+
+  // Remove the socket of a previous server, but never other kind of
+  // files (e.g. a wrong --socket argument pointing to a document)
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      std::cerr << path << " already exists and it isn't a socket\n";
+      close(server);
+      return false;
+    }
+    unlink(path.c_str());
+  }
+
+  if (bind(server, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(server, 16) != 0) {
+    std::perror(path.c_str());
+    close(server);
+    return false;
+  }
+
+  while (true) {
+    int client = accept(server, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR)
+        continue;
+      std::perror("accept");
+      break;
+    }
+
+    std::FILE* in = fdopen(client, "r");
+    std::FILE* out = fdopen(dup(client), "w");
+    if (in && out)
+      serve(in, out);
+    if (in) std::fclose(in); else close(client);
+    if (out) std::fclose(out);
+  }
+
+  close(server);
+  unlink(path.c_str());
+  return true;
+}
+
+int run_batch_client(const AppOptions& options)
+{
+  std::vector<std::string> args;
+  for (const auto& value : options.values()) {
+    const AppOptions::Option* opt = value.option();
+    if (opt != &options.connect() &&
+        opt != &options.socket() &&
+        opt != &options.batch())
+      AppOptions::valueToArgs(value, args);
+  }
+
+  const std::string& path = options.socketPath();
+  sockaddr_un addr;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "--connect needs a valid --socket <path>\n";
+    return 1;
+  }
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::strcpy(addr.sun_path, path.c_str());
+  if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    std::perror(path.c_str());
+    if (fd >= 0)
+      close(fd);
+    return 1;
+  }
+
+  std::string job = BatchServer::joinArgs(args) + "\n";
+  if (write(fd, job.c_str(), job.size()) != ssize_t(job.size())) {
+    std::perror(path.c_str());
+    close(fd);
+    return 1;
+  }
+  shutdown(fd, SHUT_WR);
+
+  std::FILE* in = fdopen(fd, "r");
+  std::string reply;
+  bool ok = (in && read_line(in, reply));
+  if (in)
+    std::fclose(in);
+  else
+    close(fd);
+
+  if (!ok) {
+    std::cerr << "No reply from the server\n";
+    return 1;
+  }
+
+  std::cout << get_json_string(reply, "output") << std::flush;
+  return get_json_int(reply, "exitCode");
+}
+
+#endif
+
+void BatchServer::serve(std::FILE* in, std::FILE* out)
+{
+  std::string line;
+  while (read_line(in, line)) {
+    // Ignore empty lines
+    if (line.find_first_not_of(" \t\r") == std::string::npos)
+      continue;
+
+    std::string reply = runJob(line);
+    std::fputs(reply.c_str(), out);
+    std::fputc('\n', out);
+    std::fflush(out);
+  }
+}
+
+std::string BatchServer::runJob(const std::string& line)
+{
+  int id = ++m_lastId;
+  int exitCode = 0;
+  base::Chrono chrono;
+
+  // Redirect stdout to a temporary file to get the output of the job
+  std::fflush(stdout);
+  std::cout.flush();
+  std::FILE* output = std::tmpfile();
+  int oldStdout = -1;
+  if (output) {
+    oldStdout = dup(STDOUT_FILENO);
+    dup2(fileno(output), STDOUT_FILENO);
+  }
+
+  std::vector<std::string> args;
+  args.push_back("libresprite");
+  if (!splitArgs(line, args)) {
+    std::cout << "Unterminated quote in job\n";
+    exitCode = 2;
+  }
+  else {
+    std::vector<const char*> argv;
+    for (const auto& arg : args)
+      argv.push_back(arg.c_str());
+
+    try {
+      // AppOptions prints the parse error details in stderr
+      AppOptions options(int(argv.size()), &argv[0]);
+      if (options.isValid())
+        exitCode = m_func(options);
+      else {
+        std::cout << "Invalid arguments in job\n";
+        exitCode = 2;
+      }
+    }
+    catch (const std::exception& ex) {
+      std::cout << ex.what() << "\n";
+      exitCode = 1;
+    }
+  }
+
+  std::string text;
+  std::fflush(stdout);
+  std::cout.flush();
+  if (output) {
+    dup2(oldStdout, STDOUT_FILENO);
+    close(oldStdout);
+
+    char buf[4096];
+    std::size_t bytes;
+    std::rewind(output);
+    while ((bytes = std::fread(buf, 1, sizeof(buf), output)) > 0)
+      text.append(buf, bytes);
+    std::fclose(output);
+  }
+
+  std::ostringstream reply;
+  reply << "{ \"id\": " << id
+        << ", \"exitCode\": " << exitCode
+        << ", \"time\": " << chrono.elapsed()
+        << ", \"output\": \"" << escape_json(text) << "\" }";
+  return reply.str();
+}
+
+bool BatchServer::splitArgs(const std::string& line, std::vector<std::string>& args)
+{
+  std::string arg;
+  bool hasArg = false;
+  char quote = 0;
+
+  for (std::size_t i=0; i<line.size(); ++i) {
+    char chr = line[i];
+    if (quote == '\'') {
+      if (chr == '\'')
+        quote = 0;
+      else
+        arg.push_back(chr);
+    }
+    else if (chr == '\\' && i+1 < line.size() &&
+             (!quote || line[i+1] == '"' || line[i+1] == '\\')) {
+      arg.push_back(line[++i]);
+      hasArg = true;
+    }
+    else if (quote == '"') {
+      if (chr == '"')
+        quote = 0;
+      else
+        arg.push_back(chr);
+    }
+    else if (chr == '"' || chr == '\'') {
+      quote = chr;
+      hasArg = true;
+    }
+    else if (chr == ' ' || chr == '\t' || chr == '\r') {
+      if (hasArg) {
+        args.push_back(arg);
+        arg.clear();
+        hasArg = false;
+      }
+    }
+    else {
+      arg.push_back(chr);
+      hasArg = true;
+    }
+  }
+
+  if (hasArg)
+    args.push_back(arg);
+  return (quote == 0);
+}
+
+std::string BatchServer::joinArgs(const std::vector<std::string>& args)
+{
+  std::string line;
+  for (const auto& arg : args) {
+    if (!line.empty())
+      line.push_back(' ');
+
+    line.push_back('"');
+    for (char chr : arg) {
+      if (chr == '"' || chr == '\\')
+        line.push_back('\\');
+      line.push_back(chr);
+    }
+    line.push_back('"');
+  }
+  return line;
+}
+
+} // namespace app
@@ -0,0 +1,62 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace app {
+  class AppOptions;
+
+  // Keeps the program running to process jobs without paying the
+  // startup cost for each one (--serve). Each job is a line with the
+  // same arguments of the command line (e.g. "a.ase --save-as a.png",
+  // quoted like in a shell), and the server replies with a line of
+  // JSON:
+  //
+  //   { "id": 1, "exitCode": 0, "time": 0.25, "output": "..." }
+  //
+  // where "output" is what the job printed in stdout.
+  class BatchServer {
+  public:
+    // Runs one job and returns its exit code.
+    typedef std::function<int(const AppOptions& options)> JobFunc;
+
+    explicit BatchServer(const JobFunc& func);
+
+    // Reads jobs from "in" and replies in "out" until "in" is closed.
+    void serve(std::FILE* in, std::FILE* out);
+
+    // Same as serve() with stdin and stdout.
+    void serveStdio();
+
+    // Reads jobs from the clients connected to the given UNIX socket
+    // (one client at a time). Returns false if the socket cannot be
+    // created.
+    bool serveSocket(const std::string& path);
+
+    // Splits a job line in arguments, returns false if a quote is not
+    // closed.
+    static bool splitArgs(const std::string& line, std::vector<std::string>& args);
+    static std::string joinArgs(const std::vector<std::string>& args);
+
+  private:
+    std::string runJob(const std::string& line);
+
+    JobFunc m_func;
+    int m_lastId;
+  };
+
+  // Sends the command line (without --connect and --socket) as a job
+  // to the server and prints its output (--connect). Returns the exit
+  // code of the job.
+  int run_batch_client(const AppOptions& options);
+
+} // namespace app
@@ -0,0 +1,119 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/test.h"
+
+#include "app/app_options.h"
+#include "app/batch_server.h"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace app;
+
+typedef std::vector<std::string> Args;
+
+TEST(BatchServer, SplitArgs)
+{
+  Args args;
+  EXPECT_TRUE(BatchServer::splitArgs(
+      "a.ase  --save-as \"b c.png\" 'd \"e\"' f\\ g \"h\\\"i\" \"\"", args));
+  EXPECT_EQ(Args({ "a.ase", "--save-as", "b c.png", "d \"e\"", "f g", "h\"i", "" }), args);
+
+  args.clear();
+  EXPECT_FALSE(BatchServer::splitArgs("a.ase \"b", args));
+}
+
+TEST(BatchServer, JoinArgs)
+{
+  Args args = { "a.ase", "--save-as", "b \"c\\\".png", "" };
+  std::string line = BatchServer::joinArgs(args);
+
+  Args result;
+  EXPECT_TRUE(BatchServer::splitArgs(line, result));
+  EXPECT_EQ(args, result);
+}
+
+TEST(BatchServer, RunJobs)
+{
+  std::FILE* in = std::tmpfile();
+  std::FILE* out = std::tmpfile();
+  std::fputs("a.ase --save-as b.png\n\nc.ase\n", in);
+  std::rewind(in);
+
+  std::vector<std::string> files;
+  BatchServer server(
+    [&files](const AppOptions& options) {
+      for (const auto& value : options.values()) {
+        if (!value.option())
+          files.push_back(value.value());
+      }
+      std::printf("%d\n", int(files.size()));
+      return int(files.size());
+    });
+  server.serve(in, out);
+
+  EXPECT_EQ(Args({ "a.ase", "c.ase" }), files);
+
+  std::rewind(out);
+  char buf[256];
+  ASSERT_TRUE(std::fgets(buf, sizeof(buf), out));
+  EXPECT_EQ(0, std::strncmp(buf, "{ \"id\": 1, \"exitCode\": 1, \"time\": ", 34));
+  EXPECT_TRUE(std::strstr(buf, "\"output\": \"1\\n\" }") != nullptr);
+  ASSERT_TRUE(std::fgets(buf, sizeof(buf), out));
+  EXPECT_EQ(0, std::strncmp(buf, "{ \"id\": 2, \"exitCode\": 2, ", 26));
+
+  std::fclose(in);
+  std::fclose(out);
+}
+
+TEST(BatchServer, InvalidJobArgs)
+{
+  std::FILE* in = std::tmpfile();
+  std::FILE* out = std::tmpfile();
+  std::fputs("a.ase --unknown-option\n", in);
+  std::rewind(in);
+
+  int calls = 0;
+  BatchServer server(
+    [&calls](const AppOptions&) {
+      ++calls;
+      return 0;
+    });
+  server.serve(in, out);
+
+  EXPECT_EQ(0, calls);
+
+  std::rewind(out);
+  char buf[256];
+  ASSERT_TRUE(std::fgets(buf, sizeof(buf), out));
+  EXPECT_EQ(0, std::strncmp(buf, "{ \"id\": 1, \"exitCode\": 2, ", 26));
+
+  std::fclose(in);
+  std::fclose(out);
+}
+
+#ifndef _WIN32
+
+TEST(BatchServer, DontRemoveFilesAsSocket)
+{
+  const char* fn = "_batch_server_tests.txt";
+  std::FILE* f = std::fopen(fn, "w");
+  ASSERT_TRUE(f != nullptr);
+  std::fputs("data", f);
+  std::fclose(f);
+
+  BatchServer server([](const AppOptions&) { return 0; });
+  EXPECT_FALSE(server.serveSocket(fn));
+
+  f = std::fopen(fn, "r");
+  ASSERT_TRUE(f != nullptr);
+  std::fclose(f);
+  std::remove(fn);
+}
+
+#endif
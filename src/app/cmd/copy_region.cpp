@@ -11,6 +11,7 @@
 
 #include "app/cmd/copy_region.h"
 
+#include "base/rle.h"
 #include "doc/image.h"
 
 #include <algorithm>
@@ -23,7 +24,6 @@ CopyRegion::CopyRegion(Image* dst, const Image* src,
                        const gfx::Point& dstPos,
                        bool alreadyCopied)
   : WithImage(dst)
-  , m_size(0)
   , m_alreadyCopied(alreadyCopied)
 {
   // Create region to save/swap later
@@ -39,16 +39,23 @@ CopyRegion::CopyRegion(Image* dst, const Image* src,
     m_region.createUnion(m_region, gfx::Region(clip.dstBounds()));
   }
 
-  // Save region pixels
+  // Save the XOR delta between src and dst pixels. Only modified
+  // pixels are non-zero, so the delta is highly compressible.
+  base::buffer delta;
   for (const auto& rc : m_region) {
+    const size_t rowSize = src->getRowStrideSize(rc.w);
     for (int y=0; y<rc.h; ++y) {
-      m_stream.write(
-        (const char*)src->getPixelAddress(rc.x-dstPos.x,
-                                          rc.y-dstPos.y+y),
-        src->getRowStrideSize(rc.w));
+      const uint8_t* s = (const uint8_t*)src->getPixelAddress(rc.x-dstPos.x,
+                                                              rc.y-dstPos.y+y);
+      const uint8_t* d = (const uint8_t*)dst->getPixelAddress(rc.x, rc.y+y);
+      const size_t pos = delta.size();
+      delta.resize(pos+rowSize);
+      for (size_t i=0; i<rowSize; ++i)
+        delta[pos+i] = s[i] ^ d[i];
     }
   }
-  m_size = size_t(m_stream.tellp());
+  base::encode_rle(delta, m_delta);
+  m_delta.shrink_to_fit();
 }
 
 void CopyRegion::onExecute()
@@ -71,27 +78,24 @@ void CopyRegion::swap()
 {
   Image* image = this->image();
 
-  // Save current image region in "tmp" stream
-  std::stringstream tmp;
-  for (const auto& rc : m_region)
-    for (int y=0; y<rc.h; ++y)
-      tmp.write(
-        (const char*)image->getPixelAddress(rc.x, rc.y+y),
-        image->getRowStrideSize(rc.w));
+  base::buffer delta;
+  if (!base::decode_rle(m_delta, delta)) {
+    ASSERT(false);
+    return;
+  }
 
-  // Restore m_stream into the image
-  m_stream.seekg(0, std::ios_base::beg);
+  // XOR the delta into the image, which toggles the region between
+  // the original and the new pixels.
+  const uint8_t* p = delta.data();
   for (const auto& rc : m_region) {
+    const size_t rowSize = image->getRowStrideSize(rc.w);
     for (int y=0; y<rc.h; ++y) {
-      m_stream.read(
-        (char*)image->getPixelAddress(rc.x, rc.y+y),
-        image->getRowStrideSize(rc.w));
+      uint8_t* d = (uint8_t*)image->getPixelAddress(rc.x, rc.y+y);
+      for (size_t i=0; i<rowSize; ++i)
+        d[i] ^= *(p++);
     }
   }
-
-  // TODO use m_stream.swap(tmp) when clang and gcc support it
-  m_stream.str(tmp.str());
-  m_stream.clear();
+  ASSERT(p == delta.data()+delta.size());
 
   image->incrementVersion();
 }
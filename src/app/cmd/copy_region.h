@@ -9,11 +9,10 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
+#include "base/buffer.h"
 #include "gfx/point.h"
 #include "gfx/region.h"
 
-#include <sstream>
-
 namespace app {
 namespace cmd {
   using namespace doc;
@@ -35,16 +34,18 @@ namespace cmd {
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + m_size;
+      return sizeof(*this) + m_delta.size();
     }
 
   private:
     void swap();
 
-    size_t m_size;
     bool m_alreadyCopied;
     gfx::Region m_region;
-    std::stringstream m_stream;
+    // RLE-compressed XOR delta between the "dst" and "src" pixels
+    // in m_region. As XOR is its own inverse, applying it to the
+    // image swaps between the old and the new pixels.
+    base::buffer m_delta;
   };
 
 } // namespace cmd
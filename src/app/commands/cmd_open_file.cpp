@@ -45,6 +45,7 @@ protected:
 private:
   std::string m_filename;
   std::string m_folder;
+  bool m_compact;
 };
 
 class OpenFileJob : public Job, public IFileOpProgress
@@ -92,6 +93,7 @@ OpenFileCommand::OpenFileCommand()
   : Command("OpenFile",
             "Open Sprite",
             CmdRecordableFlag)
+  , m_compact(false)
 {
 }
 
@@ -99,6 +101,10 @@ void OpenFileCommand::onLoadParams(const Params& params)
 {
   m_filename = params.get("filename");
   m_folder = params.get("folder"); // Initial folder
+
+  // Crop cels and link identical frames to use less memory (e.g. to
+  // import long animations)
+  m_compact = (params.get("compact") == "true");
 }
 
 void OpenFileCommand::onExecute(Context* context)
@@ -121,7 +127,9 @@ void OpenFileCommand::onExecute(Context* context)
   if (!m_filename.empty()) {
     std::unique_ptr<FileOp> fop(
       FileOp::createLoadDocumentOperation(
-        context, m_filename.c_str(), FILE_LOAD_SEQUENCE_ASK));
+        context, m_filename.c_str(),
+        FILE_LOAD_SEQUENCE_ASK | FILE_LOAD_LAZY |
+        (m_compact ? FILE_LOAD_COMPACT: 0)));
     bool unrecent = false;
 
     if (fop) {
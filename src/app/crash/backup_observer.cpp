@@ -13,6 +13,7 @@
 
 #include "app/app.h"
 #include "app/crash/session.h"
+#include "app/crash/write_document.h"
 #include "app/document.h"
 #include "app/pref/preferences.h"
 #include "base/bind.h"
@@ -21,6 +22,9 @@
 #include "base/scoped_lock.h"
 #include "doc/context.h"
 
+#include <algorithm>
+#include <memory>
+
 namespace app {
 namespace crash {
 
@@ -56,11 +60,9 @@ void BackupObserver::onAddDocument(doc::Document* document)
 void BackupObserver::onRemoveDocument(doc::Document* document)
 {
   TRACE("DataRecovery:: Remove document %p\n", document);
-  {
-    base::scoped_lock hold(m_mutex);
-    base::remove_from_container(m_documents, static_cast<app::Document*>(document));
-  }
-  m_session->removeDocument(static_cast<app::Document*>(document));
+  base::scoped_lock hold(m_mutex);
+  base::remove_from_container(m_documents, static_cast<app::Document*>(document));
+  m_closedDocuments.push_back(document->id());
 }
 
 void BackupObserver::backgroundThread()
@@ -78,30 +80,76 @@ void BackupObserver::backgroundThread()
   while (!m_done) {
     seconds++;
     if (seconds >= waitUntil) {
-      TRACE("DataRecovery: Start backup process for %d documents\n", m_documents.size());
-
-      base::scoped_lock hold(m_mutex);
       base::Chrono chrono;
-      bool somethingLocked = false;
-
-      for (app::Document* doc : m_documents) {
-        try {
-          if (doc->needsBackup())
-            m_session->saveDocumentChanges(doc);
-        }
-        catch (const std::exception&) {
-          TRACE("DataRecovery: Document '%d' is locked\n", doc->id());
-          somethingLocked = true;
-        }
-      }
+      bool somethingLocked = backupDocuments();
 
       seconds = 0;
       waitUntil = (somethingLocked ? lockedPeriod: normalPeriod);
 
       TRACE("DataRecovery: Backup process done (%.16g)\n", chrono.elapsed());
     }
+    removeClosedDocuments();
     base::this_thread::sleep_for(1.0);
   }
+  removeClosedDocuments();
+}
+
+// Saves the changes of all documents, returns true if some document
+// was locked (so it couldn't be saved). The m_mutex is locked only to
+// take the snapshot of each document (so it cannot be closed in the
+// meantime), and snapshots are compressed and written without locks.
+bool BackupObserver::backupDocuments()
+{
+  std::vector<app::Document*> documents;
+  {
+    base::scoped_lock hold(m_mutex);
+    documents = m_documents;
+  }
+  TRACE("DataRecovery: Start backup process for %d documents\n", documents.size());
+
+  bool somethingLocked = false;
+  for (app::Document* doc : documents) {
+    std::unique_ptr<DocumentSnapshot> snapshot;
+    {
+      base::scoped_lock hold(m_mutex);
+
+      // The document could be closed after we copied the list
+      if (std::find(m_documents.begin(), m_documents.end(), doc) == m_documents.end() ||
+          !doc->needsBackup())
+        continue;
+
+      try {
+        snapshot = m_session->snapshotDocument(doc);
+      }
+      catch (const std::exception&) {
+        TRACE("DataRecovery: Document '%d' is locked\n", doc->id());
+        somethingLocked = true;
+        continue;
+      }
+    }
+
+    try {
+      m_session->writeDocumentSnapshot(snapshot.get());
+    }
+    catch (const std::exception& ex) {
+      TRACE("DataRecovery: Error writing document '%d': %s\n",
+            snapshot->docId(), ex.what());
+    }
+  }
+  return somethingLocked;
+}
+
+// Deletes the backup of closed documents (it's done in this thread
+// because their last snapshot could be being written).
+void BackupObserver::removeClosedDocuments()
+{
+  std::vector<doc::ObjectId> closed;
+  {
+    base::scoped_lock hold(m_mutex);
+    closed.swap(m_closedDocuments);
+  }
+  for (doc::ObjectId docId : closed)
+    m_session->removeDocument(docId);
 }
 
 } // namespace crash
@@ -12,6 +12,7 @@
 #include "doc/context_observer.h"
 #include "doc/document_observer.h"
 #include "doc/documents_observer.h"
+#include "doc/object_id.h"
 
 #include <vector>
 
@@ -38,11 +39,16 @@ namespace crash {
 
   private:
     void backgroundThread();
+    bool backupDocuments();
+    void removeClosedDocuments();
 
     Session* m_session;
     base::mutex m_mutex;
     doc::Context* m_ctx;
     std::vector<app::Document*> m_documents;
+    // Closed documents, their backups are removed in the background
+    // thread (so they are not removed while they are written).
+    std::vector<doc::ObjectId> m_closedDocuments;
     bool m_done;
     base::thread m_thread;
   };
@@ -13,6 +13,7 @@
 
 #include "app/console.h"
 #include "app/crash/internals.h"
+#include "app/crash/tiled_image_io.h"
 #include "app/document.h"
 #include "base/convert_to.h"
 #include "base/exception.h"
@@ -21,6 +22,7 @@
 #include "base/path.h"
 #include "base/serialization.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
 #include "doc/cel.h"
 #include "doc/cel_data_io.h"
 #include "doc/cel_io.h"
@@ -28,17 +30,23 @@
 #include "doc/frame.h"
 #include "doc/frame_tag.h"
 #include "doc/frame_tag_io.h"
+#include "doc/image_loader.h"
 #include "doc/image_io.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/palette_io.h"
+#include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "doc/string_io.h"
 #include "doc/subobjects_io.h"
 
+#include <algorithm>
 #include <fstream>
+#include <iterator>
 #include <map>
 #include <memory>
+#include <set>
+#include <sstream>
 
 namespace app {
 namespace crash {
@@ -49,6 +57,156 @@ using namespace doc;
 
 namespace {
 
+// Images are saved as tiles (see tiled_image_io.h), or as one block
+// of pixels in backups of previous versions.
+Image* read_backup_image(std::istream& s)
+{
+  std::istream::pos_type pos = s.tellg();
+  if (read32(s) == TILED_IMAGE_MAGIC_NUMBER)
+    return read_tiled_image(s, false);
+
+  s.seekg(pos);
+  return read_image(s, false);
+}
+
+std::string object_filename(const char* prefix, ObjectId id, ObjectVersion ver)
+{
+  std::string fn = prefix;
+  fn.push_back('-');
+  fn += base::convert_to<std::string>(id);
+  fn.push_back('.');
+  fn += base::convert_to<std::string>(ver);
+  return fn;
+}
+
+// Content of the backup file of an image (without the magic number)
+// and the image properties from its header.
+struct BackupImageData {
+  size_t versionIndex;          // Index of the file version in ObjVersions
+  PixelFormat format;
+  int width;
+  int height;
+  color_t maskColor;
+  std::string data;
+};
+typedef std::shared_ptr<BackupImageData> BackupImageDataPtr;
+
+// Reads the header of an image (tiled or not) without its pixels.
+bool read_backup_image_header(std::istream& s, BackupImageData& img)
+{
+  // The ID is after the tiled image magic number, or it's the first
+  // field in images of previous versions.
+  if (read32(s) == TILED_IMAGE_MAGIC_NUMBER)
+    read32(s);
+
+  img.format = (PixelFormat)read8(s);
+  img.width = read16(s);
+  img.height = read16(s);
+  img.maskColor = read32(s);
+
+  return
+    (s.good() &&
+     (img.format == IMAGE_RGB ||
+      img.format == IMAGE_GRAYSCALE ||
+      img.format == IMAGE_INDEXED ||
+      img.format == IMAGE_BITMAP) &&
+     img.width >= 1 && img.height >= 1 &&
+     img.width <= 0xfffff && img.height <= 0xfffff);
+}
+
+// Reads the file of the newest valid version of an image (starting
+// from the given index of "versions"). It can be called from any
+// thread.
+BackupImageDataPtr read_backup_image_data(const std::string& dir,
+                                          ObjectId id,
+                                          const ObjVersions& versions,
+                                          size_t firstIndex = 0)
+{
+  for (size_t i=firstIndex; i<versions.size(); ++i) {
+    ObjectVersion ver = versions[i];
+    if (!ver)
+      continue;
+
+    std::ifstream f(FSTREAM_PATH(base::join_path(dir, object_filename("img", id, ver))),
+                    std::ifstream::binary);
+    std::string data((std::istreambuf_iterator<char>(f)),
+                     std::istreambuf_iterator<char>());
+
+    BackupImageDataPtr img = std::make_shared<BackupImageData>();
+    std::istringstream s(data);
+    if (read32(s) == MAGIC_NUMBER &&
+        read_backup_image_header(s, *img)) {
+      img->versionIndex = i;
+      img->data = data.substr(4);
+      return img;
+    }
+  }
+  return nullptr;
+}
+
+// Inflates the pixels of a restored image from the content of its
+// backup file the first time the image is used. If that version of
+// the image cannot be decoded, the older versions are tried (as
+// Reader::loadObject() does with other objects). If all of them
+// fail, the image is left empty and the loader is marked as failed,
+// so the document cannot be saved with the wrong pixels.
+class BackupImageLoader : public ImageLoader {
+public:
+  BackupImageLoader(const std::string& dir,
+                    ObjectId id,
+                    const ObjVersions& versions,
+                    const BackupImageDataPtr& data)
+    : m_dir(dir)
+    , m_id(id)
+    , m_versions(versions)
+    , m_data(data) {
+  }
+
+protected:
+  void onLoad(Image* image) override {
+    BackupImageDataPtr data = m_data;
+    m_data.reset();
+
+    while (data) {
+      if (decode(*data, image))
+        return;
+
+      TRACE(" - img #%d v%d was not restored\n",
+            m_id, m_versions[int(data->versionIndex)]);
+      data = read_backup_image_data(m_dir, m_id, m_versions,
+                                    data->versionIndex+1);
+    }
+
+    TRACE(" - Error loading object img #%d\n", m_id);
+    clear_image(image, image->maskColor());
+    setFailed();
+  }
+
+private:
+  static bool decode(const BackupImageData& data, Image* image) {
+    try {
+      std::istringstream s(data.data);
+      std::unique_ptr<Image> pixels(read_backup_image(s));
+      if (pixels &&
+          pixels->pixelFormat() == image->pixelFormat() &&
+          pixels->width() == image->width() &&
+          pixels->height() == image->height()) {
+        copy_image(image, pixels.get());
+        return true;
+      }
+    }
+    catch (const std::exception&) {
+      // Try the next version
+    }
+    return false;
+  }
+
+  std::string m_dir;
+  ObjectId m_id;
+  ObjVersions m_versions;
+  BackupImageDataPtr m_data;
+};
+
 class Reader : public SubObjectsIO {
 public:
   Reader(const std::string& dir)
@@ -74,6 +232,9 @@ public:
       ObjVersions& versions = m_objVersions[id];
       versions.add(ver);
 
+      if (fn.compare(0, 4, "img-") == 0)
+        m_imageIds.insert(id);
+
       if (fn.compare(0, 3, "doc") == 0) {
         if (!m_docId)
           m_docId = id;
@@ -87,7 +248,13 @@ public:
   }
 
   app::Document* loadDocument() {
+    preloadImages();
+
     app::Document* doc = loadObject<app::Document*>("doc", m_docId, &Reader::readDocument);
+
+    // Files of images that aren't used by the document
+    m_preloadedImages.clear();
+
     if (doc)
       fixUndetectedDocumentIssues(doc);
     else
@@ -116,10 +283,51 @@ private:
     return loadObject<Sprite*>("spr", sprId, &Reader::readSprite);
   }
 
+  // Reads the files of all images in parallel, so the document can
+  // be created without waiting the disk for each image. Each image is
+  // created when a cel uses it (see getImageRef()), and its pixels
+  // are inflated the first time it's used (see BackupImageLoader).
+  void preloadImages() {
+    std::vector<ObjectId> ids(m_imageIds.begin(), m_imageIds.end());
+    std::vector<ObjVersions> versions(ids.size());
+    for (size_t i=0; i<ids.size(); ++i)
+      versions[i] = m_objVersions[ids[i]];
+
+    std::vector<BackupImageDataPtr> data(ids.size());
+    if (!ids.empty()) {
+      base::thread_pool pool(std::min(ids.size(),
+                                      base::thread_pool::default_size()));
+      base::parallel_for(
+        pool, ids.size(),
+        [this, &ids, &versions, &data](std::size_t i){
+          data[i] = read_backup_image_data(m_dir, ids[i], versions[i]);
+        });
+    }
+
+    // Images that cannot be read are loaded later with loadObject()
+    // (to report the error).
+    for (size_t i=0; i<ids.size(); ++i)
+      if (data[i])
+        m_preloadedImages[ids[i]] = data[i];
+  }
+
   ImageRef getImageRef(ObjectId imageId) {
     if (m_images.find(imageId) != m_images.end())
       return m_images[imageId];
 
+    auto it = m_preloadedImages.find(imageId);
+    if (it != m_preloadedImages.end()) {
+      BackupImageDataPtr data = it->second;
+      m_preloadedImages.erase(it);
+
+      ImageRef image(Image::create(data->format, data->width, data->height));
+      image->setMaskColor(data->maskColor);
+      m_imageLoaders[image.get()] =
+        std::make_shared<BackupImageLoader>(m_dir, imageId,
+                                            m_objVersions[imageId], data);
+      return m_images[imageId] = image;
+    }
+
     ImageRef image(loadObject<Image*>("img", imageId, &Reader::readImage));
     return m_images[imageId] = image;
   }
@@ -143,11 +351,7 @@ private:
 
       TRACE(" - Restoring %s #%d v%d\n", prefix, id, ver);
 
-      std::string fn = prefix;
-      fn.push_back('-');
-      fn += base::convert_to<std::string>(id);
-      fn.push_back('.');
-      fn += base::convert_to<std::string>(ver);
+      std::string fn = object_filename(prefix, id, ver);
 
       std::ifstream s(FSTREAM_PATH(base::join_path(m_dir, fn)), std::ifstream::binary);
       T obj = nullptr;
@@ -217,7 +421,7 @@ private:
     if (m_loadInfo) {
       m_loadInfo->format = format;
       m_loadInfo->width = w;
-      m_loadInfo->height = w;
+      m_loadInfo->height = h;
       m_loadInfo->frames = nframes;
       return (Sprite*)1;
     }
@@ -315,11 +519,17 @@ private:
   }
 
   CelData* readCelData(std::ifstream& s) {
-    return read_celdata(s, this, false);
+    CelData* celData = read_celdata(s, this, false);
+    if (celData) {
+      auto it = m_imageLoaders.find(celData->imageRef().get());
+      if (it != m_imageLoaders.end())
+        celData->setImageLoader(it->second);
+    }
+    return celData;
   }
 
   Image* readImage(std::ifstream& s) {
-    return read_image(s, false);
+    return read_backup_image(s);
   }
 
   std::shared_ptr<Palette> readPalette(std::ifstream& s) {
@@ -359,7 +569,10 @@ private:
   ObjVersionsMap m_objVersions;
   ObjVersions* m_docVersions;
   DocumentInfo* m_loadInfo;
+  std::set<ObjectId> m_imageIds;
+  std::map<ObjectId, BackupImageDataPtr> m_preloadedImages;
   std::map<ObjectId, ImageRef> m_images;
+  std::map<const Image*, ImageLoaderRef> m_imageLoaders;
   std::map<ObjectId, CelDataRef> m_celdatas;
 };
 
@@ -409,7 +622,7 @@ app::Document* read_document_with_raw_images(const std::string& dir,
 
     ImageRef img;
     if (read32(s) == MAGIC_NUMBER)
-      img.reset(read_image(s, false));
+      img.reset(read_backup_image(s));
 
     if (img) {
         lay->addCel(std::make_shared<Cel>(frame, img));
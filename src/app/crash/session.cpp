@@ -129,29 +129,37 @@ void Session::removeFromDisk()
   }
 }
 
-void Session::saveDocumentChanges(app::Document* doc)
+std::unique_ptr<DocumentSnapshot> Session::snapshotDocument(app::Document* doc)
 {
+  // The document is locked only to copy the modified objects, so the
+  // user can continue editing it while they are compressed and
+  // written in the disk.
   DocumentReader reader(doc, 250);
+  return snapshot_document(doc);
+}
+
+void Session::writeDocumentSnapshot(const DocumentSnapshot* snapshot)
+{
   app::Context ctx;
   std::string dir = base::join_path(m_path,
-    base::convert_to<std::string>(doc->id()));
+    base::convert_to<std::string>(snapshot->docId()));
   TRACE("DataRecovery: Saving document '%s'...\n", dir.c_str());
 
   if (!base::is_directory(dir))
     base::make_directory(dir);
 
   // Save document information
-  write_document(dir, doc);
+  write_document_snapshot(dir, snapshot);
 }
 
-void Session::removeDocument(app::Document* doc)
+void Session::removeDocument(doc::ObjectId docId)
 {
   try {
-    delete_document_internals(doc);
+    delete_document_internals(docId);
 
     // Delete document backup directory
     std::string dir = base::join_path(m_path,
-      base::convert_to<std::string>(doc->id()));
+      base::convert_to<std::string>(docId));
     if (base::is_directory(dir))
       deleteDirectory(dir);
   }
@@ -11,8 +11,10 @@
 #include "base/disable_copying.h"
 #include "base/process.h"
 #include "base/shared_ptr.h"
+#include "doc/object_id.h"
 
 #include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -20,6 +22,7 @@ namespace app {
   class Document;
 
 namespace crash {
+  class DocumentSnapshot;
 
   // A class to record/restore session information.
   class Session {
@@ -47,8 +50,11 @@ namespace crash {
     void create(base::pid pid);
     void removeFromDisk();
 
-    void saveDocumentChanges(app::Document* doc);
-    void removeDocument(app::Document* doc);
+    // Saving a document is done in two steps, so the document is
+    // locked only to take the snapshot, and written without locks.
+    std::unique_ptr<DocumentSnapshot> snapshotDocument(app::Document* doc);
+    void writeDocumentSnapshot(const DocumentSnapshot* snapshot);
+    void removeDocument(doc::ObjectId docId);
 
     void restoreBackup(Backup* backup);
     void restoreRawImages(Backup* backup, RawImagesAs as);
@@ -0,0 +1,218 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/crash/tiled_image_io.h"
+
+#include "base/exception.h"
+#include "base/serialization.h"
+#include "doc/image.h"
+#include "gfx/rect.h"
+#include "zlib.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+namespace app {
+namespace crash {
+
+using namespace base::serialization;
+using namespace base::serialization::little_endian;
+using namespace doc;
+
+namespace {
+
+const uint32_t RECORD_BEGIN = 0x43455254; // 'TREC' in ASCII
+const uint32_t RECORD_END = 0x444E4554;   // 'TEND' in ASCII
+
+int tile_columns(int width) {
+  return (width + IMAGE_TILE_SIZE - 1) / IMAGE_TILE_SIZE;
+}
+
+int tile_rows(int height) {
+  return (height + IMAGE_TILE_SIZE - 1) / IMAGE_TILE_SIZE;
+}
+
+gfx::Rect tile_bounds(int width, int height, int tile) {
+  int cols = tile_columns(width);
+  gfx::Rect bounds((tile % cols) * IMAGE_TILE_SIZE,
+                   (tile / cols) * IMAGE_TILE_SIZE,
+                   IMAGE_TILE_SIZE, IMAGE_TILE_SIZE);
+  return bounds.createIntersection(gfx::Rect(0, 0, width, height));
+}
+
+} // anonymous namespace
+
+void calculate_image_tile_hashes(const Image* image,
+                                 ImageTileHashes& hashes)
+{
+  int ntiles = tile_columns(image->width()) * tile_rows(image->height());
+  hashes.resize(ntiles);
+
+  for (int tile=0; tile<ntiles; ++tile) {
+    gfx::Rect bounds = tile_bounds(image->width(), image->height(), tile);
+    int rowSize = image->getRowStrideSize(bounds.w);
+
+    uLong crc = crc32(0, Z_NULL, 0);
+    uLong adler = adler32(0, Z_NULL, 0);
+    for (int y=bounds.y; y<bounds.y2(); ++y) {
+      const Bytef* row = (const Bytef*)image->getPixelAddress(bounds.x, y);
+      crc = crc32(crc, row, rowSize);
+      adler = adler32(adler, row, rowSize);
+    }
+    hashes[tile] = (uint64_t(crc) << 32) | uint64_t(adler & 0xffffffff);
+  }
+}
+
+void write_tiled_image_header(std::ostream& os, const Image* image,
+                              ObjectId id)
+{
+  write32(os, TILED_IMAGE_MAGIC_NUMBER);
+  write32(os, id);
+  write8(os, image->pixelFormat());    // Pixel format
+  write16(os, image->width());         // Width
+  write16(os, image->height());        // Height
+  write32(os, image->maskColor());     // Mask color
+  write16(os, IMAGE_TILE_SIZE);        // Tile size
+}
+
+void copy_image_tiles(const Image* image,
+                      const std::vector<int>& tiles,
+                      ImageTilesPixels& result)
+{
+  result.resize(tiles.size());
+  for (std::size_t i=0; i<tiles.size(); ++i) {
+    gfx::Rect bounds = tile_bounds(image->width(), image->height(), tiles[i]);
+    int rowSize = image->getRowStrideSize(bounds.w);
+
+    result[i].tile = tiles[i];
+    result[i].pixels.resize(rowSize * bounds.h);
+    for (int y=0; y<bounds.h; ++y)
+      std::copy_n(image->getPixelAddress(bounds.x, bounds.y+y), rowSize,
+                  result[i].pixels.begin() + y*rowSize);
+  }
+}
+
+void write_tiled_image_record(std::ostream& os,
+                              const ImageTilesPixels& tiles)
+{
+  std::vector<uint8_t> compressed;
+
+  write32(os, RECORD_BEGIN);
+  write32(os, tiles.size());
+
+  for (const auto& tile : tiles) {
+    const std::vector<uint8_t>& pixels = tile.pixels;
+
+    uLongf compressedSize = compressBound(pixels.size());
+    compressed.resize(compressedSize);
+    int err = compress2(&compressed[0], &compressedSize,
+                        &pixels[0], pixels.size(), Z_BEST_SPEED);
+    if (err != Z_OK)
+      throw base::Exception("ZLib error %d in compress2().", err);
+
+    write32(os, tile.tile);
+    write32(os, compressedSize);
+    if (os.write((const char*)&compressed[0], compressedSize).fail())
+      throw base::Exception("Error writing compressed image tile.\n");
+  }
+
+  write32(os, RECORD_END);
+}
+
+Image* read_tiled_image(std::istream& is, bool setId)
+{
+  ObjectId id = read32(is);
+  int pixelFormat = read8(is);          // Pixel format
+  int width = read16(is);               // Width
+  int height = read16(is);              // Height
+  uint32_t maskColor = read32(is);      // Mask color
+  int tileSize = read16(is);            // Tile size
+
+  if ((pixelFormat != IMAGE_RGB &&
+       pixelFormat != IMAGE_GRAYSCALE &&
+       pixelFormat != IMAGE_INDEXED &&
+       pixelFormat != IMAGE_BITMAP) ||
+      (width < 1 || height < 1) ||
+      (width > 0xfffff || height > 0xfffff) ||
+      (tileSize != IMAGE_TILE_SIZE))
+    return nullptr;
+
+  std::unique_ptr<Image> image(Image::create(static_cast<PixelFormat>(pixelFormat), width, height));
+  const int ntiles = tile_columns(width) * tile_rows(height);
+
+  // Tiles of the current record (they are copied to the image only
+  // if the whole record can be read)
+  std::vector<std::pair<int, std::vector<uint8_t>>> recordTiles;
+  std::vector<uint8_t> compressed;
+  int records = 0;
+
+  while (read32(is) == RECORD_BEGIN && is.good()) {
+    int count = read32(is);
+    if (count < 0 || count > ntiles)
+      break;
+
+    recordTiles.resize(count);
+    bool ok = true;
+    for (auto& recordTile : recordTiles) {
+      int tile = read32(is);
+      int compressedSize = read32(is);
+      if (!is.good() || tile < 0 || tile >= ntiles || compressedSize < 0) {
+        ok = false;
+        break;
+      }
+
+      gfx::Rect bounds = tile_bounds(width, height, tile);
+      uLongf size = image->getRowStrideSize(bounds.w) * bounds.h;
+
+      compressed.resize(compressedSize);
+      recordTile.first = tile;
+      recordTile.second.resize(size);
+      if (compressedSize > 0 &&
+          is.read((char*)&compressed[0], compressedSize).fail()) {
+        ok = false;
+        break;
+      }
+
+      if (uncompress(&recordTile.second[0], &size,
+                     &compressed[0], compressedSize) != Z_OK ||
+          size != recordTile.second.size()) {
+        ok = false;
+        break;
+      }
+    }
+
+    if (!ok || read32(is) != RECORD_END || is.fail())
+      break;
+
+    // Apply the whole record
+    for (const auto& recordTile : recordTiles) {
+      gfx::Rect bounds = tile_bounds(width, height, recordTile.first);
+      int rowSize = image->getRowStrideSize(bounds.w);
+      for (int y=0; y<bounds.h; ++y)
+        std::copy_n(recordTile.second.begin() + y*rowSize, rowSize,
+                    image->getPixelAddress(bounds.x, bounds.y+y));
+    }
+    ++records;
+  }
+
+  // The first record contains all tiles
+  if (records == 0)
+    return nullptr;
+
+  image->setMaskColor(maskColor);
+  if (setId)
+    image->setId(id);
+  return image.release();
+}
+
+} // namespace crash
+} // namespace app
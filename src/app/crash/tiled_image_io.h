@@ -0,0 +1,68 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#pragma once
+
+#include "doc/object_id.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+namespace crash {
+
+  // Images are saved in the backup divided in tiles, so a new
+  // version of an image can be saved appending only the modified
+  // tiles to the same file. A file contains a header and a list of
+  // records, each record has some tiles (all tiles in the first
+  // one). A record that wasn't completely written (e.g. the program
+  // crashed in the middle) is ignored with all the following ones.
+
+  const uint32_t TILED_IMAGE_MAGIC_NUMBER = 0x454C4954; // 'TILE' in ASCII
+  const int IMAGE_TILE_SIZE = 128;
+
+  typedef std::vector<uint64_t> ImageTileHashes;
+
+  // Copy of the pixels of a tile (rows of the tile one after the
+  // other), so it can be compressed without the original image.
+  struct ImageTilePixels {
+    int tile;
+    std::vector<uint8_t> pixels;
+  };
+  typedef std::vector<ImageTilePixels> ImageTilesPixels;
+
+  // Calculates a hash of the pixels of each tile of the image (to
+  // know which tiles were modified between two versions).
+  void calculate_image_tile_hashes(const doc::Image* image,
+                                   ImageTileHashes& hashes);
+
+  // Writes the header of a tiled image (including the magic number).
+  // The "id" is the ID of the original image ("image" can be a copy).
+  void write_tiled_image_header(std::ostream& os, const doc::Image* image,
+                                doc::ObjectId id);
+
+  // Copies the pixels of the given tiles (indexes in the hashes
+  // vector from calculate_image_tile_hashes()).
+  void copy_image_tiles(const doc::Image* image,
+                        const std::vector<int>& tiles,
+                        ImageTilesPixels& result);
+
+  // Writes a record with the given tiles.
+  void write_tiled_image_record(std::ostream& os,
+                                const ImageTilesPixels& tiles);
+
+  // Reads an image (after the magic number) applying all its
+  // complete records. Returns nullptr if there is no complete record.
+  doc::Image* read_tiled_image(std::istream& is, bool setId);
+
+} // namespace crash
+} // namespace app
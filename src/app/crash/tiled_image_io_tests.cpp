@@ -0,0 +1,136 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/test.h"
+
+#include "app/crash/tiled_image_io.h"
+#include "base/serialization.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+#include <memory>
+#include <numeric>
+#include <sstream>
+
+using namespace app::crash;
+using namespace base::serialization::little_endian;
+using namespace doc;
+
+static Image* create_test_image(int w, int h)
+{
+  Image* image = Image::create(IMAGE_RGB, w, h);
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(image, x, y, rgba(x & 0xff, y & 0xff, (x*y) & 0xff, 255));
+  return image;
+}
+
+static void write_record(std::ostream& os, const Image* image,
+                         const std::vector<int>& tiles)
+{
+  ImageTilesPixels pixels;
+  copy_image_tiles(image, tiles, pixels);
+  write_tiled_image_record(os, pixels);
+}
+
+static void write_all_tiles(std::ostream& os, const Image* image)
+{
+  ImageTileHashes hashes;
+  calculate_image_tile_hashes(image, hashes);
+
+  std::vector<int> tiles(hashes.size());
+  std::iota(tiles.begin(), tiles.end(), 0);
+
+  write_tiled_image_header(os, image, image->id());
+  write_record(os, image, tiles);
+}
+
+static Image* read_from(std::istream& is)
+{
+  EXPECT_EQ(TILED_IMAGE_MAGIC_NUMBER, read32(is));
+  return read_tiled_image(is, false);
+}
+
+TEST(TiledImageIO, AllTiles)
+{
+  std::unique_ptr<Image> image(create_test_image(300, 200));
+  std::stringstream s;
+  write_all_tiles(s, image.get());
+
+  std::unique_ptr<Image> result(read_from(s));
+  ASSERT_TRUE(result != nullptr);
+  EXPECT_EQ(300, result->width());
+  EXPECT_EQ(200, result->height());
+  EXPECT_EQ(0, count_diff_between_images(image.get(), result.get()));
+}
+
+TEST(TiledImageIO, ModifiedTiles)
+{
+  std::unique_ptr<Image> image(create_test_image(300, 200));
+  std::stringstream s;
+  write_all_tiles(s, image.get());
+
+  ImageTileHashes oldHashes, newHashes;
+  calculate_image_tile_hashes(image.get(), oldHashes);
+  EXPECT_EQ(6, int(oldHashes.size()));
+
+  put_pixel(image.get(), 290, 150, rgba(0, 0, 0, 0));
+  calculate_image_tile_hashes(image.get(), newHashes);
+
+  std::vector<int> modified;
+  for (std::size_t i=0; i<newHashes.size(); ++i)
+    if (newHashes[i] != oldHashes[i])
+      modified.push_back(int(i));
+  ASSERT_EQ(1, int(modified.size()));
+  EXPECT_EQ(5, modified[0]);
+
+  // The copy of the tiles is independent from the image
+  ImageTilesPixels pixels;
+  copy_image_tiles(image.get(), modified, pixels);
+  ASSERT_EQ(1, int(pixels.size()));
+  EXPECT_EQ(5, pixels[0].tile);
+  EXPECT_EQ(4*44*72, int(pixels[0].pixels.size()));
+  std::unique_ptr<Image> expected(Image::createCopy(image.get()));
+  clear_image(image.get(), rgba(0, 0, 0, 0));
+  write_tiled_image_record(s, pixels);
+
+  std::unique_ptr<Image> result(read_from(s));
+  ASSERT_TRUE(result != nullptr);
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()));
+}
+
+TEST(TiledImageIO, IncompleteRecordIsIgnored)
+{
+  std::unique_ptr<Image> image(create_test_image(300, 200));
+  std::unique_ptr<Image> original(Image::createCopy(image.get()));
+  std::stringstream s;
+  write_all_tiles(s, image.get());
+
+  clear_image(image.get(), rgba(0, 0, 0, 0));
+  std::stringstream record;
+  write_record(record, image.get(), { 0, 1, 2 });
+
+  // Simulate a crash in the middle of the record
+  std::string data = record.str();
+  s << data.substr(0, data.size()/2);
+
+  std::unique_ptr<Image> result(read_from(s));
+  ASSERT_TRUE(result != nullptr);
+  EXPECT_EQ(0, count_diff_between_images(original.get(), result.get()));
+}
+
+TEST(TiledImageIO, NoCompleteRecord)
+{
+  std::unique_ptr<Image> image(create_test_image(64, 64));
+  std::stringstream full;
+  write_all_tiles(full, image.get());
+
+  std::string data = full.str();
+  std::stringstream s(data.substr(0, data.size()-4));
+  std::unique_ptr<Image> result(read_from(s));
+  EXPECT_TRUE(result == nullptr);
+}
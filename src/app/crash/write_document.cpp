@@ -12,6 +12,7 @@
 #include "app/crash/write_document.h"
 
 #include "app/crash/internals.h"
+#include "app/crash/tiled_image_io.h"
 #include "app/document.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
@@ -26,7 +27,6 @@
 #include "doc/frame.h"
 #include "doc/frame_tag.h"
 #include "doc/frame_tag_io.h"
-#include "doc/image_io.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/palette_io.h"
@@ -35,6 +35,8 @@
 
 #include <fstream>
 #include <map>
+#include <numeric>
+#include <sstream>
 
 namespace app {
 namespace crash {
@@ -45,53 +47,71 @@ using namespace doc;
 
 namespace {
 
+// Maximum number of records in the file of an image. When it's
+// reached, all tiles are written in a new file.
+const int MAX_IMAGE_RECORDS = 32;
+
+// Tiles of an image in its backup file.
+struct ImageTiles {
+  ObjectVersion version;        // Image version in the file
+  ImageTileHashes hashes;       // Hash of each tile in that version
+  int records;                  // Records in the file
+  std::size_t appendedTiles;    // Tiles written after the first record
+
+  ImageTiles() : version(0), records(0), appendedTiles(0) { }
+};
+
+typedef std::map<ObjectId, ImageTiles> ImageTilesMap;
+
 static std::map<ObjectId, ObjVersionsMap> g_docVersions;
+static std::map<ObjectId, ImageTilesMap> g_docImageTiles;
 
-class Writer {
+// Copies the modified objects of a document to a snapshot.
+class Snapshooter {
 public:
-  Writer(const std::string& dir, app::Document* doc)
-    : m_dir(dir)
-    , m_doc(doc)
+  Snapshooter(app::Document* doc, DocumentSnapshot& snapshot)
+    : m_doc(doc)
+    , m_snapshot(snapshot)
     , m_objVersions(g_docVersions[doc->id()]) {
   }
 
-  void saveDocument() {
+  void takeSnapshot() {
     Sprite* spr = m_doc->sprite();
 
     // Save from objects without children (e.g. images), to aggregated
     // objects (e.g. cels, layers, etc.)
 
     for (auto pal : spr->getPalettes())
-      saveObject("pal", pal.get(), &Writer::writePalette);
+      addObject("pal", pal.get(), &Snapshooter::writePalette);
 
     for (FrameTag* frtag : spr->frameTags())
-      saveObject("frtag", frtag, &Writer::writeFrameTag);
+      addObject("frtag", frtag, &Snapshooter::writeFrameTag);
 
     for (auto cel : spr->uniqueCels()) {
-      saveObject("img", cel->image(), &Writer::writeImage);
-      saveObject("celdata", cel->data(), &Writer::writeCelData);
+      addImage(cel->image());
+      addObject("celdata", cel->data(), &Snapshooter::writeCelData);
     }
 
     for (auto cel : spr->cels())
-      saveObject("cel", cel.get(), &Writer::writeCel);
+      addObject("cel", cel.get(), &Snapshooter::writeCel);
 
     std::vector<Layer*> layers;
     spr->getLayersList(layers);
     for (Layer* lay : layers)
-      saveObject("lay", lay, &Writer::writeLayerStructure);
+      addObject("lay", lay, &Snapshooter::writeLayerStructure);
 
-    saveObject("spr", spr, &Writer::writeSprite);
-    saveObject("doc", m_doc, &Writer::writeDocumentFile);
+    addObject("spr", spr, &Snapshooter::writeSprite);
+    addObject("doc", m_doc, &Snapshooter::writeDocumentFile);
   }
 
 private:
 
-  void writeDocumentFile(std::ofstream& s, app::Document* doc) {
+  void writeDocumentFile(std::ostream& s, app::Document* doc) {
     write32(s, doc->sprite()->id());
     write_string(s, doc->filename());
   }
 
-  void writeSprite(std::ofstream& s, Sprite* spr) {
+  void writeSprite(std::ostream& s, Sprite* spr) {
     write8(s, spr->pixelFormat());
     write16(s, spr->width());
     write16(s, spr->height());
@@ -120,7 +140,7 @@ private:
       write32(s, frtag->id());
   }
 
-  void writeLayerStructure(std::ofstream& s, Layer* lay) {
+  void writeLayerStructure(std::ostream& s, Layer* lay) {
     write32(s, static_cast<int>(lay->flags())); // Flags
     write16(s, static_cast<int>(lay->type()));  // Type
     write_string(s, lay->name());
@@ -137,46 +157,221 @@ private:
     }
   }
 
-  void writeCel(std::ofstream& s, Cel* cel) {
+  void writeCel(std::ostream& s, Cel* cel) {
     write_cel(s, cel);
   }
 
-  void writeCelData(std::ofstream& s, CelData* celdata) {
+  void writeCelData(std::ostream& s, CelData* celdata) {
     write_celdata(s, celdata);
   }
 
-  void writeImage(std::ofstream& s, Image* img) {
-    write_image(s, img);
-  }
-
-  void writePalette(std::ofstream& s, Palette* pal) {
+  void writePalette(std::ostream& s, Palette* pal) {
     write_palette(s, *pal);
   }
 
-  void writeFrameTag(std::ofstream& s, FrameTag* frameTag) {
+  void writeFrameTag(std::ostream& s, FrameTag* frameTag) {
     write_frame_tag(s, frameTag);
   }
 
   template<typename T>
-  void saveObject(const char* prefix, T* obj, void (Writer::*writeMember)(std::ofstream&, T*)) {
+  bool isModified(T* obj) {
     if (!obj->version())
       obj->incrementVersion();
 
-    ObjVersions& versions = m_objVersions[obj->id()];
-    if (versions.newer() == obj->version())
+    return (m_objVersions[obj->id()].newer() != obj->version());
+  }
+
+  // Modified images are copied as they are (a plain copy of the
+  // pixels is the fastest thing we can do with the document locked),
+  // the modified tiles are found and compressed by the Writer.
+  void addImage(Image* img) {
+    if (!isModified(img))
+      return;
+
+    DocumentSnapshot::Object obj;
+    obj.prefix = "img";
+    obj.id = img->id();
+    obj.version = img->version();
+    obj.image.reset(Image::createCopy(img));
+    m_snapshot.addObject(std::move(obj));
+  }
+
+  template<typename T>
+  void addObject(const char* prefix, T* obj, void (Snapshooter::*writeMember)(std::ostream&, T*)) {
+    if (!isModified(obj))
       return;
 
+    std::ostringstream s;
+    (this->*writeMember)(s, obj); // Write the object
+
+    DocumentSnapshot::Object snapshotObj;
+    snapshotObj.prefix = prefix;
+    snapshotObj.id = obj->id();
+    snapshotObj.version = obj->version();
+    snapshotObj.data = s.str();
+    m_snapshot.addObject(std::move(snapshotObj));
+  }
+
+  app::Document* m_doc;
+  DocumentSnapshot& m_snapshot;
+  ObjVersionsMap& m_objVersions;
+};
+
+// Writes the objects of a snapshot in the backup directory.
+class Writer {
+public:
+  Writer(const std::string& dir, ObjectId docId)
+    : m_dir(dir)
+    , m_objVersions(g_docVersions[docId])
+    , m_imageTiles(g_docImageTiles[docId]) {
+  }
+
+  void writeSnapshot(const DocumentSnapshot& snapshot) {
+    for (const auto& obj : snapshot.objects()) {
+      if (obj.image)
+        saveImage(obj);
+      else
+        saveObject(obj);
+    }
+  }
+
+private:
+  // Images are saved in a file that contains the tiles of each
+  // version (see tiled_image_io.h). Only the modified tiles are
+  // appended to the file, and the file is renamed with the new
+  // version. All tiles are written again in a new file when the
+  // appended tiles use more space than a whole image (or there are
+  // too many records).
+  //
+  // If something fails, the previous version (and its file) is kept,
+  // and the image is saved again in a new file in the next backup.
+  void saveImage(const DocumentSnapshot::Object& obj) {
+    const Image* img = obj.image.get();
+    ObjVersions& versions = m_objVersions[obj.id];
+    ImageTiles& tiles = m_imageTiles[obj.id];
+    std::string oldfn = (tiles.version ? objectFilename("img", obj.id, tiles.version): std::string());
+    std::string fullfn = objectFilename("img", obj.id, obj.version);
+
+    ImageTileHashes hashes;
+    calculate_image_tile_hashes(img, hashes);
+
+    std::vector<int> modified;
+    bool allTiles = (!tiles.version ||
+                     tiles.hashes.size() != hashes.size() ||
+                     tiles.records >= MAX_IMAGE_RECORDS);
+    if (!allTiles) {
+      for (std::size_t i=0; i<hashes.size(); ++i)
+        if (hashes[i] != tiles.hashes[i])
+          modified.push_back(int(i));
+
+      allTiles = (tiles.appendedTiles + modified.size() > hashes.size());
+    }
+    if (allTiles) {
+      modified.resize(hashes.size());
+      std::iota(modified.begin(), modified.end(), 0);
+    }
+
+    ImageTilesPixels pixels;
+    copy_image_tiles(img, modified, pixels);
+
+    if (allTiles) {
+      std::ofstream s(FSTREAM_PATH(fullfn), std::ofstream::binary);
+      write32(s, 0);            // Leave a room for the magic number
+      write_tiled_image_header(s, img, obj.id);
+      write_tiled_image_record(s, pixels);
+
+      // Write the magic number
+      s.flush();
+      s.seekp(0);
+      write32(s, MAGIC_NUMBER);
+      s.close();
+
+      if (s.fail()) {
+        TRACE(" - Cannot write img #%d v%d\n", obj.id, obj.version);
+        try {
+          if (base::is_file(fullfn))
+            base::delete_file(fullfn);
+        }
+        catch (const std::exception&) {
+          // Ignore it, the file will be overwritten
+        }
+        tiles.records = MAX_IMAGE_RECORDS;
+        return;
+      }
+
+      // Remove the file of the previous version
+      try {
+        if (!oldfn.empty() && base::is_file(oldfn))
+          base::delete_file(oldfn);
+      }
+      catch (const std::exception&) {
+        TRACE(" - Cannot delete img #%d v%d\n", obj.id, tiles.version);
+      }
+
+      tiles.records = 1;
+      tiles.appendedTiles = 0;
+    }
+    else {
+      // The snapshot doesn't have all tiles to write a new file, so
+      // the image is saved again (with all tiles) in the next backup.
+      if (!base::is_file(oldfn)) {
+        TRACE(" - Cannot find img #%d v%d\n", obj.id, tiles.version);
+        tiles.records = MAX_IMAGE_RECORDS;
+        return;
+      }
+
+      {
+        std::ofstream s(FSTREAM_PATH(oldfn), std::ofstream::binary | std::ofstream::app);
+        write_tiled_image_record(s, pixels);
+
+        // Write all tiles in the next version if this record is
+        // incomplete (it's ignored when the file is read, so the file
+        // still contains the previous version).
+        s.flush();
+        if (s.fail()) {
+          TRACE(" - Cannot append to img #%d v%d\n", obj.id, tiles.version);
+          tiles.records = MAX_IMAGE_RECORDS;
+          return;
+        }
+        ++tiles.records;
+      }
+      try {
+        base::move_file(oldfn, fullfn);
+      }
+      catch (const std::exception&) {
+        // The same version will be saved again in a new file
+        TRACE(" - Cannot rename img #%d v%d\n", obj.id, tiles.version);
+        tiles.records = MAX_IMAGE_RECORDS;
+        return;
+      }
+
+      tiles.appendedTiles += pixels.size();
+    }
+
+    tiles.version = obj.version;
+    tiles.hashes = std::move(hashes);
+    versions.rotateRevisions(obj.version);
+
+    TRACE(" - Saved img #%d v%d (%d tiles)\n", obj.id, obj.version, int(pixels.size()));
+  }
+
+  std::string objectFilename(const char* prefix, ObjectId id, ObjectVersion ver) const {
     std::string fn = prefix;
     fn.push_back('-');
-    fn += base::convert_to<std::string>(obj->id());
+    fn += base::convert_to<std::string>(id);
+    fn.push_back('.');
+    fn += base::convert_to<std::string>(ver);
+    return base::join_path(m_dir, fn);
+  }
 
-    std::string fullfn = base::join_path(m_dir, fn);
-    std::string oldfn = fullfn + "." + base::convert_to<std::string>(versions.older());
-    fullfn += "." + base::convert_to<std::string>(obj->version());
+  void saveObject(const DocumentSnapshot::Object& obj) {
+    ObjVersions& versions = m_objVersions[obj.id];
+    std::string fullfn = objectFilename(obj.prefix, obj.id, obj.version);
+    std::string oldfn = objectFilename(obj.prefix, obj.id, versions.older());
 
     std::ofstream s(FSTREAM_PATH(fullfn), std::ofstream::binary);
     write32(s, 0);                // Leave a room for the magic number
-    (this->*writeMember)(s, obj); // Write the object
+    s.write(obj.data.c_str(), obj.data.size()); // Write the object
 
     // Flush all data. In this way we ensure that the magic number is
     // the last thing being written in the file.
@@ -192,18 +387,18 @@ private:
         base::delete_file(oldfn);
     }
     catch (const std::exception&) {
-      TRACE(" - Cannot delete %s #%d v%d\n", prefix, obj->id(), versions.older());
+      TRACE(" - Cannot delete %s #%d v%d\n", obj.prefix, obj.id, versions.older());
     }
 
     // Rotate versions and add the latest one
-    versions.rotateRevisions(obj->version());
+    versions.rotateRevisions(obj.version);
 
-    TRACE(" - Saved %s #%d v%d\n", prefix, obj->id(), obj->version());
+    TRACE(" - Saved %s #%d v%d\n", obj.prefix, obj.id, obj.version);
   }
 
   std::string m_dir;
-  app::Document* m_doc;
   ObjVersionsMap& m_objVersions;
+  ImageTilesMap& m_imageTiles;
 };
 
 } // anonymous namespace
@@ -211,21 +406,29 @@ private:
 //////////////////////////////////////////////////////////////////////
 // Public API
 
-void write_document(const std::string& dir, app::Document* doc)
+std::unique_ptr<DocumentSnapshot> snapshot_document(app::Document* doc)
 {
-  Writer writer(dir, doc);
-  writer.saveDocument();
+  std::unique_ptr<DocumentSnapshot> snapshot(new DocumentSnapshot(doc->id()));
+  Snapshooter(doc, *snapshot).takeSnapshot();
+  return snapshot;
 }
 
-void delete_document_internals(app::Document* doc)
+void write_document_snapshot(const std::string& dir, const DocumentSnapshot* snapshot)
 {
-  ASSERT(doc);
-  auto it = g_docVersions.find(doc->id());
+  Writer writer(dir, snapshot->docId());
+  writer.writeSnapshot(*snapshot);
+}
+
+void delete_document_internals(ObjectId docId)
+{
+  auto it = g_docVersions.find(docId);
 
   // The document could not be inside g_documentObjects in case it was
   // never saved by the backup process.
   if (it != g_docVersions.end())
     g_docVersions.erase(it);
+
+  g_docImageTiles.erase(docId);
 }
 
 } // namespace crash
@@ -7,14 +7,56 @@
 
 #pragma once
 
+#include "doc/image_ref.h"
+#include "doc/object.h"
+
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace app {
 class Document;
 namespace crash {
 
-  void write_document(const std::string& dir, app::Document* doc);
-  void delete_document_internals(app::Document* doc);
+  // Objects of a document that were modified since the last backup,
+  // copied to write them without locking the document.
+  class DocumentSnapshot {
+  public:
+    struct Object {
+      const char* prefix;
+      doc::ObjectId id;
+      doc::ObjectVersion version;
+      std::string data;         // Serialized object
+      doc::ImageRef image;      // Copy of the image (only for "img" objects)
+
+      Object() : prefix(nullptr), id(0), version(0) { }
+    };
+    typedef std::vector<Object> Objects;
+
+    explicit DocumentSnapshot(doc::ObjectId docId) : m_docId(docId) { }
+
+    doc::ObjectId docId() const { return m_docId; }
+    const Objects& objects() const { return m_objects; }
+    void addObject(Object&& obj) { m_objects.push_back(std::move(obj)); }
+
+  private:
+    doc::ObjectId m_docId;
+    Objects m_objects;
+  };
+
+  // Copies the modified objects of the document. It must be called
+  // with the document locked, but it's fast: small objects are
+  // serialized in memory and modified images are just copied.
+  std::unique_ptr<DocumentSnapshot> snapshot_document(app::Document* doc);
+
+  // Writes the snapshot in the backup directory. The modified tiles
+  // of each image are found (comparing tile hashes) and compressed
+  // here, so it can be called without locking the document.
+  void write_document_snapshot(const std::string& dir, const DocumentSnapshot* snapshot);
+
+  // Forgets the objects saved from the given document. It must not be
+  // called while a snapshot of the document is taken or written.
+  void delete_document_internals(doc::ObjectId docId);
 
 } // namespace crash
 } // namespace app
@@ -13,23 +13,29 @@
 
 #include "app/document_exporter.h"
 
+#include "app/app.h"
 #include "app/cmd/set_pixel_format.h"
 #include "app/console.h"
 #include "app/document.h"
+#include "app/export_cache.h"
 #include "app/file/file.h"
+#include "app/file/image_stream_writer.h"
 #include "app/filename_formatter.h"
 #include "app/ui_context.h"
 #include "base/convert_to.h"
 #include "base/fstream_path.h"
 #include "base/path.h"
 #include "base/replace_string.h"
+#include "base/sha1.h"
 #include "base/shared_ptr.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/dithering_method.h"
 #include "doc/frame_tag.h"
 #include "doc/image.h"
+#include "doc/image_ref.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
@@ -38,16 +44,38 @@
 #include "gfx/size.h"
 #include "render/render.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <list>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+// Maximum size of each band of the texture rendered by
+// DocumentExporter::streamTexture()
+#define STREAM_BAND_SIZE (8*1024*1024)
 
 using namespace doc;
 
 namespace {
 
+// The sprite sheet couldn't be exported, it must be exported again
+// and the command line must return an error code.
+void export_failed()
+{
+  if (app::ExportCache* cache = app::ExportCache::instance())
+    cache->setFailed();
+
+  app::App* app = app::App::instance();
+  if (app && !app->isGui())
+    app->setFileOperationFailed();
+}
+
 std::string escape_for_json(const std::string& path)
 {
   std::string res = path;
@@ -83,7 +111,8 @@ public:
   SampleBounds(Sprite* sprite) :
     m_originalSize(sprite->width(), sprite->height()),
     m_trimmedBounds(0, 0, sprite->width(), sprite->height()),
-    m_inTextureBounds(0, 0, sprite->width(), sprite->height()) {
+    m_inTextureBounds(0, 0, sprite->width(), sprite->height()),
+    m_page(0) {
   }
 
   bool trimmed() const {
@@ -96,14 +125,17 @@ public:
   const gfx::Size& originalSize() const { return m_originalSize; }
   const gfx::Rect& trimmedBounds() const { return m_trimmedBounds; }
   const gfx::Rect& inTextureBounds() const { return m_inTextureBounds; }
+  int page() const { return m_page; }
 
   void setTrimmedBounds(const gfx::Rect& bounds) { m_trimmedBounds = bounds; }
   void setInTextureBounds(const gfx::Rect& bounds) { m_inTextureBounds = bounds; }
+  void setPage(int page) { m_page = page; }
 
 private:
   gfx::Size m_originalSize;
   gfx::Rect m_trimmedBounds;
   gfx::Rect m_inTextureBounds;
+  int m_page;                   // Texture where the sample is placed
 };
 
 typedef base::SharedPtr<SampleBounds> SampleBoundsPtr;
@@ -155,7 +187,12 @@ public:
   std::string filename() const { return m_filename; }
   const gfx::Size& originalSize() const { return m_bounds->originalSize(); }
   const gfx::Rect& trimmedBounds() const { return m_bounds->trimmedBounds(); }
-  const gfx::Rect& inTextureBounds() const { return m_bounds->inTextureBounds(); }
+  const gfx::Rect& inTextureBounds() const {
+    return (m_textureBounds ? m_textureBounds: m_bounds)->inTextureBounds();
+  }
+  int page() const {
+    return (m_textureBounds ? m_textureBounds: m_bounds)->page();
+  }
 
   gfx::Size requiredSize() const {
     gfx::Size size = m_bounds->trimmedBounds().size();
@@ -170,17 +207,35 @@ public:
 
   void setTrimmedBounds(const gfx::Rect& bounds) { m_bounds->setTrimmedBounds(bounds); }
   void setInTextureBounds(const gfx::Rect& bounds) { m_bounds->setInTextureBounds(bounds); }
+  void setPage(int page) { m_bounds->setPage(page); }
 
   bool isDuplicated() const { return m_isDuplicated; }
-  SampleBoundsPtr sharedBounds() const { return m_bounds; }
+
+  // Rendered pixels of the trimmed bounds (if they were kept by
+  // captureSamples())
+  const ImageRef& image() const { return m_image; }
+  void setImage(const ImageRef& image) { m_image = image; }
+
+  // Hash of the trimmed pixels (if duplicates are merged)
+  const std::string& hash() const { return m_hash; }
+  void setHash(const std::string& hash) { m_hash = hash; }
 
   void setDuplicated(bool duplicated) {
     m_isDuplicated = duplicated;
   }
 
-  void setSharedBounds(const SampleBoundsPtr& bounds) {
+  // Uses the same bounds of a sample of a linked cel
+  void setSharedBounds(const Sample& other) {
     m_isDuplicated = true;
-    m_bounds = bounds;
+    m_bounds = other.m_bounds;
+    m_textureBounds = other.m_textureBounds;
+  }
+
+  // Uses the same place in the texture of other sample with the same
+  // pixels (its trimmed bounds can be in other position)
+  void setSharedTextureBounds(const Sample& other) {
+    m_isDuplicated = true;
+    m_textureBounds = (other.m_textureBounds ? other.m_textureBounds: other.m_bounds);
   }
 
 private:
@@ -191,7 +246,10 @@ private:
   std::string m_filename;
   int m_innerPadding;
   SampleBoundsPtr m_bounds;
+  SampleBoundsPtr m_textureBounds;
   bool m_isDuplicated;
+  ImageRef m_image;
+  std::string m_hash;
 };
 
 class DocumentExporter::Samples {
@@ -215,10 +273,14 @@ private:
   List m_samples;
 };
 
+// Places the samples in the texture. If the texture has a maximum
+// size (both dimensions greater than zero), the samples that don't
+// fit are placed in more pages (textures of the same size). Returns
+// the number of pages, or 0 if a sample is bigger than a page.
 class DocumentExporter::LayoutSamples {
 public:
   virtual ~LayoutSamples() { }
-  virtual void layoutSamples(Samples& samples, int borderPadding, int shapePadding, int& width, int& height) = 0;
+  virtual int layoutSamples(Samples& samples, int borderPadding, int shapePadding, int& width, int& height, const gfx::Size& maxSize) = 0;
 };
 
 class DocumentExporter::SimpleLayoutSamples :
@@ -228,12 +290,20 @@ public:
     : m_type(type) {
   }
 
-  void layoutSamples(Samples& samples, int borderPadding, int shapePadding, int& width, int& height) override {
+  int layoutSamples(Samples& samples, int borderPadding, int shapePadding, int& width, int& height, const gfx::Size& maxSize) override {
     const Sprite* oldSprite = NULL;
     const Layer* oldLayer = NULL;
 
+    // Size of each page if there is a maximum size (zero if the
+    // texture can grow without limits).
+    gfx::Size pageSize;
+    if (maxSize.w > 0 && maxSize.h > 0)
+      pageSize = gfx::Size(width > 0 ? width: maxSize.w,
+                           height > 0 ? height: maxSize.h);
+
     gfx::Point framePt(borderPadding, borderPadding);
     gfx::Size rowSize(0, 0);
+    int page = 0;
 
     for (auto& sample : samples) {
       if (sample.isDuplicated())
@@ -243,50 +313,60 @@ public:
       const Layer* layer = sample.layer();
       gfx::Size size = sample.requiredSize();
 
+      if (pageSize.w > 0 &&
+          (size.w > pageSize.w-2*borderPadding ||
+           size.h > pageSize.h-2*borderPadding))
+        return 0;
+
       if (oldSprite) {
         if (m_type == SpriteSheetType::Columns) {
           // If the user didn't specify a height for the texture, we
-          // put each sprite/layer in a different column.
-          if (height == 0) {
-            // New sprite or layer, go to next column.
-            if (oldSprite != sprite || oldLayer != layer) {
-              framePt.x += rowSize.w + shapePadding;
-              framePt.y = borderPadding;
-              rowSize = size;
-            }
-          }
-          // When a texture height is specified, we can put different
-          // sprites/layers in each column until we reach the texture
-          // bottom-border.
-          else if (framePt.y+size.h > height-borderPadding) {
+          // put each sprite/layer in a different column. When a
+          // texture height is specified (or a maximum height), we can
+          // put different sprites/layers in each column until we
+          // reach the texture bottom-border.
+          int columnHeight = (height > 0 ? height: pageSize.h);
+          if ((height == 0 && (oldSprite != sprite || oldLayer != layer)) ||
+              (columnHeight > 0 && framePt.y+size.h > columnHeight-borderPadding) ||
+              (pageSize.w > 0 && framePt.x+std::max(rowSize.w, size.w) > pageSize.w-borderPadding)) {
             framePt.x += rowSize.w + shapePadding;
             framePt.y = borderPadding;
             rowSize = size;
           }
+
+          // The new column doesn't fit in the page, go to the next page.
+          if (pageSize.w > 0 && framePt.x+size.w > pageSize.w-borderPadding) {
+            framePt = gfx::Point(borderPadding, borderPadding);
+            rowSize = size;
+            ++page;
+          }
         }
         else {
           // If the user didn't specify a width for the texture, we put
-          // each sprite/layer in a different row.
-          if (width == 0) {
-            // New sprite or layer, go to next row.
-            if (oldSprite != sprite || oldLayer != layer) {
-              framePt.x = borderPadding;
-              framePt.y += rowSize.h + shapePadding;
-              rowSize = size;
-            }
-          }
-          // When a texture width is specified, we can put different
-          // sprites/layers in each row until we reach the texture
-          // right-border.
-          else if (framePt.x+size.w > width-borderPadding) {
+          // each sprite/layer in a different row. When a texture
+          // width is specified (or a maximum width), we can put
+          // different sprites/layers in each row until we reach the
+          // texture right-border.
+          int rowWidth = (width > 0 ? width: pageSize.w);
+          if ((width == 0 && (oldSprite != sprite || oldLayer != layer)) ||
+              (rowWidth > 0 && framePt.x+size.w > rowWidth-borderPadding) ||
+              (pageSize.h > 0 && framePt.y+std::max(rowSize.h, size.h) > pageSize.h-borderPadding)) {
             framePt.x = borderPadding;
             framePt.y += rowSize.h + shapePadding;
             rowSize = size;
           }
+
+          // The new row doesn't fit in the page, go to the next page.
+          if (pageSize.h > 0 && framePt.y+size.h > pageSize.h-borderPadding) {
+            framePt = gfx::Point(borderPadding, borderPadding);
+            rowSize = size;
+            ++page;
+          }
         }
       }
 
       sample.setInTextureBounds(gfx::Rect(framePt, size));
+      sample.setPage(page);
 
       // Next frame position.
       if (m_type == SpriteSheetType::Columns) {
@@ -301,6 +381,7 @@ public:
       oldSprite = sprite;
       oldLayer = layer;
     }
+    return page+1;
   }
 
 private:
@@ -314,7 +395,8 @@ public:
     : m_type(type) {
   }
 
-  void layoutSamples(Samples& samples, int borderPadding, int shapePadding, int& width, int& height) override {
+  // The maximum size is ignored, all tags are placed in one page.
+  int layoutSamples(Samples& samples, int borderPadding, int shapePadding, int& width, int& height, const gfx::Size& maxSize) override {
     const Sprite* oldSprite = NULL;
     int bframe = -1;
     int eframe = -1;
@@ -391,6 +473,7 @@ public:
       oldSprite = sprite;
       lastframe = sample.frame();
     }
+    return 1;
   }
 
 private:
@@ -399,10 +482,10 @@ private:
 class DocumentExporter::BestFitLayoutSamples :
     public DocumentExporter::LayoutSamples {
 public:
-  void layoutSamples(Samples& samples, int borderPadding, int shapePadding, int& width, int& height) override {
+  int layoutSamples(Samples& samples, int borderPadding, int shapePadding, int& width, int& height, const gfx::Size& maxSize) override {
     gfx::PackingRects pr;
-
-    // TODO Add support for shape paddings
+    pr.setBorderPadding(borderPadding);
+    pr.setShapePadding(shapePadding);
 
     for (auto& sample : samples) {
       if (sample.isDuplicated())
@@ -411,23 +494,37 @@ public:
       pr.add(sample.requiredSize());
     }
 
+    const bool hasMaxSize = (maxSize.w > 0 && maxSize.h > 0);
+    int pages = 1;
     if (width == 0 || height == 0) {
       gfx::Size sz = pr.bestFit();
+
+      // The best texture is too big, use several pages
+      if (hasMaxSize && (sz.w > maxSize.w || sz.h > maxSize.h)) {
+        pages = pr.packPages(maxSize);
+        sz = pr.bounds().size();
+      }
+
       width = sz.w;
       height = sz.h;
     }
-    else
-      pr.pack(gfx::Size(width, height));
+    else if (!pr.pack(gfx::Size(width, height)) && hasMaxSize)
+      pages = pr.packPages(gfx::Size(width, height));
+
+    if (pages == 0)
+      return 0;
 
     auto it = samples.begin();
-    for (auto& rc : pr) {
-      if (it->isDuplicated())
-        continue;
+    for (std::size_t i=0; i<pr.size(); ++i) {
+      while (it->isDuplicated())
+        ++it;
 
       ASSERT(it != samples.end());
-      it->setInTextureBounds(rc);
+      it->setInTextureBounds(pr[i]);
+      it->setPage(pr.page(i));
       ++it;
     }
+    return pages;
   }
 };
 
@@ -447,6 +544,9 @@ DocumentExporter::DocumentExporter()
  , m_trimCels(false)
  , m_listFrameTags(false)
  , m_listLayers(false)
+ , m_mergeDuplicates(false)
+ , m_streamTexture(false)
+ , m_maxTextureSize(0, 0)
 {
 }
 
@@ -465,6 +565,10 @@ Document* DocumentExporter::exportSheet()
     osbuf = fos.rdbuf();
   }
   std::ostream os(osbuf);
+  if (!m_dataFilename.empty()) {
+    if (ExportCache* cache = ExportCache::instance())
+      cache->addOutput(m_dataFilename);
+  }
 
   // Steps for sheet construction:
   // 1) Capture the samples (each sprite+frame pair)
@@ -476,35 +580,126 @@ Document* DocumentExporter::exportSheet()
     return nullptr;
   }
 
-  // 2) Layout those samples in a texture field.
+  // A fixed texture size cannot be bigger than the maximum size.
+  if (m_maxTextureSize.w > 0 && m_maxTextureSize.h > 0) {
+    m_textureWidth = std::min(m_textureWidth, m_maxTextureSize.w);
+    m_textureHeight = std::min(m_textureHeight, m_maxTextureSize.h);
+  }
+
+  // 2) Layout those samples in a texture field (or in several pages).
+  int pages = 1;
   switch (m_sheetType) {
     case SpriteSheetType::Packed: {
       BestFitLayoutSamples layout;
-      layout.layoutSamples(
+      pages = layout.layoutSamples(
         samples, m_borderPadding, m_shapePadding,
-        m_textureWidth, m_textureHeight);
+        m_textureWidth, m_textureHeight, m_maxTextureSize);
       break;
     }
     default: {
       if(m_perTag){
         PerTagLayoutSamples layout(m_sheetType);
-        layout.layoutSamples(
+        pages = layout.layoutSamples(
           samples, m_borderPadding, m_shapePadding,
-          m_textureWidth, m_textureHeight);
+          m_textureWidth, m_textureHeight, m_maxTextureSize);
       }
       else{
         SimpleLayoutSamples layout(m_sheetType);
-        layout.layoutSamples(
+        pages = layout.layoutSamples(
           samples, m_borderPadding, m_shapePadding,
-          m_textureWidth, m_textureHeight);
+          m_textureWidth, m_textureHeight, m_maxTextureSize);
       }
       break;
     }
   }
+  if (pages == 0) {
+    Console console;
+    console.printf("There are frames bigger than the maximum texture size (%dx%d)",
+                   m_maxTextureSize.w, m_maxTextureSize.h);
+    export_failed();
+    return nullptr;
+  }
+
+  // 3) Render the texture of each page (all pages have the same
+  // size).
+  PixelFormat pixelFormat;
+  gfx::Size textureSize;
+  Palette* palette;
+  calculateTexture(samples, pixelFormat, textureSize, palette);
+
+  std::unique_ptr<Document> textureDocument;
+  for (int page=0; page<pages; ++page) {
+    const std::string filename = textureFilename(page, pages);
+    if (filename.empty() && pages > 1)
+      break;
+
+    Samples pageSamples;
+    if (pages > 1) {
+      for (const auto& sample : samples) {
+        if (sample.page() == page)
+          pageSamples.addSample(sample);
+      }
+    }
+
+    try {
+      textureDocument.reset(
+        exportTexture((pages > 1 ? pageSamples: samples), filename,
+                      pixelFormat, textureSize, palette));
+    }
+    catch (const std::exception& ex) {
+      Console console;
+      console.printf("Error saving \"%s\": %s",
+                     filename.c_str(), ex.what());
+      export_failed();
+      return nullptr;
+    }
+  }
+
+  // 4) Save the metadata.
+  if (osbuf)
+    createDataFile(samples, os, pixelFormat, textureSize, pages);
+
+  return (pages == 1 ? textureDocument.release(): nullptr);
+}
+
+// Filename of the texture of the given page (e.g. "sheet-1.png" for
+// the second page of "sheet.png").
+std::string DocumentExporter::textureFilename(int page, int pages) const
+{
+  if (pages == 1 || m_textureFilename.empty())
+    return m_textureFilename;
 
-  // 3) Create and render the texture.
+  std::string filename =
+    base::get_file_title(m_textureFilename) + "-" +
+    base::convert_to<std::string>(page);
+
+  std::string ext = base::get_file_extension(m_textureFilename);
+  if (!ext.empty())
+    filename += "." + ext;
+
+  return base::join_path(base::get_file_path(m_textureFilename), filename);
+}
+
+// Renders the texture with the given samples and saves it in the
+// given file (if it isn't empty). Returns the texture document, or
+// nullptr if the texture was written directly to the file.
+Document* DocumentExporter::exportTexture(const Samples& samples,
+                                          const std::string& filename,
+                                          PixelFormat pixelFormat,
+                                          const gfx::Size& size,
+                                          const Palette* palette)
+{
+  // Render the texture band by band directly into the file...
+  if (m_streamTexture && !filename.empty() &&
+      streamTexture(samples, filename, pixelFormat, size, palette)) {
+    if (ExportCache* cache = ExportCache::instance())
+      cache->addOutput(filename);
+    return nullptr;
+  }
+
+  // ...or create the whole texture and render it.
   std::unique_ptr<Document> textureDocument(
-    createEmptyTexture(samples));
+    createEmptyTexture(pixelFormat, size, palette));
 
   Sprite* texture = textureDocument->sprite();
   Image* textureImage = texture->folder()->getFirstLayer()
@@ -512,13 +707,9 @@ Document* DocumentExporter::exportSheet()
 
   renderTexture(samples, textureImage);
 
-  // Save the metadata.
-  if (osbuf)
-    createDataFile(samples, os, textureImage);
-
-  // Save the image files.
-  if (!m_textureFilename.empty()) {
-    textureDocument->setFilename(m_textureFilename.c_str());
+  // Save the image file.
+  if (!filename.empty()) {
+    textureDocument->setFilename(filename.c_str());
     int ret = save_document(UIContext::instance(), textureDocument.get());
     if (ret == 0)
       textureDocument->markAsSaved();
@@ -529,6 +720,22 @@ Document* DocumentExporter::exportSheet()
 
 void DocumentExporter::captureSamples(Samples& samples)
 {
+  // All possible samples (in order), the index of the sample that
+  // each linked sample shares its bounds with (or -1), and the
+  // indexes of the samples that must be rendered to be trimmed or
+  // ignored (if they are empty).
+  std::vector<Sample> candidates;
+  std::vector<int> sources;
+  std::vector<std::size_t> toRender;
+
+  // First sample of each sprite/layer/frame (to find the samples of
+  // linked cels)
+  std::map<std::tuple<const Sprite*, const Layer*, frame_t>, int> frameSamples;
+
+  // Per-tag layout can give its own place to samples that are
+  // duplicated
+  const bool mergeDuplicates = (m_mergeDuplicates && !m_perTag);
+
   for (auto& item : m_documents) {
     Document* doc = item.doc;
     Sprite* sprite = doc->sprite();
@@ -570,7 +777,7 @@ void DocumentExporter::captureSamples(Samples& samples)
       Sample sample(doc, sprite, layer, frame, filename, m_innerPadding);
       std::shared_ptr<Cel> cel;
       std::shared_ptr<Cel> link;
-      bool done = false;
+      int source = -1;
 
       if (layer && layer->isImage())
         cel = layer->cel(frame);
@@ -580,76 +787,184 @@ void DocumentExporter::captureSamples(Samples& samples)
 
       // Re-use linked samples
       if (link) {
-        for (const Sample& other : samples) {
-          if (other.sprite() == sprite &&
-              other.layer() == layer &&
-              other.frame() == link->frame()) {
-            ASSERT(!other.isDuplicated());
-
-            sample.setSharedBounds(other.sharedBounds());
-            done = true;
-            break;
-          }
+        auto it = frameSamples.find(std::make_tuple(sprite, layer, link->frame()));
+        if (it != frameSamples.end()) {
+          const Sample& other = candidates[it->second];
+          ASSERT(!other.isDuplicated());
+
+          sample.setSharedBounds(other);
+          source = it->second;
         }
-        // "done" variable can be false here, e.g. when we export a
-        // frame tag and the first linked cel is outside the tag range.
-        ASSERT(done || (!done && frameTag));
+        // "source" can be -1 here, e.g. when we export a frame tag
+        // and the first linked cel is outside the tag range.
+        ASSERT(source >= 0 || (source < 0 && frameTag));
       }
 
-      if (!done && (m_ignoreEmptyCels || m_trimCels)) {
-        // Ignore empty cels
-        if (layer && layer->isImage() && !cel)
-          continue;
+      if (source < 0) {
+        if (m_ignoreEmptyCels || m_trimCels) {
+          // Ignore empty cels
+          if (layer && layer->isImage() && !cel)
+            continue;
 
-        std::unique_ptr<Image> sampleRender(
-          Image::create(sprite->pixelFormat(),
-            sprite->width(),
-            sprite->height(),
-            m_sampleRenderBuf));
-
-        sampleRender->setMaskColor(sprite->transparentColor());
-        clear_image(sampleRender.get(), sprite->transparentColor());
-        renderSample(sample, sampleRender.get(), 0, 0);
-
-        gfx::Rect frameBounds;
-        doc::color_t refColor = 0;
-
-        if (m_trimCels) {
-          if ((layer &&
-               layer->isBackground()) ||
-              (!layer &&
-               sprite->backgroundLayer() &&
-               sprite->backgroundLayer()->isVisible())) {
-            refColor = get_pixel(sampleRender.get(), 0, 0);
-          }
-          else {
-            refColor = sprite->transparentColor();
-          }
+          toRender.push_back(candidates.size());
         }
-        else if (m_ignoreEmptyCels)
-          refColor = sprite->transparentColor();
+        else if (mergeDuplicates)
+          toRender.push_back(candidates.size());
+      }
 
-        if (!algorithm::shrink_bounds(sampleRender.get(), frameBounds, refColor)) {
-          // If shrink_bounds() returns false, it's because the whole
-          // image is transparent (equal to the mask color).
-          continue;
+      frameSamples.emplace(std::make_tuple(sprite, layer, frame),
+                           int(candidates.size()));
+      candidates.push_back(sample);
+      sources.push_back(source);
+    }
+  }
+
+  // Render the samples in parallel, each thread with its own buffer
+  std::vector<char> empty(candidates.size(), false);
+  if (!toRender.empty()) {
+    base::thread_pool pool(std::min(toRender.size(),
+                                    base::thread_pool::default_size()));
+    std::atomic<std::size_t> next(0);
+
+    base::parallel_for(
+      pool, pool.size(),
+      [this, &candidates, &toRender, &empty, &next](std::size_t){
+        ImageBufferPtr buffer(new ImageBuffer);
+        std::size_t i;
+        while ((i = next++) < toRender.size()) {
+          std::size_t j = toRender[i];
+          empty[j] = !captureSample(candidates[j], buffer);
         }
+      });
+  }
+
+  // First sample with each hash
+  std::map<std::string, std::size_t> hashSamples;
 
-        if (m_trimCels)
-          sample.setTrimmedBounds(frameBounds);
+  for (std::size_t i=0; i<candidates.size(); ++i) {
+    Sample& sample = candidates[i];
+
+    // Linked samples are empty if their source is empty, and they are
+    // in the same place of the texture (the source could be merged
+    // with other sample).
+    if (sources[i] >= 0) {
+      empty[i] = empty[sources[i]];
+      sample.setSharedBounds(candidates[sources[i]]);
+    }
+    else if (!empty[i] && !sample.hash().empty()) {
+      auto it = hashSamples.find(sample.hash());
+      if (it != hashSamples.end()) {
+        sample.setSharedTextureBounds(candidates[it->second]);
+        sample.setImage(ImageRef());
       }
+      else
+        hashSamples[sample.hash()] = i;
+    }
 
+    if (!empty[i])
       samples.addSample(sample);
+  }
+}
+
+// Returns a hash of the pixels of the image inside the given bounds
+// (and the colors they represent in indexed images).
+static std::string hash_sample(const Image* image,
+                               const gfx::Rect& bounds,
+                               const Palette* palette,
+                               int transparentColor)
+{
+  base::Sha1::Builder builder;
+  const int header[] = { int(image->pixelFormat()), bounds.w, bounds.h };
+  builder.add(header, sizeof(header));
+
+  const int rowSize = image->getRowStrideSize(bounds.w);
+  for (int y=bounds.y; y<bounds.y2(); ++y)
+    builder.add(image->getPixelAddress(bounds.x, y), rowSize);
+
+  if (image->pixelFormat() == IMAGE_INDEXED) {
+    builder.add(&transparentColor, sizeof(transparentColor));
+    for (int i=0; i<palette->size(); ++i) {
+      color_t color = palette->getEntry(i);
+      builder.add(&color, sizeof(color));
     }
   }
+  return base::convert_to<std::string>(builder.result());
 }
 
-Document* DocumentExporter::createEmptyTexture(const Samples& samples)
+// Renders the sample to trim it (and to find duplicates), returns
+// false if it's empty. It can be called from any thread.
+bool DocumentExporter::captureSample(Sample& sample, const ImageBufferPtr& buffer)
 {
-  Palette* palette = NULL;
-  PixelFormat pixelFormat = IMAGE_INDEXED;
+  Sprite* sprite = sample.sprite();
+  Layer* layer = sample.layer();
+
+  std::unique_ptr<Image> sampleRender(
+    Image::create(sprite->pixelFormat(),
+      sprite->width(),
+      sprite->height(),
+      buffer));
+
+  sampleRender->setMaskColor(sprite->transparentColor());
+  clear_image(sampleRender.get(), sprite->transparentColor());
+  renderSample(sample, sampleRender.get(), 0, 0);
+
+  if (m_trimCels || m_ignoreEmptyCels) {
+    gfx::Rect frameBounds;
+    doc::color_t refColor = 0;
+
+    if (m_trimCels) {
+      if ((layer &&
+           layer->isBackground()) ||
+          (!layer &&
+           sprite->backgroundLayer() &&
+           sprite->backgroundLayer()->isVisible())) {
+        refColor = get_pixel(sampleRender.get(), 0, 0);
+      }
+      else {
+        refColor = sprite->transparentColor();
+      }
+    }
+    else
+      refColor = sprite->transparentColor();
+
+    if (!algorithm::shrink_bounds(sampleRender.get(), frameBounds, refColor)) {
+      // If shrink_bounds() returns false, it's because the whole
+      // image is transparent (equal to the mask color).
+      return false;
+    }
+
+    if (m_trimCels)
+      sample.setTrimmedBounds(frameBounds);
+  }
+
+  if (m_mergeDuplicates && !m_perTag)
+    sample.setHash(hash_sample(sampleRender.get(), sample.trimmedBounds(),
+                               sprite->palette(sample.frame()),
+                               sprite->transparentColor()));
+
+  // Keep the trimmed pixels to copy them in the texture instead of
+  // rendering the sample again. They aren't kept when the texture
+  // is streamed (to keep memory bounded), and in indexed sprites
+  // with a transparent color different than 0 (the texture
+  // background).
+  if (!m_streamTexture &&
+      (sprite->pixelFormat() != IMAGE_INDEXED ||
+       sprite->transparentColor() == 0)) {
+    sample.setImage(
+      ImageRef(crop_image(sampleRender.get(), sample.trimmedBounds(),
+                          sprite->transparentColor())));
+  }
+  return true;
+}
+
+void DocumentExporter::calculateTexture(const Samples& samples,
+                                        PixelFormat& pixelFormat,
+                                        gfx::Size& size,
+                                        Palette*& palette)
+{
+  palette = NULL;
+  pixelFormat = IMAGE_INDEXED;
   gfx::Rect fullTextureBounds(0, 0, m_textureWidth, m_textureHeight);
-  int maxColors = 256;
 
   for (Samples::const_iterator
          it = samples.begin(),
@@ -690,11 +1005,18 @@ Document* DocumentExporter::createEmptyTexture(const Samples& samples)
   if (m_textureWidth == 0) fullTextureBounds.w += m_borderPadding;
   if (m_textureHeight == 0) fullTextureBounds.h += m_borderPadding;
 
+  size.w = fullTextureBounds.x+fullTextureBounds.w;
+  size.h = fullTextureBounds.y+fullTextureBounds.h;
+}
+
+Document* DocumentExporter::createEmptyTexture(PixelFormat pixelFormat,
+                                               const gfx::Size& size,
+                                               const Palette* palette)
+{
+  int maxColors = 256;
+
   std::unique_ptr<Sprite> sprite(
-    Sprite::createBasicSprite(
-      pixelFormat,
-      fullTextureBounds.x+fullTextureBounds.w,
-      fullTextureBounds.y+fullTextureBounds.h, maxColors));
+    Sprite::createBasicSprite(pixelFormat, size.w, size.h, maxColors));
 
   if (palette != NULL)
     sprite->setPalette(*palette, false);
@@ -710,22 +1032,96 @@ void DocumentExporter::renderTexture(const Samples& samples, Image* textureImage
     if (sample.isDuplicated())
       continue;
 
-    // Make the sprite compatible with the texture so the render()
-    // works correctly.
-    if (sample.sprite()->pixelFormat() != textureImage->pixelFormat()) {
-      cmd::SetPixelFormat(
-        sample.sprite(),
-        textureImage->pixelFormat(),
-        DitheringMethod::NONE).execute(UIContext::instance());
-    }
-
-    renderSample(sample, textureImage,
+    makeSampleCompatible(sample, textureImage->pixelFormat());
+    drawSample(sample, textureImage,
       sample.inTextureBounds().x+m_innerPadding,
       sample.inTextureBounds().y+m_innerPadding);
   }
 }
 
-void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os, Image* textureImage)
+bool DocumentExporter::streamTexture(const Samples& samples,
+                                     const std::string& filename,
+                                     PixelFormat pixelFormat,
+                                     const gfx::Size& size,
+                                     const Palette* palette)
+{
+  // The texture has the index 0 as the transparent color (it's
+  // cleared with 0 as in renderTexture()).
+  std::unique_ptr<ImageStreamWriter> writer(
+    create_image_stream_writer(filename, pixelFormat,
+                               size.w, size.h, palette, 0));
+  if (!writer)
+    return false;
+
+  // Samples sorted by their top row in the texture
+  std::vector<const Sample*> pending;
+  for (const auto& sample : samples) {
+    if (sample.isDuplicated())
+      continue;
+
+    makeSampleCompatible(sample, pixelFormat);
+    pending.push_back(&sample);
+  }
+  std::stable_sort(
+    pending.begin(), pending.end(),
+    [](const Sample* a, const Sample* b) {
+      return a->inTextureBounds().y < b->inTextureBounds().y;
+    });
+
+  // Each band uses up to STREAM_BAND_SIZE bytes
+  int rowSize = calculate_rowstride_bytes(pixelFormat, size.w);
+  int bandHeight = MID(1, STREAM_BAND_SIZE / MAX(1, rowSize), size.h);
+  std::unique_ptr<Image> band(
+    Image::create(pixelFormat, size.w, bandHeight));
+
+  // Samples that intersect the current band
+  std::vector<const Sample*> active;
+  auto next = pending.begin();
+
+  for (int bandY=0; bandY<size.h; bandY+=bandHeight) {
+    int rows = std::min(bandHeight, size.h-bandY);
+
+    active.erase(
+      std::remove_if(
+        active.begin(), active.end(),
+        [bandY](const Sample* sample) {
+          return sample->inTextureBounds().y2() <= bandY;
+        }),
+      active.end());
+
+    for (; next != pending.end() &&
+           (*next)->inTextureBounds().y < bandY+rows; ++next)
+      active.push_back(*next);
+
+    band->clear(0);
+    for (const Sample* sample : active) {
+      drawSample(*sample, band.get(),
+        sample->inTextureBounds().x+m_innerPadding,
+        sample->inTextureBounds().y+m_innerPadding-bandY);
+    }
+
+    writer->writeRows(band.get(), rows);
+  }
+
+  writer->close();
+  return true;
+}
+
+void DocumentExporter::makeSampleCompatible(const Sample& sample, PixelFormat pixelFormat)
+{
+  // Make the sprite compatible with the texture so the render()
+  // works correctly.
+  if (sample.sprite()->pixelFormat() != pixelFormat) {
+    cmd::SetPixelFormat(
+      sample.sprite(),
+      pixelFormat,
+      DitheringMethod::NONE).execute(UIContext::instance());
+  }
+}
+
+void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os,
+                                      PixelFormat pixelFormat, const gfx::Size& size,
+                                      int pages)
 {
   std::string frames_begin;
   std::string frames_end;
@@ -778,7 +1174,13 @@ void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os,
        << "    \"sourceSize\": { "
        << "\"w\": " << srcSize.w << ", "
        << "\"h\": " << srcSize.h << " },\n"
-       << "    \"duration\": " << sample.sprite()->frameDuration(sample.frame()) << "\n"
+       << "    \"duration\": " << sample.sprite()->frameDuration(sample.frame());
+
+    if (pages > 1)
+      os << ",\n"
+         << "    \"page\": " << sample.page();
+
+    os << "\n"
        << "   }";
 
     if (++it != samples.end())
@@ -794,13 +1196,22 @@ void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os,
      << "  \"app\": \"" << WEBSITE << "\",\n"
      << "  \"version\": \"" << VERSION << "\",\n";
 
-  if (!m_textureFilename.empty())
-    os << "  \"image\": \"" << escape_for_json(m_textureFilename).c_str() << "\",\n";
+  if (!m_textureFilename.empty()) {
+    if (pages > 1) {
+      os << "  \"images\": [";
+      for (int page=0; page<pages; ++page)
+        os << (page > 0 ? ", ": " ")
+           << "\"" << escape_for_json(textureFilename(page, pages)) << "\"";
+      os << " ],\n";
+    }
+    else
+      os << "  \"image\": \"" << escape_for_json(m_textureFilename).c_str() << "\",\n";
+  }
 
-  os << "  \"format\": \"" << (textureImage->pixelFormat() == IMAGE_RGB ? "RGBA8888": "I8") << "\",\n"
+  os << "  \"format\": \"" << (pixelFormat == IMAGE_RGB ? "RGBA8888": "I8") << "\",\n"
      << "  \"size\": { "
-     << "\"w\": " << textureImage->width() << ", "
-     << "\"h\": " << textureImage->height() << " },\n"
+     << "\"w\": " << size.w << ", "
+     << "\"h\": " << size.h << " },\n"
      << "  \"scale\": \"" << m_scale << "\"";
 
   // meta.frameTags
@@ -893,11 +1304,28 @@ void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os,
      << "}\n";
 }
 
+void DocumentExporter::drawSample(const Sample& sample, doc::Image* dst, int x, int y)
+{
+  // The sprite could be converted to the texture format after the
+  // sample was captured.
+  const Image* image = sample.image().get();
+  if (image && image->pixelFormat() == dst->pixelFormat())
+    copy_image(dst, image, x, y);
+  else
+    renderSample(sample, dst, x, y);
+}
+
 void DocumentExporter::renderSample(const Sample& sample, doc::Image* dst, int x, int y)
 {
   render::Render render;
   gfx::Clip clip(x, y, sample.trimmedBounds());
 
+  // The sample can be partially outside "dst" (e.g. a band of the
+  // texture in streamTexture()).
+  if (!clip.clip(dst->width(), dst->height(),
+                 sample.sprite()->width(), sample.sprite()->height()))
+    return;
+
   if (sample.layer()) {
     render.renderLayer(dst, sample.layer(), sample.frame(), clip);
   }
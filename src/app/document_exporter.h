@@ -12,7 +12,9 @@
 #include "app/sprite_sheet_type.h"
 #include "base/disable_copying.h"
 #include "doc/image_buffer.h"
+#include "doc/pixel_format.h"
 #include "gfx/fwd.h"
+#include "gfx/size.h"
 
 #include <iosfwd>
 #include <string>
@@ -22,6 +24,7 @@ namespace doc {
   class FrameTag;
   class Image;
   class Layer;
+  class Palette;
 }
 
 namespace app {
@@ -65,6 +68,25 @@ namespace app {
     void setListFrameTags(bool value) { m_listFrameTags = value; }
     void setListLayers(bool value) { m_listLayers = value; }
 
+    // Samples with the same pixels (e.g. repeated frames that aren't
+    // linked cels) use the same place in the texture. The data file
+    // still lists all of them.
+    void setMergeDuplicates(bool value) { m_mergeDuplicates = value; }
+
+    // When it's true, the texture is rendered in horizontal bands
+    // that are written directly to the texture file (if its format
+    // supports it, e.g. PNG or QOI), so the whole texture is never in
+    // memory. In this case exportSheet() returns nullptr.
+    void setStreamTexture(bool value) { m_streamTexture = value; }
+
+    // Maximum size of the texture. Frames that don't fit are placed
+    // in more textures of the same size (pages), saved as
+    // "sheet-0.png", "sheet-1.png", etc. (for a "sheet.png" texture
+    // filename), and each frame in the data file has the index of its
+    // page. In this case exportSheet() returns nullptr. The per-tag
+    // layout always uses one page.
+    void setMaxTextureSize(const gfx::Size& size) { m_maxTextureSize = size; }
+
     void addDocument(Document* document,
                      doc::Layer* layer = nullptr,
                      doc::FrameTag* tag = nullptr,
@@ -83,9 +105,31 @@ namespace app {
     class BestFitLayoutSamples;
 
     void captureSamples(Samples& samples);
-    Document* createEmptyTexture(const Samples& samples);
+    bool captureSample(Sample& sample, const doc::ImageBufferPtr& buffer);
+    void calculateTexture(const Samples& samples,
+                          doc::PixelFormat& pixelFormat,
+                          gfx::Size& size,
+                          doc::Palette*& palette);
+    std::string textureFilename(int page, int pages) const;
+    Document* exportTexture(const Samples& samples,
+                            const std::string& filename,
+                            doc::PixelFormat pixelFormat,
+                            const gfx::Size& size,
+                            const doc::Palette* palette);
+    Document* createEmptyTexture(doc::PixelFormat pixelFormat,
+                                 const gfx::Size& size,
+                                 const doc::Palette* palette);
     void renderTexture(const Samples& samples, doc::Image* textureImage);
-    void createDataFile(const Samples& samples, std::ostream& os, doc::Image* textureImage);
+    bool streamTexture(const Samples& samples,
+                       const std::string& filename,
+                       doc::PixelFormat pixelFormat,
+                       const gfx::Size& size,
+                       const doc::Palette* palette);
+    void makeSampleCompatible(const Sample& sample, doc::PixelFormat pixelFormat);
+    void createDataFile(const Samples& samples, std::ostream& os,
+                        doc::PixelFormat pixelFormat, const gfx::Size& size,
+                        int pages);
+    void drawSample(const Sample& sample, doc::Image* dst, int x, int y);
     void renderSample(const Sample& sample, doc::Image* dst, int x, int y);
 
     class Item {
@@ -126,9 +170,11 @@ namespace app {
     bool m_trimCels;
     Items m_documents;
     std::string m_filenameFormat;
-    doc::ImageBufferPtr m_sampleRenderBuf;
     bool m_listFrameTags;
     bool m_listLayers;
+    bool m_mergeDuplicates;
+    bool m_streamTexture;
+    gfx::Size m_maxTextureSize;
 
     DISABLE_COPYING(DocumentExporter);
   };
@@ -0,0 +1,227 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/export_cache.h"
+
+#include "app/file/split_filename.h"
+#include "base/convert_to.h"
+#include "base/exception.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/log.h"
+#include "base/path.h"
+#include "doc/image.h"
+#include "doc/palette.h"
+
+#include <fstream>
+
+#define EXPORT_CACHE_MAGIC "libresprite-export-cache 1"
+
+namespace app {
+
+static ExportCache* current_cache = nullptr;
+
+static std::string to_hex(const base::Sha1& sha1)
+{
+  return base::convert_to<std::string>(sha1);
+}
+
+// Reads the lines of an entry, returns false if the entry doesn't
+// exist or it's not valid.
+static bool read_entry(const std::string& fn, std::vector<std::string>& lines)
+{
+  std::ifstream s(FSTREAM_PATH(fn));
+  std::string line;
+  if (!std::getline(s, line) || line != EXPORT_CACHE_MAGIC)
+    return false;
+
+  while (std::getline(s, line))
+    lines.push_back(line);
+  return true;
+}
+
+// Writes a temporary file and renames it, so a cancelled write never
+// leaves a broken entry.
+static void write_entry(const std::string& fn, const std::vector<std::string>& lines)
+{
+  std::string tmp = fn + ".tmp";
+  try {
+    {
+      std::ofstream s(FSTREAM_PATH(tmp));
+      s << EXPORT_CACHE_MAGIC << "\n";
+      for (const auto& line : lines)
+        s << line << "\n";
+      if (s.fail())
+        throw base::Exception("Error writing export cache entry");
+    }
+    if (base::is_file(fn))
+      base::delete_file(fn);
+    base::move_file(tmp, fn);
+  }
+  catch (const std::exception& ex) {
+    LOG("Error writing \"%s\": %s\n", fn.c_str(), ex.what());
+    if (base::is_file(tmp))
+      base::delete_file(tmp);
+  }
+}
+
+ExportCache::ExportCache(const std::string& dir)
+  : m_dir(dir)
+  , m_failed(false)
+{
+  if (!base::is_directory(m_dir))
+    base::make_all_directories(m_dir);
+}
+
+// static
+ExportCache* ExportCache::instance()
+{
+  return current_cache;
+}
+
+void ExportCache::beginJob(const std::vector<std::string>& args,
+                           const std::vector<std::string>& inputFiles)
+{
+  base::Sha1::Builder options;
+  options.add(EXPORT_CACHE_MAGIC "\n" VERSION "\n");
+  options.add(base::get_current_path() + "\n");
+  for (const auto& arg : args) {
+    options.add(arg);
+    options.add("\n");
+  }
+  m_optionsKey = to_hex(options.result());
+
+  // Files that are really loaded (all files of each sequence)
+  std::vector<std::string> files;
+  for (const auto& fn : inputFiles)
+    get_sequence_filenames(fn, files);
+
+  base::Sha1::Builder job;
+  job.add(m_optionsKey);
+  for (const auto& fn : files) {
+    job.add(fn + "\n");
+    job.add(to_hex(base::Sha1::calculateFromFile(fn)) + "\n");
+  }
+  m_jobKey = to_hex(job.result());
+
+  m_failed = false;
+  m_outputs.clear();
+  current_cache = this;
+}
+
+bool ExportCache::isJobUpToDate() const
+{
+  std::vector<std::string> lines;
+  if (!read_entry(entryFilename(m_jobKey, ".job"), lines) || lines.empty())
+    return false;
+
+  // Each line is "stamp\tfilename"
+  for (const auto& line : lines) {
+    std::size_t tab = line.find('\t');
+    if (tab == std::string::npos ||
+        line.substr(0, tab) != base::get_file_stamp(line.substr(tab+1)))
+      return false;
+  }
+  return true;
+}
+
+void ExportCache::endJob()
+{
+  if (current_cache == this)
+    current_cache = nullptr;
+
+  if (m_failed || m_outputs.empty())
+    return;
+
+  std::vector<std::string> jobLines;
+  for (const auto& output : m_outputs) {
+    const std::string& fn = output.first;
+    std::string stamp = base::get_file_stamp(fn);
+    if (stamp.empty())
+      return;
+
+    jobLines.push_back(stamp + "\t" + fn);
+
+    // Remember the content of the file to avoid writing it again
+    if (!output.second.empty())
+      write_entry(entryFilename(base::get_current_path() + "\n" + fn, ".out"),
+                  { output.second + "\t" + stamp });
+  }
+  write_entry(entryFilename(m_jobKey, ".job"), jobLines);
+}
+
+void ExportCache::addOutput(const std::string& filename)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_outputs[filename];
+}
+
+void ExportCache::addOutput(const std::string& filename, const base::Sha1& content)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_outputs[filename] = to_hex(content);
+}
+
+void ExportCache::setFailed()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_failed = true;
+}
+
+bool ExportCache::isOutputUpToDate(const std::string& filename,
+                                   const base::Sha1& content) const
+{
+  std::vector<std::string> lines;
+  if (!read_entry(entryFilename(base::get_current_path() + "\n" + filename, ".out"), lines) ||
+      lines.size() != 1)
+    return false;
+
+  // The line is "content\tstamp"
+  std::string stamp = base::get_file_stamp(filename);
+  return (!stamp.empty() && lines[0] == to_hex(content) + "\t" + stamp);
+}
+
+base::Sha1 ExportCache::imageHash(const doc::Image* image,
+                                  const doc::Palette* palette,
+                                  int transparentColor) const
+{
+  base::Sha1::Builder builder;
+  builder.add(m_optionsKey);
+
+  const int header[] = { int(image->pixelFormat()),
+                         image->width(),
+                         image->height(),
+                         transparentColor,
+                         (palette ? palette->size(): 0) };
+  builder.add(header, sizeof(header));
+
+  const int rowSize = image->getRowStrideSize();
+  for (int y=0; y<image->height(); ++y)
+    builder.add(image->getPixelAddress(0, y), rowSize);
+
+  if (palette) {
+    for (int i=0; i<palette->size(); ++i) {
+      doc::color_t color = palette->getEntry(i);
+      builder.add(&color, sizeof(color));
+    }
+  }
+  return builder.result();
+}
+
+std::string ExportCache::entryFilename(const std::string& key,
+                                       const char* extension) const
+{
+  base::Sha1::Builder builder;
+  builder.add(key);
+  return base::join_path(m_dir, to_hex(builder.result()) + extension);
+}
+
+} // namespace app
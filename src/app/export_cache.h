@@ -0,0 +1,102 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/sha1.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace doc {
+  class Image;
+  class Palette;
+}
+
+namespace app {
+
+  // Remembers the files written by exports in batch mode
+  // (--export-cache <dir>) to avoid doing the same work again:
+  //
+  // * A job (a command line, or each input file of a command line
+  //   when they are processed separately) is skipped if the content
+  //   of its input files and its options are the same as in a
+  //   previous job, and the files it wrote weren't modified since
+  //   then.
+  //
+  // * Each frame of a sequence (e.g. --save-as frame{frame}.png) is
+  //   encoded only if its image is different from the one in the
+  //   file (as it was written by a previous job).
+  //
+  // Files written by other programs (or modified after the export)
+  // are never trusted, they are identified by their size and
+  // modification time (with the best resolution available, see
+  // base::get_file_stamp()).
+  class ExportCache {
+  public:
+    explicit ExportCache(const std::string& dir);
+
+    // Cache used by the current job (or nullptr if there is no
+    // --export-cache).
+    static ExportCache* instance();
+
+    // Starts a new job with the given arguments (command line
+    // options and files) and input files (documents to load). The
+    // other files of a sequence (e.g. "frame02.png" for
+    // "frame01.png") are inputs too, as they are loaded with the
+    // first one. The cache is used as the instance() until endJob()
+    // is called.
+    void beginJob(const std::vector<std::string>& args,
+                  const std::vector<std::string>& inputFiles);
+
+    // Returns true if the current job was already done and its
+    // output files weren't modified.
+    bool isJobUpToDate() const;
+
+    // Remembers the written files (if the job didn't fail).
+    void endJob();
+
+    // The file was written by the current job. "content" is the
+    // hash of the data used to write it (see imageHash()).
+    void addOutput(const std::string& filename);
+    void addOutput(const std::string& filename, const base::Sha1& content);
+
+    // Some output couldn't be written, the job will be done again the
+    // next time.
+    void setFailed();
+
+    // Returns true if the file was written with the given content by
+    // a previous job (and it's still the same file).
+    bool isOutputUpToDate(const std::string& filename,
+                          const base::Sha1& content) const;
+
+    // Hash of an image to be encoded in a file by the current job.
+    base::Sha1 imageHash(const doc::Image* image,
+                         const doc::Palette* palette,
+                         int transparentColor) const;
+
+  private:
+    std::string entryFilename(const std::string& key,
+                              const char* extension) const;
+
+    std::string m_dir;
+    std::string m_optionsKey; // Hash of the options of the current job
+    std::string m_jobKey;     // Hash of the options and input files
+    bool m_failed;
+
+    // Written files of the current job -> hash of their content (or
+    // an empty string if it's unknown)
+    std::map<std::string, std::string> m_outputs;
+    std::mutex m_mutex;
+
+    DISABLE_COPYING(ExportCache);
+  };
+
+} // namespace app
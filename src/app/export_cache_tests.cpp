@@ -0,0 +1,188 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/test.h"
+
+#include "app/export_cache.h"
+#include "base/fs.h"
+#include "base/path.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+using namespace app;
+
+typedef std::vector<std::string> Args;
+
+class ExportCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    m_dir = base::join_path(base::get_temp_path(), "_export_cache_tests");
+    m_cacheDir = base::join_path(m_dir, "cache");
+    m_input = base::join_path(m_dir, "input.ase");
+    m_output = base::join_path(m_dir, "output.png");
+    base::make_all_directories(m_cacheDir);
+    write(m_input, "input");
+    std::remove(m_output.c_str());
+  }
+
+  void TearDown() override {
+    for (const auto& fn : base::list_files(m_cacheDir))
+      base::delete_file(base::join_path(m_cacheDir, fn));
+    base::remove_directory(m_cacheDir);
+    base::delete_file(m_input);
+    if (base::is_file(m_output))
+      base::delete_file(m_output);
+    base::remove_directory(m_dir);
+  }
+
+  static void write(const std::string& fn, const std::string& content) {
+    std::ofstream s(fn, std::ofstream::binary | std::ofstream::trunc);
+    s << content;
+  }
+
+  // Simulates a job that writes the output file
+  void runJob(ExportCache& cache) {
+    cache.beginJob(args(), { m_input });
+    write(m_output, "output");
+    cache.addOutput(m_output);
+    cache.endJob();
+  }
+
+  Args args() const { return { m_input, "--save-as", m_output }; }
+
+  std::string m_dir, m_cacheDir, m_input, m_output;
+};
+
+TEST_F(ExportCacheTest, JobIsUpToDate)
+{
+  ExportCache cache(m_cacheDir);
+  cache.beginJob(args(), { m_input });
+  EXPECT_EQ(&cache, ExportCache::instance());
+  EXPECT_FALSE(cache.isJobUpToDate());
+  cache.endJob();
+  EXPECT_EQ(nullptr, ExportCache::instance());
+
+  runJob(cache);
+
+  cache.beginJob(args(), { m_input });
+  EXPECT_TRUE(cache.isJobUpToDate());
+  cache.endJob();
+
+  // Other options
+  cache.beginJob({ m_input, "--save-as", m_output, "--scale", "2" }, { m_input });
+  EXPECT_FALSE(cache.isJobUpToDate());
+  cache.endJob();
+}
+
+TEST_F(ExportCacheTest, ModifiedInput)
+{
+  ExportCache cache(m_cacheDir);
+  runJob(cache);
+
+  write(m_input, "modified input");
+  cache.beginJob(args(), { m_input });
+  EXPECT_FALSE(cache.isJobUpToDate());
+  cache.endJob();
+}
+
+TEST_F(ExportCacheTest, ModifiedOrDeletedOutput)
+{
+  ExportCache cache(m_cacheDir);
+  runJob(cache);
+
+  write(m_output, "modified output");
+  cache.beginJob(args(), { m_input });
+  EXPECT_FALSE(cache.isJobUpToDate());
+  cache.endJob();
+
+  runJob(cache);
+  base::delete_file(m_output);
+  cache.beginJob(args(), { m_input });
+  EXPECT_FALSE(cache.isJobUpToDate());
+  cache.endJob();
+}
+
+TEST_F(ExportCacheTest, OutputModifiedInTheSameSecond)
+{
+  ExportCache cache(m_cacheDir);
+  runJob(cache);
+
+  // Same size, a few milliseconds later
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  write(m_output, "OUTPUT");
+  cache.beginJob(args(), { m_input });
+  EXPECT_FALSE(cache.isJobUpToDate());
+  cache.endJob();
+}
+
+// The other files of a sequence are loaded with the first one, so
+// they are inputs of the job too.
+TEST_F(ExportCacheTest, ModifiedFrameOfSequence)
+{
+  std::string frame1 = base::join_path(m_dir, "frame01.png");
+  std::string frame2 = base::join_path(m_dir, "frame02.png");
+  write(frame1, "frame 1");
+  write(frame2, "frame 2");
+
+  ExportCache cache(m_cacheDir);
+  Args args = { frame1, "--save-as", m_output };
+  cache.beginJob(args, { frame1 });
+  write(m_output, "output");
+  cache.addOutput(m_output);
+  cache.endJob();
+
+  cache.beginJob(args, { frame1 });
+  EXPECT_TRUE(cache.isJobUpToDate());
+  cache.endJob();
+
+  write(frame2, "modified frame 2");
+  cache.beginJob(args, { frame1 });
+  EXPECT_FALSE(cache.isJobUpToDate());
+  cache.endJob();
+
+  base::delete_file(frame1);
+  base::delete_file(frame2);
+}
+
+TEST_F(ExportCacheTest, FailedJob)
+{
+  ExportCache cache(m_cacheDir);
+  cache.beginJob(args(), { m_input });
+  write(m_output, "output");
+  cache.addOutput(m_output);
+  cache.setFailed();
+  cache.endJob();
+
+  cache.beginJob(args(), { m_input });
+  EXPECT_FALSE(cache.isJobUpToDate());
+  cache.endJob();
+}
+
+TEST_F(ExportCacheTest, OutputContent)
+{
+  base::Sha1::Builder a, b;
+  a.add("a");
+  b.add("b");
+  base::Sha1 hashA = a.result();
+  base::Sha1 hashB = b.result();
+
+  ExportCache cache(m_cacheDir);
+  cache.beginJob(args(), { m_input });
+  EXPECT_FALSE(cache.isOutputUpToDate(m_output, hashA));
+  write(m_output, "output");
+  cache.addOutput(m_output, hashA);
+  cache.endJob();
+
+  EXPECT_TRUE(cache.isOutputUpToDate(m_output, hashA));
+  EXPECT_FALSE(cache.isOutputUpToDate(m_output, hashB));
+
+  write(m_output, "modified output");
+  EXPECT_FALSE(cache.isOutputUpToDate(m_output, hashA));
+}
@@ -11,19 +11,29 @@
 
 #include "app/context.h"
 #include "app/document.h"
+#include "app/file/ase_options.h"
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
+#include "app/ini_file.h"
 #include "base/cfile.h"
 #include "base/exception.h"
 #include "base/file_handle.h"
+#include "base/fs.h"
 #include "base/path.h"
+#include "base/thread_pool.h"
+#include "doc/algorithm/rotate.h"
 #include "doc/doc.h"
 #include "ui/alert.h"
 #include "zlib.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 
 #define ASE_FILE_MAGIC                      0xA5E0
 #define ASE_FILE_FRAME_MAGIC                0xF1FA
@@ -62,6 +72,10 @@
 #define ASE_USER_DATA_FLAG_HAS_TEXT         1
 #define ASE_USER_DATA_FLAG_HAS_COLOR        2
 
+// Progress of the first pass reading the sprite structure (the rest
+// is used to decode compressed cels)
+#define ASE_FIRST_PASS_PROGRESS             0.1
+
 namespace app {
 
 using namespace base;
@@ -96,6 +110,20 @@ struct ASE_Chunk {
   int start;
 };
 
+// Compressed cel found while reading the file structure. Its pixels
+// are decoded later (in parallel with other cels).
+struct ASE_CompressedCel {
+  ImageRef image;
+  long offset;                  // Offset of the zlib data in the file
+  size_t size;                  // Size of the zlib data
+  gfx::Size imageSize;          // Size of the image in the file (it
+                                // can be bigger than "image" when we
+                                // load a reduced preview)
+};
+
+// Cel images being compressed in worker threads to be written later.
+typedef std::map<const Cel*, std::future<std::vector<uint8_t>>> ASE_CompressingCels;
+
 static bool ase_file_read_header(FILE* f, ASE_Header* header);
 static void ase_file_prepare_header(FILE* f, ASE_Header* header, const Sprite* sprite);
 static void ase_file_write_header(FILE* f, ASE_Header* header);
@@ -106,7 +134,9 @@ static void ase_file_prepare_frame_header(FILE* f, ASE_FrameHeader* frame_header
 static void ase_file_write_frame_header(FILE* f, ASE_FrameHeader* frame_header);
 
 static void ase_file_write_layers(FILE* f, ASE_FrameHeader* frame_header, const Layer* layer);
-static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, const Sprite* sprite, const Layer* layer, frame_t frame);
+static std::vector<uint8_t> compress_image(const Image* image, int level);
+static void ase_file_compress_cels(base::thread_pool& pool, ASE_CompressingCels& cels, FileOp* fop, const AseOptions& options, const Layer* layer, frame_t frame);
+static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, const Sprite* sprite, const Layer* layer, frame_t frame, ASE_CompressingCels& cels);
 
 static void ase_file_read_padding(FILE* f, int bytes);
 static void ase_file_write_padding(FILE* f, int bytes);
@@ -123,8 +153,9 @@ static void ase_file_write_color2_chunk(FILE* f, ASE_FrameHeader* frame_header,
 static void ase_file_write_palette_chunk(FILE* f, ASE_FrameHeader* frame_header, const Palette* pal, int from, int to);
 static Layer* ase_file_read_layer_chunk(FILE* f, ASE_Header* header, Sprite* sprite, Layer** previous_layer, int* current_level);
 static void ase_file_write_layer_chunk(FILE* f, ASE_FrameHeader* frame_header, const Layer* layer);
-static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame, PixelFormat pixelFormat, FileOp* fop, ASE_Header* header, size_t chunk_end);
-static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, const Cel* cel, const LayerImage* layer, const Sprite* sprite);
+static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame, PixelFormat pixelFormat, FileOp* fop, ASE_Header* header, size_t chunk_end, int scale, std::vector<ASE_CompressedCel>& compressedCels, bool lazy);
+static void ase_file_read_compressed_cels(FILE* f, std::vector<ASE_CompressedCel>& compressedCels, int scale, FileOp* fop);
+static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, const Cel* cel, const LayerImage* layer, const Sprite* sprite, ASE_CompressingCels& cels);
 static Mask* ase_file_read_mask_chunk(FILE* f);
 #if 0
 static void ase_file_write_mask_chunk(FILE* f, ASE_FrameHeader* frame_header, Mask* mask);
@@ -166,35 +197,112 @@ class AseFormat : public FileFormat {
       FILE_SUPPORT_LAYERS |
       FILE_SUPPORT_FRAMES |
       FILE_SUPPORT_PALETTES |
+      FILE_SUPPORT_GET_FORMAT_OPTIONS |
       FILE_SUPPORT_FRAME_TAGS |
       FILE_SUPPORT_BIG_PALETTES |
       FILE_SUPPORT_PALETTE_WITH_ALPHA;
   }
 
   bool onLoad(FileOp* fop) override;
+  bool onLoadPreview(FileOp* fop, int maxSize) override;
   bool onPostLoad(FileOp* fop) override;
   bool onSave(FileOp* fop) override;
+  base::SharedPtr<FormatOptions> onGetFormatOptions(FileOp* fop) override;
   int listPriority() override {return -100;}
+
+  bool loadSprite(FileOp* fop, int previewSize);
 };
 
 static FileFormat::Regular<AseFormat> ff{"ase"};
 
+static AseOptions::Compression default_compression = AseOptions::Compression::Default;
+
+int AseOptions::zlibLevel() const
+{
+  switch (m_compression) {
+    case Compression::Fast: return Z_BEST_SPEED;
+    case Compression::Max: return Z_BEST_COMPRESSION;
+    default: return Z_DEFAULT_COMPRESSION;
+  }
+}
+
+// static
+AseOptions::Compression AseOptions::defaultCompression()
+{
+  return default_compression;
+}
+
+// static
+void AseOptions::setDefaultCompression(Compression compression)
+{
+  default_compression = compression;
+}
+
+// static
+bool AseOptions::parseCompression(const std::string& str, Compression& compression)
+{
+  if (str == "fast")
+    compression = Compression::Fast;
+  else if (str == "default")
+    compression = Compression::Default;
+  else if (str == "max")
+    compression = Compression::Max;
+  else
+    return false;
+  return true;
+}
+
+// Size of something (sprite or cel) in a preview reduced "scale" times
+static int ase_reduced_size(int size, int scale)
+{
+  return (size + scale - 1) / scale;
+}
+
+// Position of a cel in a preview reduced "scale" times
+static int ase_reduced_pos(int pos, int scale)
+{
+  return (pos >= 0 ? pos / scale: -((-pos + scale - 1) / scale));
+}
+
 bool AseFormat::onLoad(FileOp* fop)
+{
+  return loadSprite(fop, 0);
+}
+
+// Loads only the first frame, decoding one of each N pixels so the
+// sprite is at least "maxSize" pixels (and not much more) in its
+// biggest dimension.
+bool AseFormat::onLoadPreview(FileOp* fop, int maxSize)
+{
+  return loadSprite(fop, maxSize);
+}
+
+bool AseFormat::loadSprite(FileOp* fop, int previewSize)
 {
   FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
   FILE* f = handle.get();
   bool ignore_old_color_chunks = false;
 
+  // Cel pixels are decoded when they are used
+  const bool lazy = (fop->isLazy() && previewSize == 0);
+
   ASE_Header header;
   if (!ase_file_read_header(f, &header)) {
     fop->setError("Error reading header\n");
     return false;
   }
 
+  // Scale to reduce the sprite when we are loading a preview
+  int scale = 1;
+  if (previewSize > 0)
+    scale = std::max(1, std::max<int>(header.width, header.height) / previewSize);
+
   // Create the new sprite
   std::unique_ptr<Sprite> sprite(new Sprite(header.depth == 32 ? IMAGE_RGB:
       header.depth == 16 ? IMAGE_GRAYSCALE: IMAGE_INDEXED,
-      header.width, header.height, header.ncolors));
+      ase_reduced_size(header.width, scale),
+      ase_reduced_size(header.height, scale),
+      header.ncolors));
 
   // Set frames and speed
   sprite->setTotalFrames(frame_t(header.frames));
@@ -208,11 +316,16 @@ bool AseFormat::onLoad(FileOp* fop)
   WithUserData* last_object_with_user_data = nullptr;
   int current_level = -1;
 
+  // The file is loaded in two passes: first we read the whole
+  // structure of the sprite (skipping the compressed pixels of each
+  // cel), and then we decode all compressed cels in parallel.
+  std::vector<ASE_CompressedCel> compressedCels;
+
   // Read frame by frame to end-of-file
   for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
     // Start frame position
     int frame_pos = ftell(f);
-    fop->setProgress((float)frame_pos / (float)header.size);
+    fop->setProgress(ASE_FIRST_PASS_PROGRESS * frame_pos / header.size);
 
     // Read frame header
     ASE_FrameHeader frame_header;
@@ -228,7 +341,7 @@ bool AseFormat::onLoad(FileOp* fop)
       for (int c=0; c<frame_header.chunks; c++) {
         /* start chunk position */
         int chunk_pos = ftell(f);
-        fop->setProgress((float)chunk_pos / (float)header.size);
+        fop->setProgress(ASE_FIRST_PASS_PROGRESS * chunk_pos / header.size);
 
         // Read chunk information
         int chunk_size = fgetl(f);
@@ -271,7 +384,8 @@ bool AseFormat::onLoad(FileOp* fop)
             Cel* cel =
               ase_file_read_cel_chunk(f, sprite.get(), frame,
                                       sprite->pixelFormat(), fop, &header,
-                                      chunk_pos+chunk_size);
+                                      chunk_pos+chunk_size, scale,
+                                      compressedCels, lazy);
             if (cel) {
               last_object_with_user_data = cel->data();
             }
@@ -325,13 +439,17 @@ bool AseFormat::onLoad(FileOp* fop)
     fseek(f, frame_pos+frame_header.size, SEEK_SET);
 
     // Just one frame?
-    if (fop->isOneFrame())
+    if (fop->isOneFrame() || previewSize > 0)
       break;
 
     if (fop->isStop())
       break;
   }
 
+  // Second pass: decode pixels of compressed cels
+  if (!fop->isStop())
+    ase_file_read_compressed_cels(f, compressedCels, scale, fop);
+
   fop->createDocument(sprite.get());
   sprite.release();
 
@@ -383,6 +501,19 @@ bool AseFormat::onSave(FileOp* fop)
   ase_file_prepare_header(f, &header, sprite);
   ase_file_write_header(f, &header);
 
+  base::SharedPtr<AseOptions> options = fop->sequenceGetFormatOptions();
+  if (!options)
+    options.reset(new AseOptions);
+
+  // Compress cel images in worker threads, they are written in order
+  // as soon as they are ready. Only a few frames ahead of the frame
+  // being written are queued, so the compressed data of the whole
+  // sprite is never in memory at the same time.
+  base::thread_pool pool;
+  ASE_CompressingCels compressingCels;
+  const frame_t compressWindow = frame_t(pool.size()) + 1;
+  frame_t compressedFrames = 0;
+
   bool require_new_palette_chunk = false;
   for (auto& pal : sprite->getPalettes()) {
     if (pal->size() != 256 || pal->hasAlpha()) {
@@ -393,6 +524,12 @@ bool AseFormat::onSave(FileOp* fop)
 
   // Write frames
   for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
+    for (; compressedFrames < std::min(frame+compressWindow, sprite->totalFrames());
+         ++compressedFrames) {
+      ase_file_compress_cels(pool, compressingCels, fop, *options,
+                             sprite->folder(), compressedFrames);
+    }
+
     // Prepare the frame header
     ASE_FrameHeader frame_header;
     ase_file_prepare_frame_header(f, &frame_header);
@@ -430,7 +567,8 @@ bool AseFormat::onSave(FileOp* fop)
     }
 
     // Write cel chunks
-    ase_file_write_cels(f, &frame_header, sprite, sprite->folder(), frame);
+    ase_file_write_cels(f, &frame_header, sprite, sprite->folder(), frame,
+                        compressingCels);
 
     // Write the frame header
     ase_file_write_frame_header(f, &frame_header);
@@ -455,6 +593,24 @@ bool AseFormat::onSave(FileOp* fop)
   }
 }
 
+base::SharedPtr<FormatOptions> AseFormat::onGetFormatOptions(FileOp* fop)
+{
+  base::SharedPtr<AseOptions> ase_options(new AseOptions);
+
+  // The compression level used from the UI can be changed in the
+  // configuration file
+  if (fop->context() &&
+      fop->context()->isUIAvailable()) {
+    int compression = get_config_int("ASE", "Compression",
+                                     int(ase_options->compression()));
+    if (compression >= int(AseOptions::Compression::Fast) &&
+        compression <= int(AseOptions::Compression::Max))
+      ase_options->setCompression(AseOptions::Compression(compression));
+  }
+
+  return ase_options;
+}
+
 static bool ase_file_read_header(FILE* f, ASE_Header* header)
 {
   header->pos = ftell(f);
@@ -594,14 +750,41 @@ static void ase_file_write_layers(FILE* f, ASE_FrameHeader* frame_header, const
   }
 }
 
-static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, const Sprite* sprite, const Layer* layer, frame_t frame)
+static void ase_file_compress_cels(base::thread_pool& pool, ASE_CompressingCels& cels, FileOp* fop, const AseOptions& options, const Layer* layer, frame_t frame)
+{
+  if (layer->isImage()) {
+    auto cel = layer->cel(frame);
+    if (cel && !cel->link() && cel->image()) {
+      const Image* image = cel->image();
+      const int level = options.zlibLevel();
+      auto task = std::make_shared<std::packaged_task<std::vector<uint8_t>()>>(
+        [image, level, fop]{
+          if (fop->isStop())
+            return std::vector<uint8_t>();
+          return compress_image(image, level);
+        });
+      cels[cel.get()] = task->get_future();
+      pool.execute([task]{ (*task)(); });
+    }
+  }
+
+  if (layer->isFolder()) {
+    auto it = static_cast<const LayerFolder*>(layer)->getLayerBegin(),
+         end = static_cast<const LayerFolder*>(layer)->getLayerEnd();
+
+    for (; it != end; ++it)
+      ase_file_compress_cels(pool, cels, fop, options, *it, frame);
+  }
+}
+
+static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, const Sprite* sprite, const Layer* layer, frame_t frame, ASE_CompressingCels& cels)
 {
   if (layer->isImage()) {
     if (auto cel = layer->cel(frame)) {
 /*       fop->setError("New cel in frame %d, in layer %d\n", */
 /*                   frame, sprite_layer2index(sprite, layer)); */
 
-      ase_file_write_cel_chunk(f, frame_header, cel.get(), static_cast<const LayerImage*>(layer), sprite);
+      ase_file_write_cel_chunk(f, frame_header, cel.get(), static_cast<const LayerImage*>(layer), sprite, cels);
 
       if (!cel->link() &&
           !cel->data()->userData().isEmpty()) {
@@ -616,7 +799,7 @@ static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, const Sp
          end = static_cast<const LayerFolder*>(layer)->getLayerEnd();
 
     for (; it != end; ++it)
-      ase_file_write_cels(f, frame_header, sprite, *it, frame);
+      ase_file_write_cels(f, frame_header, sprite, *it, frame, cels);
   }
 }
 
@@ -894,6 +1077,10 @@ static void ase_file_write_layer_chunk(FILE* f, ASE_FrameHeader* frame_header, c
 // Pixel I/O
 //////////////////////////////////////////////////////////////////////
 
+// The "same_layout" member of each PixelIO indicates if the pixels
+// in memory have the same byte order of the .ase file (little-endian),
+// so rows can be read/written directly without a conversion.
+
 template<typename ImageTraits>
 class PixelIO {
 public:
@@ -907,6 +1094,11 @@ template<>
 class PixelIO<RgbTraits> {
   int r, g, b, a;
 public:
+#ifdef ASEPRITE_LITTLE_ENDIAN
+  static const bool same_layout = true;
+#else
+  static const bool same_layout = false;
+#endif
   RgbTraits::pixel_t read_pixel(FILE* f) {
     r = fgetc(f);
     g = fgetc(f);
@@ -946,6 +1138,11 @@ template<>
 class PixelIO<GrayscaleTraits> {
   int k, a;
 public:
+#ifdef ASEPRITE_LITTLE_ENDIAN
+  static const bool same_layout = true;
+#else
+  static const bool same_layout = false;
+#endif
   GrayscaleTraits::pixel_t read_pixel(FILE* f) {
     k = fgetc(f);
     a = fgetc(f);
@@ -976,6 +1173,7 @@ public:
 template<>
 class PixelIO<IndexedTraits> {
 public:
+  static const bool same_layout = true;
   IndexedTraits::pixel_t read_pixel(FILE* f) {
     return fgetc(f);
   }
@@ -999,15 +1197,26 @@ public:
 template<typename ImageTraits>
 static void read_raw_image(FILE* f, Image* image, FileOp* fop, ASE_Header* header)
 {
-  PixelIO<ImageTraits> pixel_io;
-  int x, y;
+  typedef PixelIO<ImageTraits> PixelIOT;
+  PixelIOT pixel_io;
+  const size_t rowBytes = ImageTraits::getRowStrideBytes(image->width());
+  std::vector<uint8_t> scanline(PixelIOT::same_layout ? 0: rowBytes);
+  int y;
 
   for (y=0; y<image->height(); y++) {
-    for (x=0; x<image->width(); x++)
-      put_pixel_fast<ImageTraits>(image, x, y, pixel_io.read_pixel(f));
+    typename ImageTraits::address_t address =
+      (typename ImageTraits::address_t)image->getPixelAddress(0, y);
 
-    fop->setProgress((float)ftell(f) / (float)header->size);
+    // Read the whole row (directly in the image if it's possible)
+    uint8_t* dst = (PixelIOT::same_layout ? (uint8_t*)address: &scanline[0]);
+    if (fread(dst, 1, rowBytes, f) != rowBytes)
+      std::fill(dst, dst+rowBytes, 0);
+
+    if (!PixelIOT::same_layout)
+      pixel_io.read_scanline(address, image->width(), &scanline[0]);
   }
+
+  fop->setProgress(ASE_FIRST_PASS_PROGRESS * ftell(f) / header->size);
 }
 
 template<typename ImageTraits>
@@ -1025,143 +1234,250 @@ static void write_raw_image(FILE* f, const Image* image)
 // Compressed Image
 //////////////////////////////////////////////////////////////////////
 
-template<typename ImageTraits>
-static void read_compressed_image(FILE* f, Image* image, size_t chunk_end, FileOp* fop, ASE_Header* header)
-{
-  PixelIO<ImageTraits> pixel_io;
-  z_stream zstream;
-  int y, err;
-
-  zstream.zalloc = (alloc_func)0;
-  zstream.zfree  = (free_func)0;
-  zstream.opaque = (voidpf)0;
+// Inflates the zlib data of a compressed cel row by row.
+class ASE_Inflater {
+public:
+  ASE_Inflater(const std::vector<uint8_t>& compressed) : m_err(Z_OK) {
+    m_zstream.zalloc = (alloc_func)0;
+    m_zstream.zfree  = (free_func)0;
+    m_zstream.opaque = (voidpf)0;
 
-  err = inflateInit(&zstream);
-  if (err != Z_OK)
-    throw base::Exception("ZLib error %d in inflateInit().", err);
+    int err = inflateInit(&m_zstream);
+    if (err != Z_OK)
+      throw base::Exception("ZLib error %d in inflateInit().", err);
 
-  std::vector<uint8_t> scanline(ImageTraits::getRowStrideBytes(image->width()));
-  std::vector<uint8_t> uncompressed(static_cast<long>(image->height()) * ImageTraits::getRowStrideBytes(image->width()));
-  std::vector<uint8_t> compressed(4096);
-  int uncompressed_offset = 0;
+    m_zstream.next_in = (Bytef*)compressed.data();
+    m_zstream.avail_in = compressed.size();
+  }
 
-  while (true) {
-    size_t input_bytes;
+  ~ASE_Inflater() {
+    inflateEnd(&m_zstream);
+  }
 
-    if (ftell(f)+compressed.size() > chunk_end) {
-      input_bytes = chunk_end - ftell(f); // Remaining bytes
-      ASSERT(input_bytes < compressed.size());
+  // Inflates the next "size" bytes in "dst". If the data is
+  // truncated, the rest of "dst" is cleared.
+  void readRow(uint8_t* dst, size_t size) {
+    m_zstream.next_out = (Bytef*)dst;
+    m_zstream.avail_out = size;
 
-      if (input_bytes == 0)
-        break;                  // Done, we consumed all chunk
+    while (m_zstream.avail_out > 0 && m_err == Z_OK) {
+      m_err = inflate(&m_zstream, Z_NO_FLUSH);
+      if (m_err != Z_OK && m_err != Z_STREAM_END && m_err != Z_BUF_ERROR)
+        throw base::Exception("ZLib error %d in inflate().", m_err);
     }
-    else
-      input_bytes = compressed.size();
 
-    size_t bytes_read = fread(&compressed[0], 1, input_bytes, f);
-    zstream.next_in = (Bytef*)&compressed[0];
-    zstream.avail_in = bytes_read;
+    if (m_zstream.avail_out > 0)
+      std::fill(dst + size - m_zstream.avail_out, dst + size, 0);
+  }
 
-    do {
-      zstream.next_out = (Bytef*)&scanline[0];
-      zstream.avail_out = scanline.size();
+private:
+  z_stream m_zstream;
+  int m_err;
+};
 
-      err = inflate(&zstream, Z_NO_FLUSH);
-      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
-        throw base::Exception("ZLib error %d in inflate().", err);
+template<typename ImageTraits>
+static void read_compressed_image(const std::vector<uint8_t>& compressed, Image* image)
+{
+  typedef PixelIO<ImageTraits> PixelIOT;
+  PixelIOT pixel_io;
+  ASE_Inflater inflater(compressed);
 
-      size_t uncompressed_bytes = scanline.size() - zstream.avail_out;
-      if (uncompressed_bytes > 0) {
-        if (uncompressed_offset+uncompressed_bytes > uncompressed.size())
-          throw base::Exception("Bad compressed image.");
+  // Rows are inflated directly in the image memory when the pixel
+  // layout matches, in other case we use a scanline to convert them.
+  const size_t rowBytes = ImageTraits::getRowStrideBytes(image->width());
+  std::vector<uint8_t> scanline(PixelIOT::same_layout ? 0: rowBytes);
 
-        std::copy(scanline.begin(), scanline.begin()+uncompressed_bytes,
-                  uncompressed.begin()+uncompressed_offset);
+  for (int y=0; y<image->height(); y++) {
+    typename ImageTraits::address_t address =
+      (typename ImageTraits::address_t)image->getPixelAddress(0, y);
+    uint8_t* dst = (PixelIOT::same_layout ? (uint8_t*)address: &scanline[0]);
 
-        uncompressed_offset += uncompressed_bytes;
-      }
-    } while (zstream.avail_out == 0);
+    inflater.readRow(dst, rowBytes);
 
-    fop->setProgress((float)ftell(f) / (float)header->size);
+    if (!PixelIOT::same_layout)
+      pixel_io.read_scanline(address, image->width(), &scanline[0]);
   }
+}
 
-  uncompressed_offset = 0;
-  for (y=0; y<image->height(); y++) {
-    typename ImageTraits::address_t address =
-      (typename ImageTraits::address_t)image->getPixelAddress(0, y);
+// Decodes a compressed cel of "srcSize" pixels keeping only one of
+// each "scale" rows/columns in "image" (used to load previews).
+template<typename ImageTraits>
+static void read_compressed_image_reduced(const std::vector<uint8_t>& compressed, Image* image,
+                                          const gfx::Size& srcSize, int scale)
+{
+  PixelIO<ImageTraits> pixel_io;
+  ASE_Inflater inflater(compressed);
 
-    pixel_io.read_scanline(address, image->width(), &uncompressed[uncompressed_offset]);
+  std::vector<uint8_t> scanline(ImageTraits::getRowStrideBytes(srcSize.w));
+  std::vector<typename ImageTraits::pixel_t> row(srcSize.w);
 
-    uncompressed_offset += ImageTraits::getRowStrideBytes(image->width());
-  }
+  // We can stop inflating after the last row that we need
+  for (int y=0; y<srcSize.h && y/scale < image->height(); y++) {
+    inflater.readRow(&scanline[0], scanline.size());
+    if ((y % scale) != 0)
+      continue;
 
-  err = inflateEnd(&zstream);
-  if (err != Z_OK)
-    throw base::Exception("ZLib error %d in inflateEnd().", err);
+    pixel_io.read_scanline(&row[0], srcSize.w, &scanline[0]);
+
+    typename ImageTraits::address_t address =
+      (typename ImageTraits::address_t)image->getPixelAddress(0, y/scale);
+    for (int x=0; x<image->width(); x++)
+      address[x] = row[x*scale];
+  }
 }
 
 template<typename ImageTraits>
-static void write_compressed_image(FILE* f, const Image* image)
+static void write_compressed_image(const Image* image, int level, std::vector<uint8_t>& output)
 {
-  PixelIO<ImageTraits> pixel_io;
+  typedef PixelIO<ImageTraits> PixelIOT;
+  PixelIOT pixel_io;
   z_stream zstream;
   int y, err;
 
   zstream.zalloc = (alloc_func)0;
   zstream.zfree  = (free_func)0;
   zstream.opaque = (voidpf)0;
-  err = deflateInit(&zstream, Z_DEFAULT_COMPRESSION);
+  err = deflateInit(&zstream, level);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateInit().", err);
 
   std::vector<uint8_t> scanline(ImageTraits::getRowStrideBytes(image->width()));
-  std::vector<uint8_t> compressed(4096);
+  output.resize(deflateBound(&zstream, uLong(scanline.size()) * image->height()));
+  zstream.next_out = (Bytef*)&output[0];
+  zstream.avail_out = output.size();
 
   for (y=0; y<image->height(); y++) {
     typename ImageTraits::address_t address =
       (typename ImageTraits::address_t)image->getPixelAddress(0, y);
 
-    pixel_io.write_scanline(address, image->width(), &scanline[0]);
-
-    zstream.next_in = (Bytef*)&scanline[0];
+    // Compress the row directly from the image memory if possible
+    if (PixelIOT::same_layout) {
+      zstream.next_in = (Bytef*)address;
+    }
+    else {
+      pixel_io.write_scanline(address, image->width(), &scanline[0]);
+      zstream.next_in = (Bytef*)&scanline[0];
+    }
     zstream.avail_in = scanline.size();
     int flush = (y == image->height()-1 ? Z_FINISH: Z_NO_FLUSH);
 
-    do {
-      zstream.next_out = (Bytef*)&compressed[0];
-      zstream.avail_out = compressed.size();
-
-      // Compress
-      err = deflate(&zstream, flush);
-      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
-        throw base::Exception("ZLib error %d in deflate().", err);
-
-      int output_bytes = compressed.size() - zstream.avail_out;
-      if (output_bytes > 0) {
-        if ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
-            || ferror(f))
-          throw base::Exception("Error writing compressed image pixels.\n");
-      }
-    } while (zstream.avail_out == 0);
+    // Compress (the output buffer is big enough for the whole image)
+    err = deflate(&zstream, flush);
+    if (err != Z_OK && err != Z_STREAM_END)
+      throw base::Exception("ZLib error %d in deflate().", err);
   }
+  // Release the unused part of the deflateBound() buffer (the data
+  // is kept in memory until it's written in the file)
+  output.resize(output.size() - zstream.avail_out);
+  output.shrink_to_fit();
 
   err = deflateEnd(&zstream);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateEnd().", err);
 }
 
+static std::vector<uint8_t> compress_image(const Image* image, int level)
+{
+  std::vector<uint8_t> output;
+  switch (image->pixelFormat()) {
+
+    case IMAGE_RGB:
+      write_compressed_image<RgbTraits>(image, level, output);
+      break;
+
+    case IMAGE_GRAYSCALE:
+      write_compressed_image<GrayscaleTraits>(image, level, output);
+      break;
+
+    case IMAGE_INDEXED:
+      write_compressed_image<IndexedTraits>(image, level, output);
+      break;
+  }
+  return output;
+}
+
+static void decompress_image(const std::vector<uint8_t>& compressed, Image* image)
+{
+  switch (image->pixelFormat()) {
+
+    case IMAGE_RGB:
+      read_compressed_image<RgbTraits>(compressed, image);
+      break;
+
+    case IMAGE_GRAYSCALE:
+      read_compressed_image<GrayscaleTraits>(compressed, image);
+      break;
+
+    case IMAGE_INDEXED:
+      read_compressed_image<IndexedTraits>(compressed, image);
+      break;
+  }
+}
+
+static void decompress_image_reduced(const std::vector<uint8_t>& compressed, Image* image,
+                                     const gfx::Size& srcSize, int scale)
+{
+  switch (image->pixelFormat()) {
+
+    case IMAGE_RGB:
+      read_compressed_image_reduced<RgbTraits>(compressed, image, srcSize, scale);
+      break;
+
+    case IMAGE_GRAYSCALE:
+      read_compressed_image_reduced<GrayscaleTraits>(compressed, image, srcSize, scale);
+      break;
+
+    case IMAGE_INDEXED:
+      read_compressed_image_reduced<IndexedTraits>(compressed, image, srcSize, scale);
+      break;
+  }
+}
+
+// Decodes the pixels of a compressed cel the first time its image is
+// used (for files loaded with FILE_LOAD_LAZY). The compressed data is
+// copied when the file is opened, so the pixels don't depend on the
+// file (it can be modified or deleted after it's opened).
+class AseLazyCelLoader : public ImageLoader {
+public:
+  AseLazyCelLoader(std::vector<uint8_t>&& compressed)
+    : m_compressed(std::move(compressed)) {
+  }
+
+protected:
+  void onLoad(Image* image) override {
+    try {
+      decompress_image(m_compressed, image);
+    }
+    catch (const std::exception& e) {
+      // The image is left empty, and the user is warned when the
+      // sprite is saved (see FileOp::createSaveDocumentOperation()).
+      LOG("Error decoding cel pixels: %s\n", e.what());
+      clear_image(image, image->maskColor());
+      setFailed();
+    }
+    m_compressed.clear();
+    m_compressed.shrink_to_fit();
+  }
+
+private:
+  std::vector<uint8_t> m_compressed;
+};
+
 //////////////////////////////////////////////////////////////////////
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
 
 static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
                                     PixelFormat pixelFormat,
-                                    FileOp* fop, ASE_Header* header, size_t chunk_end)
+                                    FileOp* fop, ASE_Header* header, size_t chunk_end,
+                                    int scale,
+                                    std::vector<ASE_CompressedCel>& compressedCels,
+                                    bool lazy)
 {
   /* read chunk data */
   LayerIndex layer_index = LayerIndex(fgetw(f));
-  int x = ((short)fgetw(f));
-  int y = ((short)fgetw(f));
+  int x = ase_reduced_pos((short)fgetw(f), scale);
+  int y = ase_reduced_pos((short)fgetw(f), scale);
   int opacity = fgetc(f);
   int cel_type = fgetw(f);
   Layer* layer;
@@ -1209,6 +1525,16 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
             break;
         }
 
+        if (scale > 1) {
+          ImageRef reduced(Image::create(pixelFormat,
+                                         ase_reduced_size(w, scale),
+                                         ase_reduced_size(h, scale)));
+          algorithm::scale_image(reduced.get(), image.get(),
+                                 0, 0, reduced->width(), reduced->height(),
+                                 0, 0, w, h);
+          image = reduced;
+        }
+
         cel = std::make_shared<Cel>(frame, image);
         cel->setPosition(x, y);
         cel->setOpacity(opacity);
@@ -1246,34 +1572,32 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
       int h = fgetw(f);
 
       if (w > 0 && h > 0) {
-        ImageRef image(Image::create(pixelFormat, w, h));
-
-        // Try to read pixel data
-        try {
-          switch (image->pixelFormat()) {
-
-            case IMAGE_RGB:
-              read_compressed_image<RgbTraits>(f, image.get(), chunk_end, fop, header);
-              break;
-
-            case IMAGE_GRAYSCALE:
-              read_compressed_image<GrayscaleTraits>(f, image.get(), chunk_end, fop, header);
-              break;
-
-            case IMAGE_INDEXED:
-              read_compressed_image<IndexedTraits>(f, image.get(), chunk_end, fop, header);
-              break;
-          }
-        }
-        // OK, in case of error we can show the problem, but continue
-        // loading more cels.
-        catch (const std::exception& e) {
-          fop->setError(e.what());
-        }
+        ImageRef image(Image::create(pixelFormat,
+                                     ase_reduced_size(w, scale),
+                                     ase_reduced_size(h, scale)));
 
         cel = std::make_shared<Cel>(frame, image);
         cel->setPosition(x, y);
         cel->setOpacity(opacity);
+
+        // Pixel data will be decoded in the second pass (see
+        // ase_file_read_compressed_cels()), or when the image is used
+        // for the first time in lazy mode.
+        long offset = ftell(f);
+        if (offset < long(chunk_end)) {
+          if (lazy) {
+            std::vector<uint8_t> compressed(chunk_end - offset);
+            if (fread(&compressed[0], 1, compressed.size(), f) != compressed.size()) {
+              fop->setError("Error reading compressed cel pixels.\n");
+              return nullptr;
+            }
+            cel->data()->setImageLoader(
+              std::make_shared<AseLazyCelLoader>(std::move(compressed)));
+          }
+          else
+            compressedCels.push_back({ image, offset, chunk_end - offset,
+                                       gfx::Size(w, h) });
+        }
       }
       break;
     }
@@ -1286,8 +1610,59 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
   return cel.get();
 }
 
+static void ase_file_read_compressed_cels(FILE* f,
+                                         std::vector<ASE_CompressedCel>& compressedCels,
+                                         int scale,
+                                         FileOp* fop)
+{
+  if (compressedCels.empty())
+    return;
+
+  // Reading the file is serialized, but each cel is inflated/decoded
+  // in its own worker thread.
+  std::mutex fileMutex;
+  std::atomic<size_t> decoded(0);
+  base::thread_pool pool(std::min(compressedCels.size(),
+                                  base::thread_pool::default_size()));
+
+  base::parallel_for(
+    pool, compressedCels.size(),
+    [&](size_t i) {
+      if (fop->isStop())
+        return;
+
+      ASE_CompressedCel& compressedCel = compressedCels[i];
+      std::vector<uint8_t> compressed(compressedCel.size);
+      {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        if (fseek(f, compressedCel.offset, SEEK_SET) != 0 ||
+            fread(&compressed[0], 1, compressed.size(), f) != compressed.size()) {
+          fop->setError("Error reading compressed cel pixels.\n");
+          return;
+        }
+      }
+
+      // In case of error we can show the problem, but continue
+      // loading more cels.
+      try {
+        if (scale > 1)
+          decompress_image_reduced(compressed, compressedCel.image.get(),
+                                   compressedCel.imageSize, scale);
+        else
+          decompress_image(compressed, compressedCel.image.get());
+      }
+      catch (const std::exception& e) {
+        fop->setError(e.what());
+      }
+
+      fop->setProgress(ASE_FIRST_PASS_PROGRESS +
+                       (1.0 - ASE_FIRST_PASS_PROGRESS) * (++decoded) / compressedCels.size());
+    });
+}
+
 static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header,
-                                     const Cel* cel, const LayerImage* layer, const Sprite* sprite)
+                                     const Cel* cel, const LayerImage* layer, const Sprite* sprite,
+                                     ASE_CompressingCels& cels)
 {
   ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_CEL);
 
@@ -1349,20 +1724,16 @@ static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header,
         fputw(image->width(), f);
         fputw(image->height(), f);
 
-        // Pixel data
-        switch (image->pixelFormat()) {
-
-          case IMAGE_RGB:
-            write_compressed_image<RgbTraits>(f, image);
-            break;
+        // Pixel data (compressed in a worker thread)
+        auto it = cels.find(cel);
+        ASSERT(it != cels.end());
+        if (it != cels.end()) {
+          std::vector<uint8_t> compressed = it->second.get();
+          cels.erase(it);
 
-          case IMAGE_GRAYSCALE:
-            write_compressed_image<GrayscaleTraits>(f, image);
-            break;
-
-          case IMAGE_INDEXED:
-            write_compressed_image<IndexedTraits>(f, image);
-            break;
+          if ((fwrite(compressed.data(), 1, compressed.size(), f) != compressed.size())
+              || ferror(f))
+            throw base::Exception("Error writing compressed image pixels.\n");
         }
       }
       else {
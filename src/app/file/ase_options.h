@@ -0,0 +1,44 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#pragma once
+
+#include "app/file/format_options.h"
+
+#include <string>
+
+namespace app {
+
+  // Data for .ase files
+  class AseOptions : public FormatOptions {
+  public:
+    enum class Compression { Fast, Default, Max };
+
+    AseOptions()
+      : m_compression(defaultCompression()) {
+    }
+
+    Compression compression() const { return m_compression; }
+    void setCompression(Compression compression) { m_compression = compression; }
+
+    // zlib level to compress cels
+    int zlibLevel() const;
+
+    // Default compression used in non-interactive mode (it can be
+    // changed with the --ase-compression command line option).
+    static Compression defaultCompression();
+    static void setDefaultCompression(Compression compression);
+
+    // Converts "fast", "default", or "max" to a Compression value,
+    // returns false if the string is not valid.
+    static bool parseCompression(const std::string& str, Compression& compression);
+
+  private:
+    Compression m_compression;
+  };
+
+} // namespace app
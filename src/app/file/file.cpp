@@ -11,9 +11,11 @@
 
 #include "app/file/file.h"
 
+#include "app/app.h"
 #include "app/console.h"
 #include "app/context.h"
 #include "app/document.h"
+#include "app/export_cache.h"
 #include "app/file/file_format.h"
 #include "app/file/file_formats_manager.h"
 #include "app/file/format_options.h"
@@ -22,19 +24,24 @@
 #include "app/modules/gui.h"
 #include "app/modules/palettes.h"
 #include "app/ui/status_bar.h"
+#include "base/convert_to.h"
 #include "base/fs.h"
 #include "base/mutex.h"
 #include "base/path.h"
+#include "base/replace_string.h"
 #include "base/scoped_lock.h"
 #include "base/shared_ptr.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
 #include "doc/doc.h"
 #include "render/quantization.h"
 #include "render/render.h"
 #include "ui/alert.h"
 
+#include <algorithm>
 #include <cstring>
 #include <cstdarg>
+#include <memory>
 #include <string_view>
 
 namespace app {
@@ -119,6 +126,22 @@ int save_document(Context* context, doc::Document* document)
   return (!fop->hasError() ? 0: -1);
 }
 
+ImageStreamWriter* create_image_stream_writer(const std::string& filename,
+                                              PixelFormat pixelFormat,
+                                              int width, int height,
+                                              const Palette* palette,
+                                              int transparentIndex)
+{
+  std::string extension = base::get_file_extension(filename);
+  FileFormat* format =
+    FileFormatsManager::instance()->getFileFormatByExtension(extension.c_str());
+  if (!format || !format->support(FILE_SUPPORT_SAVE))
+    return nullptr;
+
+  return format->createStreamWriter(filename, pixelFormat, width, height,
+                                    palette, transparentIndex);
+}
+
 // static
 FileOp* FileOp::createLoadDocumentOperation(Context* context, const char* filename, int flags)
 {
@@ -135,34 +158,14 @@ FileOp* FileOp::createLoadDocumentOperation(Context* context, const char* filena
   /* prepare to load a sequence */
 
   if (fop->m_seq.filename_list.empty()) {
-    /* per now, we want load just one file */
-    fop->m_seq.filename_list.push_back(fop->m_filename);
-
     /* don't load the sequence (just the one file/one frame) */
-    if (!(fop->m_loadFlags & FILE_LOAD_SEQUENCE_NONE)) {
-      std::string left, right;
-      int c, width, start_from;
-      char buf[512];
-
+    if (fop->m_loadFlags & FILE_LOAD_SEQUENCE_NONE) {
+      fop->m_seq.filename_list.push_back(fop->m_filename);
+    }
+    else {
       /* first of all, we must generate the list of files to load in the
          sequence... */
-
-      // Check if this could be a sequence
-      start_from = app::split_filename(fop->m_filename.c_str(), left, right, width);
-      if (start_from >= 0) {
-        // Try to get more file names
-        for (c=start_from+1; ; c++) {
-          // Get the next file name
-          snprintf(buf, sizeof(buf), "%s%0*d%s", left.c_str(), width, c, right.c_str());
-
-          // If the file doesn't exist, we don't need more files to load
-          if (!base::is_file(buf))
-            break;
-
-          /* add this file name to the list */
-          fop->m_seq.filename_list.push_back(buf);
-        }
-      }
+      get_sequence_filenames(fop->m_filename, fop->m_seq.filename_list);
 
       /* TODO add a better dialog to edit file-names */
       if ((fop->m_loadFlags & FILE_LOAD_SEQUENCE_ASK) && fop->m_context && fop->m_context->isUIAvailable() && fop->m_seq.filename_list.size() > 1) {
@@ -186,10 +189,48 @@ FileOp* FileOp::createLoadDocumentOperation(Context* context, const char* filena
   if (fop->m_loadFlags & FILE_LOAD_ONE_FRAME)
     fop->m_oneframe = true;
 
+  // Decode images when they are used
+  if (fop->m_loadFlags & FILE_LOAD_LAZY)
+    fop->m_lazy = true;
+
+  // Use less memory for long animations
+  if (fop->m_loadFlags & FILE_LOAD_COMPACT)
+    fop->m_compact = true;
+
   return fop.release();
 }
 
 // static
+// Decodes the cel images that weren't used yet (if the document was
+// loaded lazily) and returns a list of the cels whose pixels couldn't
+// be loaded (one "<<- Layer, frame" line for each one).
+static std::string get_unloaded_cels(Sprite* sprite)
+{
+  const int kMaxListedCels = 10;
+  std::string list;
+  int count = 0;
+
+  for (auto cel : sprite->uniqueCels()) {
+    cel->image();
+    if (!cel->data()->imageLoadFailed())
+      continue;
+
+    if (++count <= kMaxListedCels) {
+      list += "<<- Layer \"";
+      list += cel->layer()->name();
+      list += "\", frame ";
+      list += base::convert_to<std::string>(int(cel->frame()+1));
+    }
+  }
+
+  if (count > kMaxListedCels) {
+    list += "<<- ";
+    list += base::convert_to<std::string>(count - kMaxListedCels);
+    list += " more cels";
+  }
+  return list;
+}
+
 FileOp* FileOp::createSaveDocumentOperation(const Context* context,
                                             const Document* document,
                                             const char* filename,
@@ -312,6 +353,25 @@ FileOp* FileOp::createSaveDocumentOperation(const Context* context,
     }
   }
 
+  // Cels with pixels that couldn't be decoded (e.g. damaged data in a
+  // file or backup loaded lazily) are saved empty
+  std::string unloadedCels = get_unloaded_cels(fop->m_document->sprite());
+  if (!unloadedCels.empty()) {
+    if (context && context->isUIAvailable()) {
+      int ret = ui::Alert::show("Warning<<The pixels of these cels couldn't be loaded:%s"
+                                "<<Do you want to save them as empty cels anyway?"
+                                "||&Yes||&No",
+                                unloadedCels.c_str());
+      if (ret != 1)
+        return nullptr;
+    }
+    else {
+      base::replace_string(unloadedCels, "<<", "\n");
+      Console().printf("Warning: the pixels of these cels couldn't be loaded, they are saved as empty cels:%s\n",
+                       unloadedCels.c_str());
+    }
+  }
+
   // Show the confirmation alert
   if (!warnings.empty()) {
     // Interative
@@ -446,7 +506,10 @@ bool FileOp::operateLoadTryFormat(IFileOpProgress* progress)
 {
   if (!isSequence() || !m_format->support(FILE_SUPPORT_SEQUENCES)) {
     // Direct load from one file.
-    return m_format->load(this);
+    if (m_previewSize > 0)
+      return m_format->loadPreview(this, m_previewSize);
+    else
+      return m_format->load(this);
   }
 
   // Load a sequence
@@ -478,13 +541,36 @@ bool FileOp::operateLoadTryFormat(IFileOpProgress* progress)
   m_seq.progress_offset = 0.0f;
   m_seq.progress_fraction = 1.0f / (double)frames;
 
+  // Files are decoded in parallel (each one with its own FileOp) if
+  // the format supports it, and then they are added in order.
+  std::unique_ptr<base::thread_pool> pool;
+  if (frames > 1 && m_format->support(FILE_SUPPORT_PARALLEL_SEQUENCES))
+    pool.reset(new base::thread_pool(
+                 std::min<std::size_t>(frames, base::thread_pool::default_size())));
+  std::vector<std::unique_ptr<FileOp>> batch;
+  std::size_t batchStart = 0;
+
   auto it = m_seq.filename_list.begin(),
     end = m_seq.filename_list.end();
   for (; it != end; ++it) {
+    if (isStop())
+      break;
+
     m_filename = it->c_str();
 
-    // Call the "load" procedure to read the first bitmap.
-    bool loadres = m_format->load(this);
+    bool loadres;
+    if (pool) {
+      std::size_t i = (it - m_seq.filename_list.begin());
+      if (i == batchStart + batch.size()) {
+        batchStart = i;
+        loadSequenceBatch(*pool, i, batch);
+      }
+      loadres = adoptSequenceFile(batch[i - batchStart].get());
+    }
+    else {
+      // Call the "load" procedure to read the first bitmap.
+      loadres = m_format->load(this);
+    }
     if (!loadres) {
       setError("Error loading frame %d from file \"%s\"\n", frame+1, m_filename.c_str());
     }
@@ -535,9 +621,15 @@ bool FileOp::operateLoadTryFormat(IFileOpProgress* progress)
 
     ++frame;
     m_seq.progress_offset += m_seq.progress_fraction;
+    if (pool)
+      setProgress(0.0);
   }
   m_filename = *m_seq.filename_list.begin();
 
+  // Documents of files that weren't added to the sequence
+  for (auto& fop : batch)
+    delete fop->releaseDocument();
+
   // Final setup
   if (m_document != NULL) {
     // Configure the layer as the 'Background'
@@ -635,34 +727,41 @@ void FileOp::operate(IFileOpProgress* progress)
 
       Sprite* sprite = m_document->sprite();
 
-      // Create a temporary bitmap
-      m_seq.image.reset(Image::create(sprite->pixelFormat(),
-          sprite->width(),
-          sprite->height()));
-
       m_seq.progress_offset = 0.0f;
       m_seq.progress_fraction = 1.0f / (double)sprite->totalFrames();
 
-      // For each frame in the sprite.
-      render::Render render;
-      for (frame_t frame(0); frame < sprite->totalFrames(); ++frame) {
-        // Draw the "frame" in "m_seq.image"
-        render.renderSprite(m_seq.image.get(), sprite, frame);
-
-        // Setup the palette.
-        sprite->palette(frame)->copyColorsTo(*m_seq.palette);
-
-        // Setup the filename to be used.
-        m_filename = m_seq.filename_list[frame];
+      // Encode several files at the same time if the format supports it
+      if (sprite->totalFrames() > 1 &&
+          m_format->support(FILE_SUPPORT_PARALLEL_SEQUENCES)) {
+        operateSaveParallelSequence();
+      }
+      else {
+        // Create a temporary bitmap
+        m_seq.image.reset(Image::create(sprite->pixelFormat(),
+                                        sprite->width(),
+                                        sprite->height()));
+
+        // For each frame in the sprite.
+        render::Render render;
+        for (frame_t frame(0); frame < sprite->totalFrames(); ++frame) {
+          // Draw the "frame" in "m_seq.image"
+          render.renderSprite(m_seq.image.get(), sprite, frame);
+
+          // Setup the palette.
+          sprite->palette(frame)->copyColorsTo(*m_seq.palette);
+
+          // Setup the filename to be used.
+          m_filename = m_seq.filename_list[frame];
+
+          // Call the "save" procedure... did it fail?
+          if (!saveSequenceImage(this)) {
+            setError("Error saving frame %d in the file \"%s\"\n",
+                     frame+1, m_filename.c_str());
+            break;
+          }
 
-        // Call the "save" procedure... did it fail?
-        if (!m_format->save(this)) {
-          setError("Error saving frame %d in the file \"%s\"\n",
-                   frame+1, m_filename.c_str());
-          break;
+          m_seq.progress_offset += m_seq.progress_fraction;
         }
-
-        m_seq.progress_offset += m_seq.progress_fraction;
       }
 
       m_filename = *m_seq.filename_list.begin();
@@ -677,6 +776,17 @@ void FileOp::operate(IFileOpProgress* progress)
       if (!m_format->save(this))
         setError("Error saving the sprite in the file \"%s\"\n",
                  m_filename.c_str());
+      else if (ExportCache* cache = ExportCache::instance())
+        cache->addOutput(m_filename);
+    }
+
+    if (hasError()) {
+      if (ExportCache* cache = ExportCache::instance())
+        cache->setFailed();
+
+      // The command line must return an error code
+      if (m_context && !m_context->isUIAvailable() && App::instance())
+        App::instance()->setFileOperationFailed();
     }
   }
 
@@ -811,11 +921,21 @@ void FileOp::sequenceGetAlpha(int index, int* a) const
 
 Image* FileOp::sequenceImage(PixelFormat pixelFormat, int w, int h)
 {
+  ImageRef image(Image::create(pixelFormat, w, h));
+  if (!setSequenceImage(image))
+    return nullptr;
+
+  return image.get();
+}
+
+bool FileOp::setSequenceImage(const ImageRef& image)
+{
+  PixelFormat pixelFormat = image->pixelFormat();
   Sprite* sprite;
 
-  // Create the image
+  // Create the sprite
   if (!m_document) {
-    sprite = new Sprite(pixelFormat, w, h, 256);
+    sprite = new Sprite(pixelFormat, image->width(), image->height(), 256);
     try {
       LayerImage* layer = new LayerImage(sprite);
 
@@ -835,19 +955,169 @@ Image* FileOp::sequenceImage(PixelFormat pixelFormat, int w, int h)
     sprite = m_document->sprite();
 
     if (sprite->pixelFormat() != pixelFormat)
-      return nullptr;
+      return false;
   }
 
   if (m_seq.last_cel) {
     setError("Error: called two times \"fop_sequence_image()\".\n");
-    return nullptr;
+    return false;
   }
 
-  // Create a bitmap
-  m_seq.image.reset(Image::create(pixelFormat, w, h));
+  m_seq.image = image;
   m_seq.last_cel = std::make_shared<Cel>(m_seq.frame++, ImageRef(nullptr));
+  return true;
+}
+
+// Creates a FileOp to load/save one file of this sequence in other
+// thread.
+FileOp* FileOp::createSequenceFileOp(const std::string& filename) const
+{
+  std::unique_ptr<FileOp> fop(new FileOp(m_type, m_context));
+  fop->m_loadFlags = m_loadFlags;
+  fop->m_format = m_format;
+  fop->m_filename = filename;
+  fop->m_oneframe = m_oneframe;
+  fop->m_lazy = m_lazy;
+  fop->m_compact = m_compact;
+  fop->m_seq.filename_list.push_back(filename);
+  fop->m_seq.palette = Palette::create(256);
+  fop->m_seq.palette->makeBlack();
+  fop->m_seq.has_alpha = false;
+  return fop.release();
+}
+
+// Decodes the next files of the sequence (starting from "first") in
+// parallel. The images are added to the sprite by adoptSequenceFile().
+void FileOp::loadSequenceBatch(base::thread_pool& pool,
+                               std::size_t first,
+                               std::vector<std::unique_ptr<FileOp>>& batch)
+{
+  for (auto& fop : batch)
+    delete fop->releaseDocument();
+  batch.clear();
+
+  std::size_t n = std::min(2*pool.size(), m_seq.filename_list.size() - first);
+  for (std::size_t i=0; i<n; ++i)
+    batch.emplace_back(createSequenceFileOp(m_seq.filename_list[first+i]));
+
+  std::vector<char> loaded(n, false);
+  try {
+    base::parallel_for(
+      pool, n,
+      [this, &batch, &loaded](std::size_t i){
+        if (!isStop())
+          loaded[i] = m_format->load(batch[i].get());
+      });
+  }
+  catch (...) {
+    for (auto& fop : batch)
+      delete fop->releaseDocument();
+    batch.clear();
+    throw;
+  }
 
-  return m_seq.image.get();
+  for (std::size_t i=0; i<n; ++i) {
+    if (!loaded[i] && !batch[i]->hasError())
+      batch[i]->setError("Error loading file\n");
+  }
+}
+
+// Adds the image loaded by a FileOp created with
+// createSequenceFileOp() as the next frame of this sequence.
+bool FileOp::adoptSequenceFile(FileOp* fop)
+{
+  std::unique_ptr<Document> doc(fop->releaseDocument());
+  if (fop->hasError()) {
+    setError("%s", fop->error().c_str());
+    return false;
+  }
+  if (!fop->m_seq.image || !setSequenceImage(fop->m_seq.image))
+    return false;
+
+  fop->m_seq.palette->copyColorsTo(*m_seq.palette);
+  if (fop->m_seq.has_alpha)
+    m_seq.has_alpha = true;
+  if (!m_seq.format_options)
+    m_seq.format_options = fop->m_seq.format_options;
+  return true;
+}
+
+// Saves the image of a frame of the sequence in fop->m_filename. The
+// file isn't written again if it has the same image (--export-cache).
+bool FileOp::saveSequenceImage(FileOp* fop) const
+{
+  ExportCache* cache = ExportCache::instance();
+  if (!cache)
+    return m_format->save(fop);
+
+  base::Sha1 hash = cache->imageHash(
+    fop->m_seq.image.get(),
+    fop->m_seq.palette.get(),
+    m_document->sprite()->transparentColor());
+
+  if (!cache->isOutputUpToDate(fop->m_filename, hash) &&
+      !m_format->save(fop))
+    return false;
+
+  cache->addOutput(fop->m_filename, hash);
+  return true;
+}
+
+// Renders and encodes several frames of the sequence at the same time.
+void FileOp::operateSaveParallelSequence()
+{
+  const Sprite* sprite = m_document->sprite();
+  const frame_t nframes = sprite->totalFrames();
+  base::thread_pool pool(
+    std::min<std::size_t>(nframes, base::thread_pool::default_size()));
+  const frame_t batchSize = frame_t(2*pool.size());
+
+  for (frame_t first(0); first < nframes && !isStop(); first += batchSize) {
+    const frame_t n = std::min(batchSize, nframes - first);
+    std::vector<std::unique_ptr<FileOp>> batch;
+    for (frame_t i(0); i<n; ++i) {
+      FileOp* fop = createSequenceFileOp(m_seq.filename_list[first+i]);
+      batch.emplace_back(fop);
+      fop->m_document = m_document;
+      fop->m_seq.format_options = m_seq.format_options;
+      sprite->palette(first+i)->copyColorsTo(*fop->m_seq.palette);
+    }
+
+    std::vector<char> saved(n, false);
+    base::parallel_for(
+      pool, n,
+      [this, sprite, first, &batch, &saved](std::size_t i){
+        if (isStop())
+          return;
+
+        FileOp* fop = batch[i].get();
+        fop->m_seq.image.reset(Image::create(sprite->pixelFormat(),
+                                             sprite->width(),
+                                             sprite->height()));
+        render::Render render;
+        render.renderSprite(fop->m_seq.image.get(), sprite, first+frame_t(i));
+
+        saved[i] = saveSequenceImage(fop);
+        fop->m_seq.image.reset();
+      });
+
+    for (frame_t i(0); i<n; ++i) {
+      FileOp* fop = batch[i].get();
+      fop->m_document = nullptr;   // The document isn't owned by fop
+
+      if (isStop())
+        continue;
+
+      if (!saved[i]) {
+        setError("%sError saving frame %d in the file \"%s\"\n",
+                 fop->error().c_str(), first+i+1, fop->filename().c_str());
+        return;
+      }
+    }
+
+    m_seq.progress_offset += n*m_seq.progress_fraction;
+    setProgress(0.0);
+  }
 }
 
 void FileOp::setError(const char *format, ...)
@@ -915,7 +1185,8 @@ bool FileOp::isStop() const
 }
 
 FileOp::FileOp(FileOpType type, Context* context)
-  : m_type(type)
+  : m_loadFlags(0)
+  , m_type(type)
   , m_format(nullptr)
   , m_context(context)
   , m_document(nullptr)
@@ -924,6 +1195,9 @@ FileOp::FileOp(FileOpType type, Context* context)
   , m_done(false)
   , m_stop(false)
   , m_oneframe(false)
+  , m_lazy(false)
+  , m_compact(false)
+  , m_previewSize(0)
 {
   m_seq.palette = nullptr;
   m_seq.image.reset();
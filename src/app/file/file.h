@@ -13,6 +13,8 @@
 #include "doc/image_ref.h"
 #include "doc/pixel_format.h"
 
+#include <cstddef>
+#include <memory>
 #include <stdio.h>
 #include <string>
 #include <vector>
@@ -21,6 +23,12 @@
 #define FILE_LOAD_SEQUENCE_ASK          0x00000002
 #define FILE_LOAD_SEQUENCE_YES          0x00000004
 #define FILE_LOAD_ONE_FRAME             0x00000008
+#define FILE_LOAD_LAZY                  0x00000010
+#define FILE_LOAD_COMPACT               0x00000020
+
+namespace base {
+  class thread_pool;
+}
 
 namespace doc {
   class Document;
@@ -40,6 +48,7 @@ namespace app {
   class Document;
   class FileFormat;
   class FormatOptions;
+  class ImageStreamWriter;
 
   using namespace doc;
 
@@ -66,6 +75,13 @@ namespace app {
 
     bool isSequence() const { return !m_seq.filename_list.empty(); }
     bool isOneFrame() const { return m_oneframe; }
+    bool isLazy() const { return m_lazy; }
+    bool isCompact() const { return m_compact; }
+
+    // Loads a preview of the file (see FileFormat::loadPreview()),
+    // 0 means that the whole file is loaded.
+    int previewSize() const { return m_previewSize; }
+    void setPreviewSize(int maxSize) { m_previewSize = maxSize; }
 
     const std::string& filename() const { return m_filename; }
     Context* context() const { return m_context; }
@@ -136,6 +152,12 @@ namespace app {
     bool m_oneframe;            // Load just one frame (in formats
                                 // that support animation like
                                 // GIF/FLI/ASE).
+    bool m_lazy;                // Decode cel images on demand (in
+                                // formats that support it like ASE).
+    bool m_compact;             // Crop cels to their content and link
+                                // identical consecutive frames (in
+                                // formats that support it like GIF).
+    int m_previewSize;          // Max size of the preview to load.
 
     // Data for sequences.
     struct {
@@ -156,6 +178,14 @@ namespace app {
     void prepareForSequence();
     void operateLoad(IFileOpProgress* progress);
     bool operateLoadTryFormat(IFileOpProgress* progress);
+    bool setSequenceImage(const ImageRef& image);
+    FileOp* createSequenceFileOp(const std::string& filename) const;
+    void loadSequenceBatch(base::thread_pool& pool,
+                           std::size_t first,
+                           std::vector<std::unique_ptr<FileOp>>& batch);
+    bool adoptSequenceFile(FileOp* fop);
+    bool saveSequenceImage(FileOp* fop) const;
+    void operateSaveParallelSequence();
   };
 
   // Available extensions for each load/save operation.
@@ -168,4 +198,13 @@ namespace app {
   app::Document* load_document(Context* context, const char* filename);
   int save_document(Context* context, doc::Document* document);
 
+  // Creates a writer to save an image row by row in the given file
+  // (see FileFormat::createStreamWriter()). Returns nullptr if the
+  // format of the file (given by its extension) doesn't support it.
+  ImageStreamWriter* create_image_stream_writer(const std::string& filename,
+                                                PixelFormat pixelFormat,
+                                                int width, int height,
+                                                const Palette* palette,
+                                                int transparentIndex);
+
 } // namespace app
@@ -40,6 +40,12 @@ bool FileFormat::load(FileOp* fop)
   return onLoad(fop);
 }
 
+bool FileFormat::loadPreview(FileOp* fop, int maxSize)
+{
+  ASSERT(support(FILE_SUPPORT_LOAD));
+  return onLoadPreview(fop, maxSize);
+}
+
 bool FileFormat::save(FileOp* fop)
 {
   ASSERT(support(FILE_SUPPORT_SAVE));
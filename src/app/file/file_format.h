@@ -9,7 +9,9 @@
 
 #include "base/injection.h"
 #include "base/shared_ptr.h"
+#include "doc/pixel_format.h"
 
+#include <string>
 #include <vector>
 
 #define FILE_SUPPORT_LOAD               0x00000001
@@ -27,12 +29,18 @@
 #define FILE_SUPPORT_FRAME_TAGS         0x00001000
 #define FILE_SUPPORT_BIG_PALETTES       0x00002000 // Palettes w/more than 256 colors
 #define FILE_SUPPORT_PALETTE_WITH_ALPHA 0x00004000
+#define FILE_SUPPORT_PARALLEL_SEQUENCES 0x00008000 // Files of a sequence can be loaded/saved in parallel
+
+namespace doc {
+  class Palette;
+}
 
 namespace app {
 
   class FormatOptions;
   class FileFormat;
   class FileOp;
+  class ImageStreamWriter;
 
   // A file format supported by ASE. It is the base class to extend if
   // you want to add support to load and/or save a new kind of
@@ -47,6 +55,13 @@ namespace app {
     bool load(FileOp* fop);
     bool save(FileOp* fop);
 
+    // Loads a preview of the first frame (e.g. for thumbnails). The
+    // sprite can be reduced while it's decoded, but it will be at
+    // least "maxSize" pixels in its biggest dimension (if the
+    // original is bigger than that). Formats that cannot decode a
+    // reduced image load the whole sprite as load() does.
+    bool loadPreview(FileOp* fop, int maxSize);
+
     // Does post-load operation which require user intervention.
     // Returns false cancelled the operation.
     bool postLoad(FileOp* fop);
@@ -60,6 +75,19 @@ namespace app {
       return onGetFormatOptions(fop);
     }
 
+    // Creates a writer to save an image of the given size row by row
+    // in "filename" (see ImageStreamWriter). "palette" and
+    // "transparentIndex" are used for indexed images. Returns nullptr
+    // if this format cannot write images in that way.
+    ImageStreamWriter* createStreamWriter(const std::string& filename,
+                                          doc::PixelFormat pixelFormat,
+                                          int width, int height,
+                                          const doc::Palette* palette,
+                                          int transparentIndex) {
+      return onCreateStreamWriter(filename, pixelFormat, width, height,
+                                  palette, transparentIndex);
+    }
+
     // Returns true if this file format supports the given flag.
     bool support(int f) const {
       return ((onGetFlags() & f) == f);
@@ -74,6 +102,7 @@ namespace app {
     virtual int onGetFlags() const = 0;
 
     virtual bool onLoad(FileOp* fop) = 0;
+    virtual bool onLoadPreview(FileOp* fop, int maxSize) { return onLoad(fop); }
     virtual bool onPostLoad(FileOp* fop) { return true; }
     virtual bool onSave(FileOp* fop) = 0;
     virtual void onDestroyData(FileOp* fop) { }
@@ -82,6 +111,14 @@ namespace app {
       return base::SharedPtr<FormatOptions>(0);
     }
 
+    virtual ImageStreamWriter* onCreateStreamWriter(const std::string& filename,
+                                                    doc::PixelFormat pixelFormat,
+                                                    int width, int height,
+                                                    const doc::Palette* palette,
+                                                    int transparentIndex) {
+      return nullptr;
+    }
+
   };
 
 } // namespace app
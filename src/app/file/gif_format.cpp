@@ -21,6 +21,8 @@
 #include "app/util/autocrop.h"
 #include "base/file_handle.h"
 #include "base/fs.h"
+#include "base/thread_pool.h"
+#include "doc/algorithm/shrink_bounds.h"
 #include "doc/doc.h"
 #include "render/quantization.h"
 #include "render/render.h"
@@ -30,7 +32,14 @@
 #include "gif_options.xml.h"
 
 #include <gif_lib.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #ifdef _WIN32
   #include <io.h>
@@ -49,6 +58,11 @@
 // GifBitSize can return 9 (it's a bug in giflib)
 #define GifBitSizeLimited(v) (MIN(GifBitSize(v), 8))
 
+// Maximum memory (in bytes) and number of threads used to render and
+// quantize frames ahead while a GIF file is encoded.
+#define GIF_ENCODER_MEMORY_BUDGET  (256*1024*1024)
+#define GIF_ENCODER_MAX_THREADS    8
+
 namespace app {
 
 using namespace base;
@@ -611,12 +625,66 @@ private:
   }
 
   void createCel() {
+    if (m_fop->isCompact()) {
+      createCompactCel();
+      return;
+    }
+
     auto cel = std::make_shared<Cel>(m_frameNum, ImageRef(0));
     ImageRef celImage(Image::createCopy(m_currentImage.get()));
     cel->data()->setImage(celImage);
     m_layer->addCel(cel);
   }
 
+  // Creates a cel cropped to the visible content of the frame, or a
+  // link to the previous cel if the frame didn't change. So only
+  // m_currentImage/m_previousImage have the size of the whole canvas.
+  void createCompactCel() {
+    Image* image = m_currentImage.get();
+    gfx::Rect celBounds = m_spriteBounds;
+
+    // Opaque frames will be in the background layer, which cannot
+    // contain cropped cels.
+    if (!m_opaque &&
+        !doc::algorithm::shrink_bounds(image, celBounds, image->maskColor())) {
+      // Empty frame, we don't need a cel
+      m_lastCel.reset();
+      return;
+    }
+
+    if (m_lastCel && isSameImage(m_lastCel.get(), celBounds)) {
+      auto cel = Cel::createLink(m_lastCel);
+      cel->setFrame(m_frameNum);
+      m_layer->addCel(cel);
+      return;
+    }
+
+    auto cel = std::make_shared<Cel>(m_frameNum, ImageRef(0));
+    ImageRef celImage(crop_image(image, celBounds, image->maskColor()));
+    cel->data()->setImage(celImage);
+    cel->setPosition(celBounds.origin());
+    m_layer->addCel(cel);
+    m_lastCel = cel;
+  }
+
+  // Returns true if the given area of m_currentImage is equal to the
+  // image of the given cel.
+  bool isSameImage(const Cel* cel, const gfx::Rect& bounds) const {
+    const Image* image = cel->image();
+    if (cel->bounds() != bounds ||
+        image->pixelFormat() != m_currentImage->pixelFormat())
+      return false;
+
+    const int rowBytes = image->getRowStrideSize(bounds.w);
+    for (int y=0; y<bounds.h; ++y) {
+      if (std::memcmp(image->getPixelAddress(0, y),
+                      m_currentImage->getPixelAddress(bounds.x, bounds.y+y),
+                      rowBytes) != 0)
+        return false;
+    }
+    return true;
+  }
+
   void readExtensionRecord() {
     int extCode;
     GifByteType* extension;
@@ -756,6 +824,7 @@ private:
   int m_frameDelay;
   ImageRef m_currentImage;
   ImageRef m_previousImage;
+  std::shared_ptr<Cel> m_lastCel; // Last cel created in compact mode
   Remap m_remap;
   bool m_hasLocalColormaps;     // Indicates that this fila contains local colormaps
 
@@ -796,6 +865,42 @@ bool GifFormat::onLoad(FileOp* fop)
 }
 
 class GifEncoder {
+  // A frame in the encoding pipeline.
+  struct Frame {
+    enum State { Rendering, Rendered, Encoded };
+
+    State state = Rendering;
+    ImageRef image;             // Rendered frame (RGB)
+    gfx::Rect bounds;           // Area of "image" to be written
+    DisposalMethod disposal = DisposalMethod::NONE;
+    ImageRef indexedImage;      // "bounds" area of "image" as indexes
+    std::unique_ptr<Remap> remap;
+    ColorMapObject* localColormap = nullptr; // nullptr = global colormap
+    int localTransparent = -1;
+    std::exception_ptr exception;
+
+    ~Frame() {
+      releaseColormap();
+    }
+
+    void reset(const gfx::Size& size) {
+      if (!image)
+        image.reset(Image::create(IMAGE_RGB, size.w, size.h));
+      state = Rendering;
+      indexedImage.reset();
+      remap.reset();
+      releaseColormap();
+      exception = nullptr;
+    }
+
+    void releaseColormap() {
+      if (localColormap) {
+        GifFreeMapObject(localColormap);
+        localColormap = nullptr;
+      }
+    }
+  };
+
 public:
   GifEncoder(FileOp* fop, GifFileType* gifFile)
     : m_fop(fop)
@@ -856,8 +961,16 @@ public:
     m_interlaced = gifOptions->interlaced();
     m_loop = (gifOptions->loop() ? 0: -1);
 
-    for (int i=0; i<3; ++i)
-      m_images[i].reset(Image::create(IMAGE_RGB,
+    // Sprite::rgbMap() isn't thread-safe (it caches the last
+    // generated map), so we create our own map to be shared by all
+    // worker threads.
+    if (m_globalColormap) {
+      m_globalRgbMap.reset(new RgbMap);
+      m_globalRgbMap->regenerate(m_sprite->palette(0), m_transparentIndex);
+    }
+
+    for (int i=0; i<2; ++i)
+      m_canvas[i].reset(Image::create(IMAGE_RGB,
                                       m_spriteBounds.w,
                                       m_spriteBounds.h));
   }
@@ -867,46 +980,102 @@ public:
       GifFreeMapObject(m_globalColormap);
   }
 
+  // Frames are encoded in a pipeline: worker threads render frames
+  // and quantize them ahead of time, while this thread calculates
+  // the best disposal method of each frame (it depends on the result
+  // of the previous frame) and writes the frames in order.
   bool encode() {
     writeHeader();
     if (m_loop >= 0)
       writeLoopExtension();
 
-    // Previous and next images are used to decide the best disposal
-    // method (e.g. if it's more convenient to restore the background
-    // color or to restore the previous frame to reach the next one).
-    m_previousImage = m_images[0].get();
-    m_currentImage = m_images[1].get();
-    m_nextImage = m_images[2].get();
-
-    int nframes = m_sprite->totalFrames();
+    const int nframes = m_sprite->totalFrames();
+
+    // Each slot keeps a full RGB frame and its indexed copy, so the
+    // number of threads is limited by the memory budget too (there
+    // are always two slots more than threads).
+    const std::size_t frameBytes =
+      std::max<std::size_t>(1, std::size_t(m_spriteBounds.w) * m_spriteBounds.h * 5);
+    const std::size_t maxSlots = GIF_ENCODER_MEMORY_BUDGET / frameBytes;
+    std::size_t threads = std::min<std::size_t>(
+      std::min<std::size_t>(nframes, GIF_ENCODER_MAX_THREADS),
+      base::thread_pool::default_size());
+    threads = std::max<std::size_t>(
+      1, std::min(threads, maxSlots > 2 ? maxSlots - 2: 0));
+
+    // "frames" must be destroyed after "pool" (which waits the
+    // running jobs).
+    std::vector<Frame> frames(threads + 2);
+    base::thread_pool pool(threads);
+    auto slot = [&frames](int frameNum) -> Frame& {
+      return frames[frameNum % frames.size()];
+    };
+
+    int rendered = 0;           // Next frame to render
+    int analyzed = 0;           // Next frame to calculate its bounds
     for (int frameNum=0; frameNum<nframes; ++frameNum) {
-      if (frameNum == 0)
-        renderFrame(0, m_nextImage);
-      else if (frameNum > 0)
-        std::swap(m_previousImage, m_currentImage);
-
-      std::swap(m_currentImage, m_nextImage);
-      if (frameNum+1 < nframes)
-        renderFrame(frameNum+1, m_nextImage);
+      // Render frames ahead (we can reuse the slots of frames that
+      // were already written)
+      for (; rendered < nframes &&
+             rendered < frameNum + int(frames.size()); ++rendered) {
+        Frame& frame = slot(rendered);
+        frame.reset(m_spriteBounds.size());
+        int n = rendered;
+        pool.execute([this, &frame, n]{
+          runStage(frame, Frame::Rendered, [this, &frame, n]{
+            renderFrame(n, frame.image.get());
+          });
+        });
+      }
 
-      gfx::Rect frameBounds;
-      DisposalMethod disposal;
-      calculateBestDisposalMethod(
-        frameNum, frameBounds, disposal);
+      // Calculate the bounds and disposal method of all frames that
+      // are already rendered (and the next one too), and start
+      // quantizing them.
+      for (; analyzed < nframes; ++analyzed) {
+        int next = analyzed+1;
+        if (analyzed > frameNum &&
+            (!isReady(slot(analyzed), Frame::Rendered) ||
+             (next < nframes && (next >= rendered ||
+                                 !isReady(slot(next), Frame::Rendered)))))
+          break;
 
-      // TODO We could join both frames in a longer one (with more duration)
-      if (frameBounds.isEmpty())
-        frameBounds = gfx::Rect(0, 0, 1, 1);
+        Frame& frame = slot(analyzed);
+        waitFrame(frame, Frame::Rendered);
+        Image* nextImage = nullptr;
+        if (next < nframes) {
+          waitFrame(slot(next), Frame::Rendered);
+          nextImage = slot(next).image.get();
+        }
 
-      writeImage(frameNum, frameBounds, disposal);
+        calculateBestDisposalMethod(analyzed, frame.image.get(), nextImage,
+                                    frame.bounds, frame.disposal);
+
+        // TODO We could join both frames in a longer one (with more duration)
+        if (frame.bounds.isEmpty())
+          frame.bounds = gfx::Rect(0, 0, 1, 1);
+
+        // Dispose/clear frame content to get the canvas that will
+        // be used to calculate the bounds of the next frame.
+        copy_image(m_canvas[1].get(), frame.image.get());
+        process_disposal_method(m_canvas[0].get(),
+                                m_canvas[1].get(),
+                                frame.disposal,
+                                frame.bounds,
+                                m_clearColor);
+        std::swap(m_canvas[0], m_canvas[1]);
+
+        int n = analyzed;
+        pool.execute([this, &frame, n]{
+          runStage(frame, Frame::Encoded, [this, &frame, n]{
+            encodeFrame(n, frame);
+          });
+        });
+      }
 
-      // Dispose/clear frame content
-      process_disposal_method(m_previousImage,
-                              m_currentImage,
-                              disposal,
-                              frameBounds,
-                              m_clearColor);
+      Frame& frame = slot(frameNum);
+      waitFrame(frame, Frame::Encoded);
+      writeFrame(frameNum, frame);
+      frame.releaseColormap();
 
       m_fop->setProgress(double(frameNum+1) / double(nframes));
     }
@@ -991,7 +1160,12 @@ private:
     return frameBounds;
   }
 
+  // Calculates the bounds of the given frame (compared with the
+  // canvas that resulted from the previous frame, and with the next
+  // frame), and the best disposal method.
   void calculateBestDisposalMethod(int frameNum,
+                                   Image* currentImage,
+                                   Image* nextImage,
                                    gfx::Rect& frameBounds,
                                    DisposalMethod& disposal) {
     if (m_hasBackground) {
@@ -1008,19 +1182,18 @@ private:
       gfx::Rect prev, next;
 
       if (frameNum-1 >= 0)
-        prev = calculateFrameBounds(m_currentImage, m_previousImage);
+        prev = calculateFrameBounds(currentImage, m_canvas[0].get());
 
-      if (!m_hasBackground &&
-          frameNum+1 < m_sprite->totalFrames())
-        next = calculateFrameBounds(m_currentImage, m_nextImage);
+      if (!m_hasBackground && nextImage)
+        next = calculateFrameBounds(currentImage, nextImage);
 
       frameBounds = prev.createUnion(next);
 
       // Special case were it's better to restore the previous frame
       // when we dispose the current one than clearing with the bg
       // color.
-      if (m_hasBackground && !prev.isEmpty()) {
-        gfx::Rect prevNext = calculateFrameBounds(m_previousImage, m_nextImage);
+      if (m_hasBackground && !prev.isEmpty() && nextImage) {
+        gfx::Rect prevNext = calculateFrameBounds(m_canvas[0].get(), nextImage);
         if (!prevNext.isEmpty() &&
             frameBounds.contains(prevNext) &&
             prevNext.w*prevNext.h < frameBounds.w*frameBounds.h) {
@@ -1035,15 +1208,20 @@ private:
     }
   }
 
-  void writeImage(int frameNum, const gfx::Rect& frameBounds, DisposalMethod disposal) {
+  // Converts the frame bounds area of the rendered frame to indexed
+  // colors, and creates the local colormap for it (if it's needed).
+  // Called from worker threads.
+  void encodeFrame(int frameNum, Frame& frame) {
+    const gfx::Rect& frameBounds = frame.bounds;
+    Image* image = frame.image.get();
     std::shared_ptr<Palette> framePaletteRef;
     std::unique_ptr<RgbMap> rgbmapRef;
     Palette* framePalette = m_sprite->palette(frameNum);
-    RgbMap* rgbmap = m_sprite->rgbMap(frameNum);
+    RgbMap* rgbmap = m_globalRgbMap.get();
 
     // Create optimized palette for RGB/Grayscale images
     if (m_quantizeColormaps) {
-      framePaletteRef = createOptimizedPalette(frameBounds);
+      framePaletteRef = createOptimizedPalette(image, frameBounds);
       framePalette = framePaletteRef.get();
 
       rgbmapRef.reset(new RgbMap);
@@ -1054,15 +1232,12 @@ private:
     // We will store the frameBounds pixels in frameImage, with the
     // indexes that must be stored in the GIF file for this specific
     // frame.
-    if (!m_frameImageBuf)
-      m_frameImageBuf.reset(new ImageBuffer);
-
-    ImageRef frameImage(Image::create(IMAGE_INDEXED,
-                                      frameBounds.w,
-                                      frameBounds.h,
-                                      m_frameImageBuf));
+    frame.indexedImage.reset(Image::create(IMAGE_INDEXED,
+                                           frameBounds.w,
+                                           frameBounds.h));
+    Image* frameImage = frame.indexedImage.get();
 
-    // Convert the frameBounds area of m_currentImage (RGB) to frameImage (Indexed)
+    // Convert the frameBounds area of image (RGB) to frameImage (Indexed)
     // bool needsTransparent = false;
     PalettePicks usedColors(framePalette->size());
 
@@ -1078,7 +1253,7 @@ private:
     }
 
     {
-      LockImageBits<RgbTraits> bits(m_currentImage, frameBounds);
+      LockImageBits<RgbTraits> bits(image, frameBounds);
       auto it = bits.begin();
       for (int y=0; y<frameBounds.h; ++y) {
         for (int x=0; x<frameBounds.w; ++x, ++it) {
@@ -1117,14 +1292,15 @@ private:
             usedColors.resize(i+1);
           usedColors[i] = true;
 
-          put_pixel_fast<IndexedTraits>(frameImage.get(), x, y, i);
+          put_pixel_fast<IndexedTraits>(frameImage, x, y, i);
         }
       }
     }
 
     int usedNColors = usedColors.picks();
 
-    Remap remap(256);
+    frame.remap.reset(new Remap(256));
+    Remap& remap = *frame.remap;
     for (int i=0; i<remap.size(); ++i)
       remap.map(i, i);
 
@@ -1150,15 +1326,25 @@ private:
     if (localTransparent >= 0 && m_transparentIndex != localTransparent)
       remap.map(m_transparentIndex, localTransparent);
 
+    frame.localColormap = (colormap != m_globalColormap ? colormap: nullptr);
+    frame.localTransparent = localTransparent;
+  }
+
+  // Writes the frame encoded by encodeFrame() in the GIF file.
+  void writeFrame(int frameNum, const Frame& frame) {
+    const gfx::Rect& frameBounds = frame.bounds;
+    const Image* frameImage = frame.indexedImage.get();
+    const Remap& remap = *frame.remap;
+
     // Write extension record.
-    writeExtension(frameNum, localTransparent, disposal);
+    writeExtension(frameNum, frame.localTransparent, frame.disposal);
 
     // Write the image record.
     if (EGifPutImageDesc(m_gifFile,
                          frameBounds.x, frameBounds.y,
                          frameBounds.w, frameBounds.h,
                          m_interlaced ? 1: 0,
-                         (colormap != m_globalColormap ? colormap: nullptr)) == GIF_ERROR) {
+                         frame.localColormap) == GIF_ERROR) {
       throw Exception("Error writing GIF frame %d.\n", (int)frameNum);
     }
 
@@ -1169,8 +1355,8 @@ private:
       // Need to perform 4 passes on the images.
       for (int i=0; i<4; ++i)
         for (int y=interlaced_offset[i]; y<frameBounds.h; y+=interlaced_jumps[i]) {
-          IndexedTraits::address_t addr =
-            (IndexedTraits::address_t)frameImage->getPixelAddress(0, y);
+          IndexedTraits::const_address_t addr =
+            (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
 
           for (int i=0; i<frameBounds.w; ++i, ++addr)
             scanline[i] = remap[*addr];
@@ -1182,8 +1368,8 @@ private:
     else {
       // Write all image scanlines (not interlaced in this case).
       for (int y=0; y<frameBounds.h; ++y) {
-        IndexedTraits::address_t addr =
-          (IndexedTraits::address_t)frameImage->getPixelAddress(0, y);
+        IndexedTraits::const_address_t addr =
+          (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
 
         for (int i=0; i<frameBounds.w; ++i, ++addr)
           scanline[i] = remap[*addr];
@@ -1192,16 +1378,14 @@ private:
           throw Exception("Error writing GIF image scanlines for frame %d.\n", (int)frameNum);
       }
     }
-
-    if (colormap && colormap != m_globalColormap)
-      GifFreeMapObject(colormap);
   }
 
-  std::shared_ptr<Palette> createOptimizedPalette(const gfx::Rect& frameBounds) {
+  std::shared_ptr<Palette> createOptimizedPalette(const Image* image,
+                                                  const gfx::Rect& frameBounds) {
     render::PaletteOptimizer optimizer;
 
     // Feed the palette optimizer with pixels inside frameBounds
-    for (const auto& color : LockImageBits<RgbTraits>(m_currentImage, frameBounds)) {
+    for (const auto& color : LockImageBits<RgbTraits>(image, frameBounds)) {
       if (rgba_geta(color) >= 128)
         optimizer.feedWithRgbaColor(
           rgba(rgba_getr(color),
@@ -1221,6 +1405,41 @@ private:
     render.renderSprite(dst, m_sprite, frameNum);
   }
 
+  // Runs one stage of the pipeline for the given frame in a worker
+  // thread, and wakes up the writer thread when it's done. Exceptions
+  // are re-thrown in the writer thread by waitFrame().
+  template<typename F>
+  void runStage(Frame& frame, Frame::State state, F f) {
+    std::exception_ptr ex;
+    try {
+      f();
+    }
+    catch (...) {
+      ex = std::current_exception();
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_frameMutex);
+      if (ex)
+        frame.exception = ex;
+      frame.state = state;
+    }
+    m_frameDone.notify_all();
+  }
+
+  bool isReady(const Frame& frame, Frame::State state) {
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    return (frame.state >= state || frame.exception);
+  }
+
+  void waitFrame(const Frame& frame, Frame::State state) {
+    std::unique_lock<std::mutex> lock(m_frameMutex);
+    m_frameDone.wait(lock, [&frame, state]{
+        return (frame.state >= state || frame.exception);
+      });
+    if (frame.exception)
+      std::rethrow_exception(frame.exception);
+  }
+
 private:
 
   static ColorMapObject* createColorMap(const Palette& palette) {
@@ -1255,11 +1474,12 @@ private:
   bool m_quantizeColormaps;
   bool m_interlaced;
   int m_loop;
-  ImageBufferPtr m_frameImageBuf;
-  ImageRef m_images[3];
-  Image* m_previousImage;
-  Image* m_currentImage;
-  Image* m_nextImage;
+  std::unique_ptr<RgbMap> m_globalRgbMap;
+  // Canvas that the GIF decoder will have after disposing the last
+  // analyzed frame (m_canvas[0]), and a temporary image.
+  ImageRef m_canvas[2];
+  std::mutex m_frameMutex;
+  std::condition_variable m_frameDone;
 };
 
 bool GifFormat::onSave(FileOp* fop)
@@ -1283,7 +1503,8 @@ bool GifFormat::onSave(FileOp* fop)
 base::SharedPtr<FormatOptions> GifFormat::onGetFormatOptions(FileOp* fop)
 {
   base::SharedPtr<GifOptions> gif_options;
-  if (fop->document()->getFormatOptions())
+  // The document can contain options from other format
+  if (dynamic_cast<GifOptions*>(fop->document()->getFormatOptions().get()))
     gif_options = base::SharedPtr<GifOptions>(fop->document()->getFormatOptions());
 
   if (!gif_options)
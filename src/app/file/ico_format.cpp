@@ -39,6 +39,7 @@ class IcoFormat : public FileFormat {
       FILE_SUPPORT_RGB |
       FILE_SUPPORT_GRAY |
       FILE_SUPPORT_SEQUENCES |
+      FILE_SUPPORT_PARALLEL_SEQUENCES |
       FILE_SUPPORT_INDEXED;
   }
 
@@ -0,0 +1,41 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#pragma once
+
+#include "base/disable_copying.h"
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+
+  // Writes an image file from top to bottom in strips of rows, so
+  // huge images (e.g. sprite sheets) can be saved without having the
+  // whole image in memory. Created by FileFormat::createStreamWriter().
+  //
+  // Member functions throw a base::Exception if there is an error
+  // writing the file.
+  class ImageStreamWriter {
+  public:
+    ImageStreamWriter() { }
+    virtual ~ImageStreamWriter() { }
+
+    // Writes the first "rows" rows of the given strip as the next rows
+    // of the image. The strip must have the same width and pixel
+    // format as the image.
+    virtual void writeRows(const doc::Image* strip, int rows) = 0;
+
+    // Finishes the file. It must be called after all rows were written.
+    virtual void close() = 0;
+
+  private:
+    DISABLE_COPYING(ImageStreamWriter);
+  };
+
+} // namespace app
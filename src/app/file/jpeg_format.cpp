@@ -50,13 +50,17 @@ class JpegFormat : public FileFormat {
       FILE_SUPPORT_RGB |
       FILE_SUPPORT_GRAY |
       FILE_SUPPORT_SEQUENCES |
+      FILE_SUPPORT_PARALLEL_SEQUENCES |
       FILE_SUPPORT_GET_FORMAT_OPTIONS;
   }
 
   bool onLoad(FileOp* fop) override;
+  bool onLoadPreview(FileOp* fop, int maxSize) override;
   bool onSave(FileOp* fop) override;
 
   base::SharedPtr<FormatOptions> onGetFormatOptions(FileOp* fop) override;
+
+  bool loadImage(FileOp* fop, int previewSize);
 };
 
 static FileFormat::Regular<JpegFormat> ff{"jpg"};
@@ -91,6 +95,16 @@ static void output_message(j_common_ptr cinfo)
 }
 
 bool JpegFormat::onLoad(FileOp* fop)
+{
+  return loadImage(fop, 0);
+}
+
+bool JpegFormat::onLoadPreview(FileOp* fop, int maxSize)
+{
+  return loadImage(fop, maxSize);
+}
+
+bool JpegFormat::loadImage(FileOp* fop, int previewSize)
 {
   struct jpeg_decompress_struct cinfo;
   struct error_mgr jerr;
@@ -128,6 +142,17 @@ bool JpegFormat::onLoad(FileOp* fop)
   else
     cinfo.out_color_space = JCS_RGB;
 
+  // Use the DCT scaling of libjpeg (1/2, 1/4, or 1/8) to decode a
+  // reduced preview directly.
+  if (previewSize > 0) {
+    JDIMENSION size = MAX(cinfo.image_width, cinfo.image_height);
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    while (cinfo.scale_denom < 8 &&
+           size / (cinfo.scale_denom*2) >= JDIMENSION(previewSize))
+      cinfo.scale_denom *= 2;
+  }
+
   // Start decompressor.
   jpeg_start_decompress(&cinfo);
 
@@ -345,7 +370,8 @@ bool JpegFormat::onSave(FileOp* fop)
 base::SharedPtr<FormatOptions> JpegFormat::onGetFormatOptions(FileOp* fop)
 {
   base::SharedPtr<JpegOptions> jpeg_options;
-  if (fop->document()->getFormatOptions())
+  // The document can contain options from other format
+  if (dynamic_cast<JpegOptions*>(fop->document()->getFormatOptions().get()))
     jpeg_options = base::SharedPtr<JpegOptions>(fop->document()->getFormatOptions());
 
   if (!jpeg_options)
@@ -32,7 +32,8 @@ class PcxFormat : public FileFormat {
       FILE_SUPPORT_RGB |
       FILE_SUPPORT_GRAY |
       FILE_SUPPORT_INDEXED |
-      FILE_SUPPORT_SEQUENCES;
+      FILE_SUPPORT_SEQUENCES |
+      FILE_SUPPORT_PARALLEL_SEQUENCES;
   }
 
   bool onLoad(FileOp* fop) override;
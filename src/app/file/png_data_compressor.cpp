@@ -0,0 +1,316 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/file/png_data_compressor.h"
+
+#include "base/exception.h"
+#include "doc/image.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "png.h"
+#include "zlib.h"
+
+// Approximated size (in bytes) of the filtered image data that is
+// compressed in each thread.
+#define PNG_BLOCK_SIZE          (256*1024)
+
+// Size of the deflate window. The last bytes of each block are used
+// as the dictionary of the next one, so the compression ratio is
+// almost the same as compressing the whole image in one thread.
+#define PNG_DICTIONARY_SIZE     32768
+
+namespace app {
+
+using namespace doc;
+
+void png_convert_row(const Image* image, int color_type, int y, uint8_t* dst_address)
+{
+  int x, width = image->width();
+
+  switch (color_type) {
+
+    case PNG_COLOR_TYPE_RGB_ALPHA: {
+      const uint32_t* src_address = (const uint32_t*)image->getPixelAddress(0, y);
+      for (x=0; x<width; x++) {
+        uint32_t c = *(src_address++);
+        *(dst_address++) = rgba_getr(c);
+        *(dst_address++) = rgba_getg(c);
+        *(dst_address++) = rgba_getb(c);
+        *(dst_address++) = rgba_geta(c);
+      }
+      break;
+    }
+
+    case PNG_COLOR_TYPE_RGB: {
+      const uint32_t* src_address = (const uint32_t*)image->getPixelAddress(0, y);
+      for (x=0; x<width; x++) {
+        uint32_t c = *(src_address++);
+        *(dst_address++) = rgba_getr(c);
+        *(dst_address++) = rgba_getg(c);
+        *(dst_address++) = rgba_getb(c);
+      }
+      break;
+    }
+
+    case PNG_COLOR_TYPE_GRAY_ALPHA: {
+      const uint16_t* src_address = (const uint16_t*)image->getPixelAddress(0, y);
+      for (x=0; x<width; x++) {
+        uint16_t c = *(src_address++);
+        *(dst_address++) = graya_getv(c);
+        *(dst_address++) = graya_geta(c);
+      }
+      break;
+    }
+
+    case PNG_COLOR_TYPE_GRAY: {
+      const uint16_t* src_address = (const uint16_t*)image->getPixelAddress(0, y);
+      for (x=0; x<width; x++)
+        *(dst_address++) = graya_getv(*(src_address++));
+      break;
+    }
+
+    case PNG_COLOR_TYPE_PALETTE: {
+      const uint8_t* src_address = (const uint8_t*)image->getPixelAddress(0, y);
+      std::copy(src_address, src_address+width, dst_address);
+      break;
+    }
+  }
+}
+
+static int png_paeth_predictor(int a, int b, int c)
+{
+  int p = a + b - c;
+  int pa = std::abs(p - a);
+  int pb = std::abs(p - b);
+  int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return a;
+  else if (pb <= pc)
+    return b;
+  else
+    return c;
+}
+
+// Filters the "row" (where "prev" is the previous unfiltered row, or
+// zeros for the first row) with the given PNG_FILTER_VALUE_* type.
+static void png_filter_row(int type, const uint8_t* row, const uint8_t* prev,
+                           size_t rowbytes, size_t bpp, uint8_t* dst)
+{
+  for (size_t i=0; i<rowbytes; ++i) {
+    int a = (i >= bpp ? row[i-bpp]: 0);
+    int b = prev[i];
+    int c = (i >= bpp ? prev[i-bpp]: 0);
+    int p = 0;
+    switch (type) {
+      case PNG_FILTER_VALUE_SUB: p = a; break;
+      case PNG_FILTER_VALUE_UP: p = b; break;
+      case PNG_FILTER_VALUE_AVG: p = (a + b) / 2; break;
+      case PNG_FILTER_VALUE_PAETH: p = png_paeth_predictor(a, b, c); break;
+    }
+    dst[i] = uint8_t(row[i] - p);
+  }
+}
+
+// Sum of absolute values of the filtered bytes (as signed bytes), the
+// heuristic used by libpng to choose a filter for each row.
+static size_t png_filter_cost(const uint8_t* filtered, size_t rowbytes)
+{
+  size_t cost = 0;
+  for (size_t i=0; i<rowbytes; ++i)
+    cost += std::abs(int(int8_t(filtered[i])));
+  return cost;
+}
+
+// Compresses "size" bytes of "data" as a raw deflate stream using
+// the "dictSize" bytes of "dict" (the bytes just before "data") as
+// dictionary. The stream is finished only if it's the "last" block,
+// in other case it ends with a sync flush so the next block can be
+// appended to it.
+static void png_deflate_block(const uint8_t* dict, size_t dictSize,
+                              const uint8_t* data, size_t size,
+                              int level, bool last, std::vector<uint8_t>& output)
+{
+  z_stream zstream;
+  zstream.zalloc = (alloc_func)0;
+  zstream.zfree  = (free_func)0;
+  zstream.opaque = (voidpf)0;
+
+  int err = deflateInit2(&zstream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+  if (err != Z_OK)
+    throw base::Exception("ZLib error %d in deflateInit2().", err);
+
+  if (dictSize > 0)
+    deflateSetDictionary(&zstream, (const Bytef*)dict, dictSize);
+
+  output.resize(deflateBound(&zstream, size) + 16);
+  zstream.next_in = (Bytef*)data;
+  zstream.avail_in = size;
+  zstream.next_out = (Bytef*)&output[0];
+  zstream.avail_out = output.size();
+
+  const int flush = (last ? Z_FINISH: Z_SYNC_FLUSH);
+  while (true) {
+    err = deflate(&zstream, flush);
+    if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR) {
+      deflateEnd(&zstream);
+      throw base::Exception("ZLib error %d in deflate().", err);
+    }
+    if (last ? err == Z_STREAM_END: zstream.avail_out > 0)
+      break;
+
+    // Grow the output buffer
+    size_t used = output.size() - zstream.avail_out;
+    output.resize(output.size() * 2);
+    zstream.next_out = (Bytef*)&output[used];
+    zstream.avail_out = output.size() - used;
+  }
+
+  output.resize(output.size() - zstream.avail_out);
+  deflateEnd(&zstream);
+}
+
+static size_t png_channels(int color_type)
+{
+  switch (color_type) {
+    case PNG_COLOR_TYPE_RGB_ALPHA: return 4;
+    case PNG_COLOR_TYPE_RGB: return 3;
+    case PNG_COLOR_TYPE_GRAY_ALPHA: return 2;
+    default: return 1;
+  }
+}
+
+PngDataCompressor::PngDataCompressor(const Image* image, int color_type,
+                                     PngOptions::Filter filter, int level)
+  : m_image(image)
+  , m_colorType(color_type)
+  , m_rowbytes(png_channels(color_type) * image->width())
+  , m_bpp(png_channels(color_type))
+  , m_stride(m_rowbytes + 1)
+  , m_filter(filter)
+  , m_level(level)
+  , m_rowsPerBlock(std::max<int>(1, PNG_BLOCK_SIZE / m_stride))
+  , m_nblocks((image->height() + m_rowsPerBlock - 1) / m_rowsPerBlock)
+  , m_nextBlock(0)
+  , m_adler(adler32(0, Z_NULL, 0))
+  , m_pool(std::min<size_t>(m_nblocks, base::thread_pool::default_size()))
+{
+  if (m_filter == PngOptions::Filter::Default)
+    m_filter = (color_type == PNG_COLOR_TYPE_PALETTE ?
+                PngOptions::Filter::None:
+                PngOptions::Filter::Adaptive);
+}
+
+const std::vector<std::vector<uint8_t>>& PngDataCompressor::compressNextBlocks()
+{
+  const int first = m_nextBlock;
+  const int count = std::min<int>(m_nblocks - first, int(m_pool.size()));
+  const bool lastBlocks = (first + count == m_nblocks);
+
+  m_data.resize(count);
+  m_output.resize(count);
+  std::vector<uLong> adlers(count);
+
+  // Convert and filter the rows of each block
+  base::parallel_for(m_pool, count, [this, first](size_t i){
+    filterBlock(first + int(i), m_data[i]);
+  });
+
+  // Compress each block using the end of the previous one as
+  // dictionary
+  base::parallel_for(m_pool, count, [this, count, lastBlocks, &adlers](size_t i){
+    const std::vector<uint8_t>& prev = (i > 0 ? m_data[i-1]: m_dictionary);
+    const size_t dictSize = std::min<size_t>(prev.size(), PNG_DICTIONARY_SIZE);
+    const std::vector<uint8_t>& data = m_data[i];
+
+    png_deflate_block(dictSize > 0 ? &prev[prev.size()-dictSize]: nullptr, dictSize,
+                      &data[0], data.size(), m_level,
+                      lastBlocks && int(i) == count-1, m_output[i]);
+    adlers[i] = adler32(adler32(0, Z_NULL, 0), &data[0], data.size());
+  });
+
+  for (int i=0; i<count; ++i)
+    m_adler = adler32_combine(m_adler, adlers[i], m_data[i].size());
+
+  // zlib header (deflate with 32K window, and the level in FLEVEL)
+  if (first == 0) {
+    const int flevel = (m_level < 0 ? 2:
+                        m_level < 2 ? 0:
+                        m_level < 6 ? 1:
+                        m_level == 6 ? 2: 3);
+    const uint8_t cmf = 0x78;
+    uint8_t flg = flevel << 6;
+    flg |= 31 - ((cmf << 8) + flg) % 31;
+    m_output.front().insert(m_output.front().begin(), { cmf, flg });
+  }
+
+  // zlib trailer (adler32 of the whole data)
+  if (lastBlocks) {
+    m_output.back().insert(m_output.back().end(), {
+        uint8_t((m_adler >> 24) & 0xff),
+        uint8_t((m_adler >> 16) & 0xff),
+        uint8_t((m_adler >> 8) & 0xff),
+        uint8_t(m_adler & 0xff) });
+  }
+
+  const std::vector<uint8_t>& last = m_data.back();
+  const size_t dictSize = std::min<size_t>(last.size(), PNG_DICTIONARY_SIZE);
+  m_dictionary.assign(last.end() - dictSize, last.end());
+
+  m_nextBlock += count;
+  return m_output;
+}
+
+void PngDataCompressor::filterBlock(int block, std::vector<uint8_t>& data) const
+{
+  const int y1 = block * m_rowsPerBlock;
+  const int y2 = std::min(m_image->height(), y1 + m_rowsPerBlock);
+  std::vector<uint8_t> prev(m_rowbytes, 0), row(m_rowbytes);
+  std::vector<uint8_t> candidate(m_rowbytes);
+  if (y1 > 0)
+    png_convert_row(m_image, m_colorType, y1-1, &prev[0]);
+
+  data.resize(m_stride * (y2 - y1));
+  for (int y=y1; y<y2; ++y) {
+    uint8_t* dst = &data[(y-y1)*m_stride];
+    png_convert_row(m_image, m_colorType, y, &row[0]);
+
+    if (m_filter == PngOptions::Filter::Adaptive) {
+      size_t bestCost = 0;
+      for (int type=PNG_FILTER_VALUE_NONE; type<=PNG_FILTER_VALUE_PAETH; ++type) {
+        png_filter_row(type, &row[0], &prev[0], m_rowbytes, m_bpp, &candidate[0]);
+        size_t cost = png_filter_cost(&candidate[0], m_rowbytes);
+        if (type == PNG_FILTER_VALUE_NONE || cost < bestCost) {
+          bestCost = cost;
+          dst[0] = type;
+          std::copy(candidate.begin(), candidate.end(), dst+1);
+        }
+      }
+    }
+    else {
+      int type = PNG_FILTER_VALUE_NONE;
+      switch (m_filter) {
+        case PngOptions::Filter::Sub: type = PNG_FILTER_VALUE_SUB; break;
+        case PngOptions::Filter::Up: type = PNG_FILTER_VALUE_UP; break;
+        case PngOptions::Filter::Average: type = PNG_FILTER_VALUE_AVG; break;
+        case PngOptions::Filter::Paeth: type = PNG_FILTER_VALUE_PAETH; break;
+        default: break;
+      }
+      dst[0] = type;
+      png_filter_row(type, &row[0], &prev[0], m_rowbytes, m_bpp, dst+1);
+    }
+
+    std::swap(prev, row);
+  }
+}
+
+} // namespace app
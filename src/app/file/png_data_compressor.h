@@ -0,0 +1,81 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#pragma once
+
+#include "app/file/png_options.h"
+#include "base/disable_copying.h"
+#include "base/thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+
+  // Converts the row "y" of the image to the pixel layout of the
+  // given PNG_COLOR_TYPE_* (8 bits per channel).
+  void png_convert_row(const doc::Image* image, int color_type, int y,
+                       uint8_t* dst_address);
+
+  // Creates the content of the IDAT chunks of a PNG image. Rows are
+  // converted/filtered and compressed in blocks, each block in its
+  // own thread, and all blocks form one zlib stream (the first block
+  // includes the zlib header and the last one the adler32 checksum).
+  //
+  // Only a few blocks (one for each thread) are in memory at the same
+  // time: each compressNextBlocks() call returns the IDAT chunks of
+  // the next blocks, so they can be written before compressing the
+  // rest of the image.
+  class PngDataCompressor {
+  public:
+    // The "level" is the zlib compression level (0-9, or -1 to use
+    // the zlib default).
+    PngDataCompressor(const doc::Image* image, int color_type,
+                      PngOptions::Filter filter, int level);
+
+    bool done() const { return m_nextBlock == m_nblocks; }
+
+    // Progress from 0.0 to 1.0 (compressed blocks)
+    double progress() const { return double(m_nextBlock) / m_nblocks; }
+
+    // Compresses the next blocks and returns the content of their
+    // IDAT chunks (valid until the next call).
+    const std::vector<std::vector<uint8_t>>& compressNextBlocks();
+
+  private:
+    void filterBlock(int block, std::vector<uint8_t>& data) const;
+
+    const doc::Image* m_image;
+    int m_colorType;
+    std::size_t m_rowbytes;
+    std::size_t m_bpp;
+    std::size_t m_stride;       // Filter type + filtered row
+    PngOptions::Filter m_filter;
+    int m_level;
+    int m_rowsPerBlock;
+    int m_nblocks;
+    int m_nextBlock;
+    unsigned long m_adler;      // adler32 of the compressed blocks
+    base::thread_pool m_pool;
+
+    // Filtered rows and compressed data of the current blocks
+    std::vector<std::vector<uint8_t>> m_data;
+    std::vector<std::vector<uint8_t>> m_output;
+
+    // Last filtered bytes of the previous blocks (deflate dictionary
+    // of the next block)
+    std::vector<uint8_t> m_dictionary;
+
+    DISABLE_COPYING(PngDataCompressor);
+  };
+
+} // namespace app
@@ -0,0 +1,193 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/test.h"
+
+#include "app/file/png_data_compressor.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "png.h"
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+  struct MemoryReader {
+    const std::vector<uint8_t>* data;
+    size_t pos;
+  };
+
+  void write_to_memory(png_structp png, png_bytep data, png_size_t size)
+  {
+    auto output = (std::vector<uint8_t>*)png_get_io_ptr(png);
+    output->insert(output->end(), data, data+size);
+  }
+
+  void flush_memory(png_structp png)
+  {
+  }
+
+  void read_from_memory(png_structp png, png_bytep data, png_size_t size)
+  {
+    auto reader = (MemoryReader*)png_get_io_ptr(png);
+    if (reader->pos + size > reader->data->size())
+      png_error(png, "Unexpected end of data");
+    std::memcpy(data, &(*reader->data)[reader->pos], size);
+    reader->pos += size;
+  }
+
+  // Writes a PNG file in memory with the IDAT chunks created by
+  // PngDataCompressor (as PngFormat::onSave() does)
+  std::vector<uint8_t> write_png(const Image* image, int color_type,
+                                 PngOptions::Filter filter, int level)
+  {
+    std::vector<uint8_t> output;
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png_create_info_struct(png);
+    if (setjmp(png_jmpbuf(png))) {
+      png_destroy_write_struct(&png, &info);
+      ADD_FAILURE() << "libpng error writing the file";
+      return std::vector<uint8_t>();
+    }
+
+    png_set_write_fn(png, &output, write_to_memory, flush_memory);
+    png_set_IHDR(png, info, image->width(), image->height(), 8, color_type,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+    if (color_type == PNG_COLOR_TYPE_PALETTE) {
+      std::vector<png_color> palette(256);
+      for (int i=0; i<256; ++i)
+        palette[i].red = palette[i].green = palette[i].blue = i;
+      png_set_PLTE(png, info, &palette[0], 256);
+    }
+    png_write_info(png, info);
+
+    PngDataCompressor compressor(image, color_type, filter, level);
+    while (!compressor.done()) {
+      for (const auto& data : compressor.compressNextBlocks())
+        png_write_chunk(png, (png_const_bytep)"IDAT", &data[0], data.size());
+    }
+    png_write_chunk(png, (png_const_bytep)"IEND", NULL, 0);
+
+    png_destroy_write_struct(&png, &info);
+    return output;
+  }
+
+  // Decodes the PNG file with libpng and compares its pixels with
+  // the original image
+  void expect_same_pixels(const std::vector<uint8_t>& data,
+                          const Image* image, int color_type)
+  {
+    ASSERT_FALSE(data.empty());
+
+    MemoryReader reader = { &data, 0 };
+    std::vector<std::vector<uint8_t>> rows;
+    std::vector<png_bytep> rowPointers;
+    bool ok = false;
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png_create_info_struct(png);
+    if (setjmp(png_jmpbuf(png))) {
+      png_destroy_read_struct(&png, &info, NULL);
+      FAIL() << "libpng error reading the file";
+    }
+
+    png_set_read_fn(png, &reader, read_from_memory);
+    png_read_info(png, info);
+    if (png_get_image_width(png, info) == png_uint_32(image->width()) &&
+        png_get_image_height(png, info) == png_uint_32(image->height()) &&
+        png_get_color_type(png, info) == color_type) {
+      rows.resize(image->height(), std::vector<uint8_t>(png_get_rowbytes(png, info)));
+      for (auto& row : rows)
+        rowPointers.push_back(&row[0]);
+      png_read_image(png, &rowPointers[0]);
+      png_read_end(png, NULL);
+      ok = true;
+    }
+    png_destroy_read_struct(&png, &info, NULL);
+    ASSERT_TRUE(ok);
+
+    std::vector<uint8_t> expected(rows[0].size());
+    for (int y=0; y<image->height(); ++y) {
+      png_convert_row(image, color_type, y, &expected[0]);
+      ASSERT_EQ(expected, rows[y]) << "Row " << y;
+    }
+  }
+
+  // Image with a gradient and some noise, so each filter chooses
+  // different values
+  Image* create_test_image(PixelFormat format, int w, int h)
+  {
+    Image* image = Image::create(format, w, h);
+    unsigned int seed = 1;
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        seed = seed * 1103515245 + 12345;
+        int noise = (seed >> 16) & 15;
+        if (format == IMAGE_RGB)
+          put_pixel(image, x, y, rgba((x+noise) & 255, (y+noise) & 255,
+                                      (x+y) & 255, (x*y+noise) & 255));
+        else
+          put_pixel(image, x, y, (x+y+noise) & 255);
+      }
+    }
+    return image;
+  }
+
+} // anonymous namespace
+
+TEST(PngDataCompressor, RoundTripFiltersAndLevels)
+{
+  const PngOptions::Filter filters[] = {
+    PngOptions::Filter::Default,
+    PngOptions::Filter::None,
+    PngOptions::Filter::Sub,
+    PngOptions::Filter::Up,
+    PngOptions::Filter::Average,
+    PngOptions::Filter::Paeth,
+    PngOptions::Filter::Adaptive
+  };
+  const int levels[] = { -1, 0, 1, 6, 9 };
+
+  std::unique_ptr<Image> rgb(create_test_image(IMAGE_RGB, 37, 61));
+  std::unique_ptr<Image> indexed(create_test_image(IMAGE_INDEXED, 37, 61));
+
+  for (auto filter : filters) {
+    for (int level : levels) {
+      SCOPED_TRACE(testing::Message() << "Filter " << int(filter) << " level " << level);
+      expect_same_pixels(write_png(rgb.get(), PNG_COLOR_TYPE_RGB_ALPHA, filter, level),
+                         rgb.get(), PNG_COLOR_TYPE_RGB_ALPHA);
+      expect_same_pixels(write_png(rgb.get(), PNG_COLOR_TYPE_RGB, filter, level),
+                         rgb.get(), PNG_COLOR_TYPE_RGB);
+      expect_same_pixels(write_png(indexed.get(), PNG_COLOR_TYPE_PALETTE, filter, level),
+                         indexed.get(), PNG_COLOR_TYPE_PALETTE);
+    }
+  }
+}
+
+// A big image is compressed in several calls to compressNextBlocks()
+// (each one with several blocks), and all of them must form only one
+// zlib stream.
+TEST(PngDataCompressor, SeveralGroupsOfBlocks)
+{
+  std::unique_ptr<Image> image(create_test_image(IMAGE_RGB, 256, 4096));
+
+  for (auto filter : { PngOptions::Filter::None, PngOptions::Filter::Adaptive }) {
+    PngDataCompressor compressor(image.get(), PNG_COLOR_TYPE_RGB_ALPHA, filter, 6);
+    while (!compressor.done())
+      compressor.compressNextBlocks();
+    EXPECT_EQ(1.0, compressor.progress());
+
+    expect_same_pixels(write_png(image.get(), PNG_COLOR_TYPE_RGB_ALPHA, filter, 6),
+                       image.get(), PNG_COLOR_TYPE_RGB_ALPHA);
+  }
+}
@@ -10,18 +10,28 @@
 #endif
 
 #include "app/app.h"
+#include "app/context.h"
 #include "app/document.h"
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
+#include "app/file/image_stream_writer.h"
+#include "app/file/png_data_compressor.h"
+#include "app/file/png_options.h"
 #include "app/ini_file.h"
+#include "base/exception.h"
 #include "base/file_handle.h"
 #include "doc/doc.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <memory>
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 
 #include "png.h"
+#include "zlib.h"
 
 namespace app {
 
@@ -41,15 +51,73 @@ class PngFormat : public FileFormat {
       FILE_SUPPORT_GRAYA |
       FILE_SUPPORT_INDEXED |
       FILE_SUPPORT_SEQUENCES |
+      FILE_SUPPORT_PARALLEL_SEQUENCES |
+      FILE_SUPPORT_GET_FORMAT_OPTIONS |
       FILE_SUPPORT_PALETTE_WITH_ALPHA;
   }
 
   bool onLoad(FileOp* fop) override;
   bool onSave(FileOp* fop) override;
+  base::SharedPtr<FormatOptions> onGetFormatOptions(FileOp* fop) override;
+  ImageStreamWriter* onCreateStreamWriter(const std::string& filename,
+                                          PixelFormat pixelFormat,
+                                          int width, int height,
+                                          const Palette* palette,
+                                          int transparentIndex) override;
 };
 
 static FileFormat::Regular<PngFormat> ff{"png"};
 
+static int default_compression_level = Z_DEFAULT_COMPRESSION;
+static PngOptions::Filter default_filter = PngOptions::Filter::Default;
+
+// static
+int PngOptions::defaultCompressionLevel()
+{
+  return default_compression_level;
+}
+
+// static
+void PngOptions::setDefaultCompressionLevel(int level)
+{
+  default_compression_level = level;
+}
+
+// static
+PngOptions::Filter PngOptions::defaultFilter()
+{
+  return default_filter;
+}
+
+// static
+void PngOptions::setDefaultFilter(Filter filter)
+{
+  default_filter = filter;
+}
+
+// static
+bool PngOptions::parseCompressionLevel(const std::string& str, int& level)
+{
+  if (str.size() != 1 || str[0] < '0' || str[0] > '9')
+    return false;
+  level = str[0] - '0';
+  return true;
+}
+
+// static
+bool PngOptions::parseFilter(const std::string& str, Filter& filter)
+{
+  if (str == "none") filter = Filter::None;
+  else if (str == "sub") filter = Filter::Sub;
+  else if (str == "up") filter = Filter::Up;
+  else if (str == "average") filter = Filter::Average;
+  else if (str == "paeth") filter = Filter::Paeth;
+  else if (str == "adaptive") filter = Filter::Adaptive;
+  else
+    return false;
+  return true;
+}
+
 static void report_png_error(png_structp png_ptr, png_const_charp error)
 {
   ((FileOp*)png_get_error_ptr(png_ptr))->setError("libpng: %s\n", error);
@@ -337,13 +405,14 @@ bool PngFormat::onLoad(FileOp* fop)
 bool PngFormat::onSave(FileOp* fop)
 {
   const Image* image = fop->sequenceImage();
-  png_uint_32 width, height, y;
+  png_uint_32 width, height;
   png_structp png_ptr;
   png_infop info_ptr;
   png_colorp palette = NULL;
-  png_bytep row_pointer;
   int color_type = 0;
-  int pass, number_passes;
+  // Declared before setjmp() to be destroyed correctly in case of error
+  base::SharedPtr<PngOptions> png_options;
+  std::unique_ptr<PngDataCompressor> compressor;
 
   /* open the file */
   FileHandle handle(open_file_with_exception(fop->filename(), "wb"));
@@ -454,93 +523,34 @@ bool PngFormat::onSave(FileOp* fop)
   /* Write the file header information. */
   png_write_info(png_ptr, info_ptr);
 
-  /* pack pixels into bytes */
-  png_set_packing(png_ptr);
-
-  /* non-interlaced */
-  number_passes = 1;
-
-  row_pointer = (png_bytep)png_malloc(png_ptr, png_get_rowbytes(png_ptr, info_ptr));
-
-  /* The number of passes is either 1 for non-interlaced images,
-   * or 7 for interlaced images.
-   */
-  for (pass = 0; pass < number_passes; pass++) {
-    /* If you are only writing one row at a time, this works */
-    for (y = 0; y < height; y++) {
-      /* RGB_ALPHA */
-      if (png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_RGB_ALPHA) {
-        uint32_t* src_address = (uint32_t*)image->getPixelAddress(0, y);
-        uint8_t* dst_address = row_pointer;
-        unsigned int x, c;
-
-        for (x=0; x<width; x++) {
-          c = *(src_address++);
-          *(dst_address++) = rgba_getr(c);
-          *(dst_address++) = rgba_getg(c);
-          *(dst_address++) = rgba_getb(c);
-          *(dst_address++) = rgba_geta(c);
-        }
-      }
-      /* RGB */
-      else if (png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_RGB) {
-        uint32_t* src_address = (uint32_t*)image->getPixelAddress(0, y);
-        uint8_t* dst_address = row_pointer;
-        unsigned int x, c;
-
-        for (x=0; x<width; x++) {
-          c = *(src_address++);
-          *(dst_address++) = rgba_getr(c);
-          *(dst_address++) = rgba_getg(c);
-          *(dst_address++) = rgba_getb(c);
-        }
-      }
-      /* GRAY_ALPHA */
-      else if (png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_GRAY_ALPHA) {
-        uint16_t* src_address = (uint16_t*)image->getPixelAddress(0, y);
-        uint8_t* dst_address = row_pointer;
-        unsigned int x, c;
-
-        for (x=0; x<width; x++) {
-          c = *(src_address++);
-          *(dst_address++) = graya_getv(c);
-          *(dst_address++) = graya_geta(c);
-        }
-      }
-      /* GRAY */
-      else if (png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_GRAY) {
-        uint16_t* src_address = (uint16_t*)image->getPixelAddress(0, y);
-        uint8_t* dst_address = row_pointer;
-        unsigned int x, c;
-
-        for (x=0; x<width; x++) {
-          c = *(src_address++);
-          *(dst_address++) = graya_getv(c);
-        }
-      }
-      /* PALETTE */
-      else if (png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_PALETTE) {
-        uint8_t* src_address = (uint8_t*)image->getPixelAddress(0, y);
-        uint8_t* dst_address = row_pointer;
-        unsigned int x;
-
-        for (x=0; x<width; x++)
-          *(dst_address++) = *(src_address++);
-      }
-
-      /* write the line */
-      png_write_rows(png_ptr, &row_pointer, 1);
-
-      fop->setProgress(
-        (double)((double)pass + (double)(y+1) / (double)(height))
-        / (double)number_passes);
+  png_options = fop->sequenceGetFormatOptions();
+  if (!png_options)
+    png_options.reset(new PngOptions);
+
+  // The image data is filtered and compressed in parallel by us,
+  // libpng is only used to write the chunks. Each group of blocks is
+  // written as soon as it's compressed, so we don't keep the whole
+  // compressed image in memory.
+  compressor.reset(new PngDataCompressor(image, color_type,
+                                         png_options->filter(),
+                                         png_options->compressionLevel()));
+  while (!compressor->done()) {
+    try {
+      for (const auto& data : compressor->compressNextBlocks())
+        png_write_chunk(png_ptr, (png_const_bytep)"IDAT", &data[0], data.size());
+    }
+    catch (const std::exception& e) {
+      fop->setError("%s\n", e.what());
+      png_destroy_write_struct(&png_ptr, &info_ptr);
+      return false;
     }
+    fop->setProgress(compressor->progress());
   }
 
-  png_free(png_ptr, row_pointer);
-
-  /* It is REQUIRED to call this to finish writing the rest of the file */
-  png_write_end(png_ptr, info_ptr);
+  /* It is REQUIRED to call this to finish writing the rest of the file.
+     We cannot use png_write_end() because libpng doesn't know about
+     the IDAT chunks that we've written. */
+  png_write_chunk(png_ptr, (png_const_bytep)"IEND", NULL, 0);
 
   /* If you png_malloced a palette, free it here (don't free info_ptr->palette,
      as recommended in versions 1.0.5m and earlier of this example; if
@@ -559,4 +569,166 @@ bool PngFormat::onSave(FileOp* fop)
   return true;
 }
 
+// Writes PNG files row by row (see ImageStreamWriter). Unlike
+// PngFormat::onSave(), the image data is compressed by libpng in
+// this same thread.
+class PngStreamWriter : public ImageStreamWriter {
+public:
+  PngStreamWriter(const std::string& filename,
+                  PixelFormat pixelFormat,
+                  int width, int height,
+                  const Palette* palette,
+                  int transparentIndex)
+    : m_handle(open_file_with_exception(filename, "wb"))
+    , m_png(nullptr)
+    , m_info(nullptr)
+    , m_colorType(0)
+    , m_width(width)
+    , m_rowsLeft(height) {
+    // Declared before setjmp() to be destroyed correctly in case of error
+    std::vector<png_color> colors;
+    std::vector<png_byte> trans;
+
+    m_png = png_create_write_struct(PNG_LIBPNG_VER_STRING, (png_voidp)this,
+                                    &PngStreamWriter::reportError, nullptr);
+    if (m_png)
+      m_info = png_create_info_struct(m_png);
+    if (!m_png || !m_info) {
+      png_destroy_write_struct(&m_png, nullptr);
+      throw Exception("Error creating PNG file.\n");
+    }
+
+    if (setjmp(png_jmpbuf(m_png))) {
+      png_destroy_write_struct(&m_png, &m_info);
+      throw Exception("Error writing PNG header: %s\n", m_error.c_str());
+    }
+
+    png_init_io(m_png, m_handle.get());
+
+    switch (pixelFormat) {
+      case IMAGE_RGB: m_colorType = PNG_COLOR_TYPE_RGB_ALPHA; break;
+      case IMAGE_GRAYSCALE: m_colorType = PNG_COLOR_TYPE_GRAY_ALPHA; break;
+      case IMAGE_INDEXED: m_colorType = PNG_COLOR_TYPE_PALETTE; break;
+    }
+
+    png_set_IHDR(m_png, m_info, width, height, 8, m_colorType,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+    if (pixelFormat == IMAGE_INDEXED && palette) {
+      int size = MID(1, palette->size(), PNG_MAX_PALETTE_LENGTH);
+      colors.resize(size);
+      trans.resize(size);
+      for (int c=0; c<size; ++c) {
+        color_t color = palette->getEntry(c);
+        colors[c].red   = rgba_getr(color);
+        colors[c].green = rgba_getg(color);
+        colors[c].blue  = rgba_getb(color);
+        trans[c] = (c == transparentIndex ? 0: rgba_geta(color));
+      }
+      png_set_PLTE(m_png, m_info, &colors[0], size);
+      png_set_tRNS(m_png, m_info, &trans[0], size, nullptr);
+    }
+
+    // Use the same options as non-interactive saves
+    PngOptions options;
+    if (options.compressionLevel() >= 0)
+      png_set_compression_level(m_png, options.compressionLevel());
+
+    int filters = (pixelFormat == IMAGE_INDEXED ? PNG_FILTER_NONE: PNG_ALL_FILTERS);
+    switch (options.filter()) {
+      case PngOptions::Filter::Default: break;
+      case PngOptions::Filter::None: filters = PNG_FILTER_NONE; break;
+      case PngOptions::Filter::Sub: filters = PNG_FILTER_SUB; break;
+      case PngOptions::Filter::Up: filters = PNG_FILTER_UP; break;
+      case PngOptions::Filter::Average: filters = PNG_FILTER_AVG; break;
+      case PngOptions::Filter::Paeth: filters = PNG_FILTER_PAETH; break;
+      case PngOptions::Filter::Adaptive: filters = PNG_ALL_FILTERS; break;
+    }
+    png_set_filter(m_png, PNG_FILTER_TYPE_BASE, filters);
+
+    png_write_info(m_png, m_info);
+    m_row.resize(png_get_rowbytes(m_png, m_info));
+  }
+
+  ~PngStreamWriter() {
+    png_destroy_write_struct(&m_png, &m_info);
+  }
+
+  void writeRows(const Image* strip, int rows) override {
+    ASSERT(strip->width() == m_width);
+    rows = std::min(rows, m_rowsLeft);
+
+    if (setjmp(png_jmpbuf(m_png)))
+      throw Exception("Error writing PNG image data: %s\n", m_error.c_str());
+
+    for (int y=0; y<rows; ++y) {
+      png_convert_row(strip, m_colorType, y, &m_row[0]);
+      png_write_row(m_png, &m_row[0]);
+    }
+    m_rowsLeft -= rows;
+  }
+
+  void close() override {
+    if (m_rowsLeft > 0)
+      throw Exception("Missing %d rows in PNG image.\n", m_rowsLeft);
+
+    if (setjmp(png_jmpbuf(m_png)))
+      throw Exception("Error writing PNG file: %s\n", m_error.c_str());
+
+    png_write_end(m_png, m_info);
+
+    if (std::fflush(m_handle.get()) != 0 ||
+        std::ferror(m_handle.get()))
+      throw Exception("Error writing PNG file.\n");
+  }
+
+private:
+  static void reportError(png_structp png_ptr, png_const_charp error) {
+    ((PngStreamWriter*)png_get_error_ptr(png_ptr))->m_error = error;
+  }
+
+  FileHandle m_handle;
+  png_structp m_png;
+  png_infop m_info;
+  int m_colorType;
+  int m_width;
+  int m_rowsLeft;
+  std::vector<uint8_t> m_row;
+  std::string m_error;
+};
+
+ImageStreamWriter* PngFormat::onCreateStreamWriter(const std::string& filename,
+                                                   PixelFormat pixelFormat,
+                                                   int width, int height,
+                                                   const Palette* palette,
+                                                   int transparentIndex)
+{
+  return new PngStreamWriter(filename, pixelFormat, width, height,
+                             palette, transparentIndex);
+}
+
+base::SharedPtr<FormatOptions> PngFormat::onGetFormatOptions(FileOp* fop)
+{
+  base::SharedPtr<PngOptions> png_options(new PngOptions);
+
+  // The options used from the UI can be changed in the configuration
+  // file
+  if (fop->context() &&
+      fop->context()->isUIAvailable()) {
+    // Invalid values in the file are ignored (the defaults are used)
+    int level = get_config_int("PNG", "CompressionLevel",
+                               png_options->compressionLevel());
+    if (level >= -1 && level <= 9)
+      png_options->setCompressionLevel(level);
+
+    int filter = get_config_int("PNG", "Filter",
+                                int(png_options->filter()));
+    if (filter >= int(PngOptions::Filter::Default) &&
+        filter <= int(PngOptions::Filter::Adaptive))
+      png_options->setFilter(PngOptions::Filter(filter));
+  }
+
+  return png_options;
+}
+
 } // namespace app
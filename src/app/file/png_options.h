@@ -0,0 +1,55 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#pragma once
+
+#include "app/file/format_options.h"
+
+#include <string>
+
+namespace app {
+
+  // Data for PNG files
+  class PngOptions : public FormatOptions {
+  public:
+    // Filter applied to each row before it's compressed. "Default"
+    // uses no filter for indexed images and "Adaptive" for the rest
+    // (like libpng does).
+    enum class Filter { Default, None, Sub, Up, Average, Paeth, Adaptive };
+
+    PngOptions()
+      : m_compressionLevel(defaultCompressionLevel())
+      , m_filter(defaultFilter()) {
+    }
+
+    // zlib level (0-9, or -1 to use the zlib default)
+    int compressionLevel() const { return m_compressionLevel; }
+    void setCompressionLevel(int level) { m_compressionLevel = level; }
+
+    Filter filter() const { return m_filter; }
+    void setFilter(Filter filter) { m_filter = filter; }
+
+    // Default options used in non-interactive mode (they can be
+    // changed with the --png-compression and --png-filter command
+    // line options).
+    static int defaultCompressionLevel();
+    static void setDefaultCompressionLevel(int level);
+    static Filter defaultFilter();
+    static void setDefaultFilter(Filter filter);
+
+    // Converts a string to a compression level ("0" to "9") or a
+    // filter ("none", "sub", "up", "average", "paeth", "adaptive"),
+    // returns false if the string is not valid.
+    static bool parseCompressionLevel(const std::string& str, int& level);
+    static bool parseFilter(const std::string& str, Filter& filter);
+
+  private:
+    int m_compressionLevel;
+    Filter m_filter;
+  };
+
+} // namespace app
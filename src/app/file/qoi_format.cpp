@@ -14,12 +14,17 @@
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
+#include "app/file/image_stream_writer.h"
 #include "app/ini_file.h"
+#include "base/exception.h"
 #include "base/file_handle.h"
 #include "doc/doc.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 
 #define QOI_IMPLEMENTATION
 #include <qoi.h>
@@ -38,11 +43,17 @@ class QoiFormat : public FileFormat {
       FILE_SUPPORT_RGB |
       FILE_SUPPORT_RGBA |
       FILE_SUPPORT_SEQUENCES |
+      FILE_SUPPORT_PARALLEL_SEQUENCES |
       FILE_SUPPORT_PALETTE_WITH_ALPHA;
   }
 
   bool onLoad(FileOp* fop) override;
   bool onSave(FileOp* fop) override;
+  ImageStreamWriter* onCreateStreamWriter(const std::string& filename,
+                                          PixelFormat pixelFormat,
+                                          int width, int height,
+                                          const Palette* palette,
+                                          int transparentIndex) override;
 };
 
 static FileFormat::Regular<QoiFormat> ff{"qoi"};
@@ -73,4 +84,185 @@ bool QoiFormat::onSave(FileOp* fop)
   return qoi_write(fop->filename().c_str(), image->getPixelAddress(0, 0), &desc) != 0;
 }
 
+// Writes QOI files row by row (see ImageStreamWriter). It's the same
+// encoder as qoi_encode(), but keeping its state between strips.
+class QoiStreamWriter : public ImageStreamWriter {
+public:
+  QoiStreamWriter(const std::string& filename,
+                  PixelFormat pixelFormat,
+                  int width, int height,
+                  const Palette* palette,
+                  int transparentIndex)
+    : m_pixelFormat(pixelFormat)
+    , m_width(width)
+    , m_rowsLeft(height)
+    , m_run(0) {
+    if (width <= 0 || height <= 0 ||
+        unsigned(height) >= QOI_PIXELS_MAX / unsigned(width))
+      throw Exception("Invalid QOI image size.\n");
+
+    if (palette) {
+      for (int i=0; i<palette->size(); ++i)
+        m_palette.push_back(i == transparentIndex ? 0: palette->getEntry(i));
+    }
+
+    QOI_ZEROARR(m_index);
+    m_prev.rgba.r = 0;
+    m_prev.rgba.g = 0;
+    m_prev.rgba.b = 0;
+    m_prev.rgba.a = 255;
+
+    m_handle = open_file_with_exception(filename, "wb");
+
+    unsigned char header[QOI_HEADER_SIZE];
+    int p = 0;
+    qoi_write_32(header, &p, QOI_MAGIC);
+    qoi_write_32(header, &p, width);
+    qoi_write_32(header, &p, height);
+    header[p++] = 4;
+    header[p++] = QOI_SRGB;
+    write(header, p);
+  }
+
+  void writeRows(const Image* strip, int rows) override {
+    ASSERT(strip->width() == m_width);
+    ASSERT(strip->pixelFormat() == m_pixelFormat);
+    rows = std::min(rows, m_rowsLeft);
+
+    for (int y=0; y<rows; ++y) {
+      for (int x=0; x<m_width; ++x)
+        encode(pixelColor(strip, x, y));
+      write(m_buf.data(), m_buf.size());
+      m_buf.clear();
+    }
+    m_rowsLeft -= rows;
+  }
+
+  void close() override {
+    if (m_rowsLeft > 0)
+      throw Exception("Missing %d rows in QOI image.\n", m_rowsLeft);
+
+    if (m_run > 0) {
+      m_buf.push_back(QOI_OP_RUN | (m_run - 1));
+      m_run = 0;
+    }
+    m_buf.insert(m_buf.end(), qoi_padding, qoi_padding+sizeof(qoi_padding));
+    write(m_buf.data(), m_buf.size());
+    m_buf.clear();
+
+    if (std::fflush(m_handle.get()) != 0)
+      throw Exception("Error writing QOI file.\n");
+  }
+
+private:
+  qoi_rgba_t pixelColor(const Image* strip, int x, int y) const {
+    color_t c = 0;
+    switch (m_pixelFormat) {
+      case IMAGE_RGB:
+        c = get_pixel_fast<RgbTraits>(strip, x, y);
+        break;
+      case IMAGE_GRAYSCALE: {
+        color_t g = get_pixel_fast<GrayscaleTraits>(strip, x, y);
+        c = rgba(graya_getv(g), graya_getv(g), graya_getv(g), graya_geta(g));
+        break;
+      }
+      case IMAGE_INDEXED: {
+        color_t i = get_pixel_fast<IndexedTraits>(strip, x, y);
+        if (i < m_palette.size())
+          c = m_palette[i];
+        break;
+      }
+    }
+
+    qoi_rgba_t px;
+    px.rgba.r = rgba_getr(c);
+    px.rgba.g = rgba_getg(c);
+    px.rgba.b = rgba_getb(c);
+    px.rgba.a = rgba_geta(c);
+    return px;
+  }
+
+  void encode(qoi_rgba_t px) {
+    if (px.v == m_prev.v) {
+      if (++m_run == 62) {
+        m_buf.push_back(QOI_OP_RUN | (m_run - 1));
+        m_run = 0;
+      }
+      return;
+    }
+
+    if (m_run > 0) {
+      m_buf.push_back(QOI_OP_RUN | (m_run - 1));
+      m_run = 0;
+    }
+
+    int index_pos = QOI_COLOR_HASH(px) % 64;
+    if (m_index[index_pos].v == px.v) {
+      m_buf.push_back(QOI_OP_INDEX | index_pos);
+    }
+    else {
+      m_index[index_pos] = px;
+
+      if (px.rgba.a == m_prev.rgba.a) {
+        signed char vr = px.rgba.r - m_prev.rgba.r;
+        signed char vg = px.rgba.g - m_prev.rgba.g;
+        signed char vb = px.rgba.b - m_prev.rgba.b;
+        signed char vg_r = vr - vg;
+        signed char vg_b = vb - vg;
+
+        if (vr > -3 && vr < 2 &&
+            vg > -3 && vg < 2 &&
+            vb > -3 && vb < 2) {
+          m_buf.push_back(QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+        }
+        else if (vg_r >  -9 && vg_r <  8 &&
+                 vg   > -33 && vg   < 32 &&
+                 vg_b >  -9 && vg_b <  8) {
+          m_buf.push_back(QOI_OP_LUMA | (vg + 32));
+          m_buf.push_back((vg_r + 8) << 4 | (vg_b + 8));
+        }
+        else {
+          m_buf.push_back(QOI_OP_RGB);
+          m_buf.push_back(px.rgba.r);
+          m_buf.push_back(px.rgba.g);
+          m_buf.push_back(px.rgba.b);
+        }
+      }
+      else {
+        m_buf.push_back(QOI_OP_RGBA);
+        m_buf.push_back(px.rgba.r);
+        m_buf.push_back(px.rgba.g);
+        m_buf.push_back(px.rgba.b);
+        m_buf.push_back(px.rgba.a);
+      }
+    }
+    m_prev = px;
+  }
+
+  void write(const unsigned char* data, std::size_t size) {
+    if (size > 0 && std::fwrite(data, 1, size, m_handle.get()) != size)
+      throw Exception("Error writing QOI file.\n");
+  }
+
+  FileHandle m_handle;
+  PixelFormat m_pixelFormat;
+  int m_width;
+  int m_rowsLeft;
+  std::vector<color_t> m_palette;
+  std::vector<unsigned char> m_buf;
+  qoi_rgba_t m_index[64];
+  qoi_rgba_t m_prev;
+  int m_run;
+};
+
+ImageStreamWriter* QoiFormat::onCreateStreamWriter(const std::string& filename,
+                                                   PixelFormat pixelFormat,
+                                                   int width, int height,
+                                                   const Palette* palette,
+                                                   int transparentIndex)
+{
+  return new QoiStreamWriter(filename, pixelFormat, width, height,
+                             palette, transparentIndex);
+}
+
 } // namespace app
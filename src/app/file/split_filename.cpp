@@ -11,9 +11,11 @@
 
 #include "app/file/split_filename.h"
 #include "base/convert_to.h"
+#include "base/fs.h"
 #include "base/path.h"
 #include "base/string.h"
 
+#include <cstdio>
 #include <cstring>
 
 namespace app {
@@ -60,4 +62,30 @@ int split_filename(const char* filename, std::string& left, std::string& right,
     return -1;
 }
 
+void get_sequence_filenames(const std::string& filename,
+                            std::vector<std::string>& filenames)
+{
+  filenames.push_back(filename);
+
+  // Check if this could be a sequence
+  std::string left, right;
+  int width;
+  int start_from = split_filename(filename.c_str(), left, right, width);
+  if (start_from < 0)
+    return;
+
+  // Try to get more file names
+  char buf[512];
+  for (int c=start_from+1; ; c++) {
+    // Get the next file name
+    snprintf(buf, sizeof(buf), "%s%0*d%s", left.c_str(), width, c, right.c_str());
+
+    // If the file doesn't exist, we don't need more files to load
+    if (!base::is_file(buf))
+      break;
+
+    filenames.push_back(buf);
+  }
+}
+
 } // namespace app
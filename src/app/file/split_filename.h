@@ -8,9 +8,16 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace app {
 
   int split_filename(const char* filename, std::string& left, std::string& right, int& width);
 
+  // Adds "filename" and the next existent files of its sequence
+  // (e.g. "frame02.png", "frame03.png", etc. for "frame01.png") to
+  // "filenames", the files that are loaded as a sequence.
+  void get_sequence_filenames(const std::string& filename,
+                              std::vector<std::string>& filenames);
+
 } // namespace app
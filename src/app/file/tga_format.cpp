@@ -34,7 +34,8 @@ class TgaFormat : public FileFormat {
       FILE_SUPPORT_RGBA |
       FILE_SUPPORT_GRAY |
       FILE_SUPPORT_INDEXED |
-      FILE_SUPPORT_SEQUENCES;
+      FILE_SUPPORT_SEQUENCES |
+      FILE_SUPPORT_PARALLEL_SEQUENCES;
   }
 
   bool onLoad(FileOp* fop) override;
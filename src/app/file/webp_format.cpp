@@ -50,6 +50,7 @@ class WebPFormat : public FileFormat {
       FILE_SUPPORT_RGB |
       FILE_SUPPORT_RGBA |
       FILE_SUPPORT_SEQUENCES |
+      FILE_SUPPORT_PARALLEL_SEQUENCES |
       FILE_SUPPORT_GET_FORMAT_OPTIONS;
   }
 
@@ -311,7 +312,8 @@ bool WebPFormat::onSave(FileOp* fop)
 base::SharedPtr<FormatOptions> WebPFormat::onGetFormatOptions(FileOp* fop)
 {
   base::SharedPtr<WebPOptions> webp_options;
-  if (fop->document()->getFormatOptions())
+  // The document can contain options from other format
+  if (dynamic_cast<WebPOptions*>(fop->document()->getFormatOptions().get()))
     webp_options = base::SharedPtr<WebPOptions>(fop->document()->getFormatOptions());
 
   if (!webp_options)
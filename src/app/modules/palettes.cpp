@@ -14,6 +14,7 @@
 #include "app/app.h"
 #include "app/file/palette_file.h"
 #include "app/resource_finder.h"
+#include "app/startup_profile.h"
 #include "base/fs.h"
 #include "base/path.h"
 #include "doc/image.h"
@@ -30,6 +31,21 @@ namespace app {
 // Palette in current sprite frame.
   static std::shared_ptr<Palette> ase_current_palette;
 
+// Palette file given to load_default_palette_lazily(), the default
+// palette is loaded the first time that it's used.
+static std::string ase_pending_palette_file;
+static bool ase_default_palette_pending = false;
+
+static void load_pending_default_palette()
+{
+  if (ase_default_palette_pending) {
+    ase_default_palette_pending = false;
+
+    StartupProfile::Scope profile("default palette (lazy)");
+    load_default_palette(ase_pending_palette_file);
+  }
+}
+
 int init_module_palette()
 {
   ase_default_palette = Palette::create(256);
@@ -39,6 +55,7 @@ int init_module_palette()
 
 void exit_module_palette()
 {
+  ase_default_palette_pending = false;
 }
 
 void load_default_palette(const std::string& userDefined)
@@ -126,18 +143,27 @@ void load_default_palette(const std::string& userDefined)
   set_current_palette(nullptr, true);
 }
 
+void load_default_palette_lazily(const std::string& userDefined)
+{
+  ase_pending_palette_file = userDefined;
+  ase_default_palette_pending = true;
+}
+
 Palette* get_current_palette()
 {
+  load_pending_default_palette();
   return ase_current_palette.get();
 }
 
 Palette* get_default_palette()
 {
+  load_pending_default_palette();
   return ase_default_palette.get();
 }
 
 void set_default_palette(const Palette* palette)
 {
+  load_pending_default_palette();
   palette->copyColorsTo(*ase_default_palette);
 }
 
@@ -147,6 +173,8 @@ void set_default_palette(const Palette* palette)
 // If "_palette" is nullptr the default palette is set.
 bool set_current_palette(const Palette *_palette, bool forced)
 {
+  load_pending_default_palette();
+
   const Palette* palette = (_palette ? _palette: ase_default_palette.get());
   bool ret = false;
 
@@ -25,6 +25,11 @@ namespace app {
   // line.
   void load_default_palette(const std::string& userDefined);
 
+  // Same as load_default_palette() but the palette is loaded the
+  // first time that the default/current palette is used (e.g. batch
+  // mode doesn't need it to convert files).
+  void load_default_palette_lazily(const std::string& userDefined);
+
   Palette* get_default_palette();
   Palette* get_current_palette();
 
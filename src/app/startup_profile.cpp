@@ -0,0 +1,86 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/startup_profile.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace app {
+
+namespace {
+
+struct Entry {
+  const char* name;
+  int depth;
+  double seconds;
+};
+
+std::unique_ptr<base::Chrono> total;
+std::vector<Entry> entries;
+int depth = 0;
+
+} // anonymous namespace
+
+StartupProfile::Scope::Scope(const char* name)
+  : m_entry(-1)
+{
+  if (total) {
+    m_entry = int(entries.size());
+    entries.push_back(Entry{ name, depth++, 0.0 });
+  }
+}
+
+StartupProfile::Scope::~Scope()
+{
+  if (m_entry >= 0 && total) {
+    entries[m_entry].seconds = m_chrono.elapsed();
+    --depth;
+  }
+}
+
+// static
+void StartupProfile::setEnabled(bool state)
+{
+  entries.clear();
+  depth = 0;
+  if (state)
+    total.reset(new base::Chrono);
+  else
+    total.reset();
+}
+
+// static
+bool StartupProfile::isEnabled()
+{
+  return (total != nullptr);
+}
+
+// static
+void StartupProfile::print(std::FILE* f)
+{
+  if (!total)
+    return;
+
+  std::fprintf(f, "Startup profile:\n");
+  for (const Entry& entry : entries) {
+    std::string name(2*(entry.depth+1), ' ');
+    name += entry.name;
+    std::fprintf(f, "%-32s %9.2f ms\n", name.c_str(), entry.seconds*1000.0);
+  }
+  std::fprintf(f, "%-32s %9.2f ms\n", "  total", total->elapsed()*1000.0);
+  std::fflush(f);
+
+  setEnabled(false);
+}
+
+} // namespace app
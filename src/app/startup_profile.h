@@ -0,0 +1,48 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#pragma once
+
+#include "base/chrono.h"
+#include "base/disable_copying.h"
+
+#include <cstdio>
+
+namespace app {
+
+  // Time spent initializing each part of the program, printed with
+  // --startup-profile. Parts that are initialized on their first use
+  // (e.g. the default palette in batch mode) are measured when they
+  // are used, so they appear only if they were needed.
+  //
+  // It must be used from the main thread only.
+  class StartupProfile {
+  public:
+    // Measures the time from its construction to its destruction.
+    // Scopes can be nested.
+    class Scope {
+    public:
+      explicit Scope(const char* name);
+      ~Scope();
+
+    private:
+      int m_entry;
+      base::Chrono m_chrono;
+
+      DISABLE_COPYING(Scope);
+    };
+
+    static void setEnabled(bool state);
+    static bool isEnabled();
+
+    // Prints the measured parts (and the total time since the
+    // profile was enabled) and disables the profile, so it's printed
+    // only once.
+    static void print(std::FILE* f);
+  };
+
+} // namespace app
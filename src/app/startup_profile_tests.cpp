@@ -0,0 +1,67 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/test.h"
+
+#include "app/startup_profile.h"
+
+#include <cstdio>
+#include <string>
+
+using namespace app;
+
+static std::string print_profile()
+{
+  std::FILE* f = std::tmpfile();
+  StartupProfile::print(f);
+
+  std::string result;
+  std::rewind(f);
+  char buf[256];
+  while (std::fgets(buf, sizeof(buf), f))
+    result += buf;
+  std::fclose(f);
+  return result;
+}
+
+TEST(StartupProfile, Disabled)
+{
+  StartupProfile::setEnabled(false);
+  EXPECT_FALSE(StartupProfile::isEnabled());
+  {
+    StartupProfile::Scope a("a");
+  }
+  EXPECT_EQ("", print_profile());
+}
+
+TEST(StartupProfile, NestedScopes)
+{
+  StartupProfile::setEnabled(true);
+  EXPECT_TRUE(StartupProfile::isEnabled());
+  {
+    StartupProfile::Scope a("a");
+    StartupProfile::Scope b("b");
+  }
+  {
+    StartupProfile::Scope c("c");
+  }
+
+  std::string out = print_profile();
+  EXPECT_EQ(0u, out.find("Startup profile:\n"));
+  std::size_t a = out.find("\n  a ");
+  std::size_t b = out.find("\n    b ");
+  std::size_t c = out.find("\n  c ");
+  std::size_t total = out.find("\n  total ");
+  EXPECT_NE(std::string::npos, a);
+  EXPECT_LT(a, b);
+  EXPECT_LT(b, c);
+  EXPECT_LT(c, total);
+
+  // The profile is printed only once
+  EXPECT_FALSE(StartupProfile::isEnabled());
+  EXPECT_EQ("", print_profile());
+}
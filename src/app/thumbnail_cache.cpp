@@ -0,0 +1,220 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/thumbnail_cache.h"
+
+#include "app/resource_finder.h"
+#include "base/exception.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/path.h"
+#include "base/serialization.h"
+#include "base/time.h"
+#include "doc/image.h"
+#include "doc/image_io.h"
+#include "doc/string_io.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <tuple>
+#include <vector>
+
+#define THUMBNAIL_CACHE_MAGIC   0x48545350 // "PSTH"
+
+namespace app {
+
+using namespace base::serialization;
+using namespace base::serialization::little_endian;
+
+// Returns an string that changes when the file is modified, or an
+// empty string if the file doesn't exist.
+static std::string make_entry_key(const std::string& filename)
+{
+  if (!base::is_file(filename))
+    return std::string();
+
+  std::string stamp = base::get_file_stamp(filename);
+  if (stamp.empty())
+    return std::string();
+
+  return filename + "|" + stamp;
+}
+
+static bool is_entry_file(const std::string& fn)
+{
+  return (base::get_file_extension(fn) == "thumb");
+}
+
+static bool is_older(const base::Time& a, const base::Time& b)
+{
+  return
+    std::tie(a.year, a.month, a.day, a.hour, a.minute, a.second) <
+    std::tie(b.year, b.month, b.day, b.hour, b.minute, b.second);
+}
+
+ThumbnailCache::ThumbnailCache()
+  : m_maxBytes(kDefaultMaxBytes)
+  , m_entriesLoaded(false)
+  , m_totalBytes(0)
+{
+  ResourceFinder rf;
+  rf.includeUserDir(base::join_path("thumbnails", ".").c_str());
+  m_dir = rf.getFirstOrCreateDefault();
+}
+
+ThumbnailCache::ThumbnailCache(const std::string& dir, std::size_t maxBytes)
+  : m_dir(dir)
+  , m_maxBytes(maxBytes)
+  , m_entriesLoaded(false)
+  , m_totalBytes(0)
+{
+}
+
+doc::Image* ThumbnailCache::load(const std::string& filename) const
+{
+  std::string key = make_entry_key(filename);
+  if (key.empty())
+    return nullptr;
+
+  std::string fn = entryFilename(key);
+  if (!base::is_file(fn))
+    return nullptr;
+
+  try {
+    std::ifstream s(FSTREAM_PATH(fn), std::ifstream::binary);
+    if (read32(s) != THUMBNAIL_CACHE_MAGIC ||
+        doc::read_string(s) != key)  // Hash collision
+      return nullptr;
+
+    doc::Image* image = doc::read_image(s, false);
+    if (image) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      loadEntries();
+      auto it = m_entries.find(fn);
+      if (it != m_entries.end())
+        touchEntry(fn, it->second.size);
+    }
+    return image;
+  }
+  catch (const std::exception& ex) {
+    LOG("Error reading thumbnail \"%s\": %s\n", fn.c_str(), ex.what());
+    return nullptr;
+  }
+}
+
+void ThumbnailCache::save(const std::string& filename, const doc::Image* thumbnail) const
+{
+  std::string key = make_entry_key(filename);
+  if (key.empty())
+    return;
+
+  // Write a temporary file and rename it, so a cancelled write never
+  // leaves a broken entry.
+  std::string fn = entryFilename(key);
+  std::string tmp = fn + ".tmp";
+  try {
+    {
+      std::ofstream s(FSTREAM_PATH(tmp), std::ofstream::binary);
+      write32(s, THUMBNAIL_CACHE_MAGIC);
+      doc::write_string(s, key);
+      doc::write_image(s, thumbnail);
+      if (s.fail())
+        throw base::Exception("Error writing thumbnail");
+    }
+    if (base::is_file(fn))
+      base::delete_file(fn);
+    base::move_file(tmp, fn);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    loadEntries();
+    touchEntry(fn, base::file_size(fn));
+    evictEntries();
+  }
+  catch (const std::exception& ex) {
+    LOG("Error writing thumbnail \"%s\": %s\n", fn.c_str(), ex.what());
+    if (base::is_file(tmp))
+      base::delete_file(tmp);
+  }
+}
+
+void ThumbnailCache::loadEntries() const
+{
+  if (m_entriesLoaded)
+    return;
+  m_entriesLoaded = true;
+
+  // Existing entries (from previous sessions) are used from the
+  // oldest to the newest one.
+  std::vector<std::pair<base::Time, std::string>> files;
+  for (const auto& item : base::list_files(m_dir)) {
+    std::string fn = base::join_path(m_dir, item);
+    if (is_entry_file(fn))
+      files.push_back(std::make_pair(base::get_modification_time(fn), fn));
+  }
+  std::stable_sort(files.begin(), files.end(),
+                   [](const auto& a, const auto& b) {
+                     return is_older(a.first, b.first);
+                   });
+
+  for (const auto& file : files)
+    touchEntry(file.second, base::file_size(file.second));
+}
+
+void ThumbnailCache::touchEntry(const std::string& fn, std::size_t size) const
+{
+  auto it = m_entries.find(fn);
+  if (it != m_entries.end()) {
+    m_totalBytes -= it->second.size;
+    m_lru.erase(it->second.lruPos);
+    m_entries.erase(it);
+  }
+
+  m_lru.push_front(fn);
+  m_entries[fn] = Entry{ m_lru.begin(), size };
+  m_totalBytes += size;
+}
+
+void ThumbnailCache::evictEntries() const
+{
+  // Keep at least the most recently used entry
+  while (m_totalBytes > m_maxBytes && m_lru.size() > 1) {
+    std::string fn = m_lru.back();
+    auto it = m_entries.find(fn);
+    m_totalBytes -= it->second.size;
+    m_entries.erase(it);
+    m_lru.pop_back();
+
+    try {
+      if (base::is_file(fn))
+        base::delete_file(fn);
+    }
+    catch (const std::exception& ex) {
+      LOG("Error deleting thumbnail \"%s\": %s\n", fn.c_str(), ex.what());
+    }
+  }
+}
+
+std::string ThumbnailCache::entryFilename(const std::string& key) const
+{
+  // 64-bit FNV-1a hash of the key
+  uint64_t hash = 14695981039346656037ull;
+  for (char chr : key) {
+    hash ^= uint8_t(chr);
+    hash *= 1099511628211ull;
+  }
+
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%016llx.thumb", (unsigned long long)hash);
+  return base::join_path(m_dir, buf);
+}
+
+} // namespace app
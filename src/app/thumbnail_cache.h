@@ -0,0 +1,74 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+
+  // Keeps thumbnails of files on disk so they don't need to be
+  // generated again (e.g. each time the file selector is opened).
+  // Entries are keyed by the path, modification time, and size of
+  // the file, so a modified file gets a new thumbnail.
+  //
+  // The total size of the entries is limited: when a new thumbnail is
+  // saved, the least recently used entries are deleted.
+  //
+  // All member functions can be called from any thread.
+  class ThumbnailCache {
+  public:
+    static const std::size_t kDefaultMaxBytes = 64*1024*1024;
+
+    // Uses the "thumbnails" directory in the user folder.
+    ThumbnailCache();
+    explicit ThumbnailCache(const std::string& dir,
+                            std::size_t maxBytes = kDefaultMaxBytes);
+
+    // Returns a new image with the cached thumbnail of the given
+    // file, or nullptr if there is no valid thumbnail for it.
+    doc::Image* load(const std::string& filename) const;
+
+    void save(const std::string& filename, const doc::Image* thumbnail) const;
+
+  private:
+    typedef std::list<std::string> LruList;
+    struct Entry {
+      LruList::iterator lruPos;
+      std::size_t size;
+    };
+
+    std::string entryFilename(const std::string& key) const;
+
+    // Functions to keep the LRU list of entries (m_mutex must be
+    // locked).
+    void loadEntries() const;
+    void touchEntry(const std::string& fn, std::size_t size) const;
+    void evictEntries() const;
+
+    std::string m_dir;
+    std::size_t m_maxBytes;
+
+    // Entry files sorted from the most to the least recently used,
+    // and their sizes. They are read from the directory the first
+    // time they are needed.
+    mutable std::mutex m_mutex;
+    mutable bool m_entriesLoaded;
+    mutable LruList m_lru;
+    mutable std::map<std::string, Entry> m_entries;
+    mutable std::size_t m_totalBytes;
+  };
+
+} // namespace app
@@ -0,0 +1,89 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/test.h"
+
+#include "app/thumbnail_cache.h"
+#include "base/fs.h"
+#include "base/path.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+#include <fstream>
+#include <memory>
+
+using namespace app;
+using namespace doc;
+
+class ThumbnailCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    m_dir = base::join_path(base::get_temp_path(), "_thumbnail_cache_tests");
+    m_cacheDir = base::join_path(m_dir, "cache");
+    base::make_all_directories(m_cacheDir);
+    for (int i=0; i<3; ++i)
+      std::ofstream(input(i)) << "input" << i;
+  }
+
+  void TearDown() override {
+    for (const auto& fn : base::list_files(m_cacheDir))
+      base::delete_file(base::join_path(m_cacheDir, fn));
+    base::remove_directory(m_cacheDir);
+    for (int i=0; i<3; ++i)
+      base::delete_file(input(i));
+    base::remove_directory(m_dir);
+  }
+
+  std::string input(int i) const {
+    return base::join_path(m_dir, "input" + std::to_string(i) + ".png");
+  }
+
+  bool isCached(const ThumbnailCache& cache, int i) const {
+    std::unique_ptr<Image> image(cache.load(input(i)));
+    return (image != nullptr);
+  }
+
+  std::string m_dir;
+  std::string m_cacheDir;
+};
+
+TEST_F(ThumbnailCacheTest, SaveAndLoad)
+{
+  ThumbnailCache cache(m_cacheDir);
+  EXPECT_FALSE(isCached(cache, 0));
+
+  std::unique_ptr<Image> thumbnail(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(thumbnail.get(), rgba(255, 0, 0, 255));
+  cache.save(input(0), thumbnail.get());
+
+  std::unique_ptr<Image> result(cache.load(input(0)));
+  ASSERT_TRUE(result != nullptr);
+  EXPECT_EQ(0, count_diff_between_images(thumbnail.get(), result.get()));
+}
+
+TEST_F(ThumbnailCacheTest, EvictLeastRecentlyUsed)
+{
+  // Noise to avoid compressing the pixels
+  std::unique_ptr<Image> thumbnail(Image::create(IMAGE_RGB, 32, 32));
+  uint32_t seed = 1;
+  for (int y=0; y<32; ++y)
+    for (int x=0; x<32; ++x) {
+      seed = seed*1103515245 + 12345;
+      put_pixel(thumbnail.get(), x, y, seed);
+    }
+
+  // Room for two entries (each one has 4 KB of pixels)
+  ThumbnailCache cache(m_cacheDir, 10*1024);
+  cache.save(input(0), thumbnail.get());
+  cache.save(input(1), thumbnail.get());
+  EXPECT_TRUE(isCached(cache, 0));  // Now input1 is the least recently used
+
+  cache.save(input(2), thumbnail.get());
+  EXPECT_TRUE(isCached(cache, 0));
+  EXPECT_FALSE(isCached(cache, 1));
+  EXPECT_TRUE(isCached(cache, 2));
+}
@@ -17,8 +17,6 @@
 #include "app/file/file.h"
 #include "app/file_system.h"
 #include "base/bind.h"
-#include "base/scoped_lock.h"
-#include "base/thread.h"
 #include "doc/algorithm/rotate.h"
 #include "doc/conversion_she.h"
 #include "doc/image.h"
@@ -27,84 +25,45 @@
 #include "doc/sprite.h"
 #include "she/system.h"
 
+#include <algorithm>
+
 #define MAX_THUMBNAIL_SIZE              128
 
+// Maximum number of threads generating thumbnails at the same time
+#define MAX_THUMBNAIL_THREADS           4
+
 namespace app {
 
 class ThumbnailGenerator::Worker {
 public:
   Worker(FileOp* fop, IFileItem* fileitem)
     : m_fop(fop)
-    , m_fileitem(fileitem)
-    , m_thumbnail(nullptr)
-    , m_palette(nullptr)
-    , m_thread(base::Bind<void>(&Worker::loadBgThread, this)) {
-  }
-
-  ~Worker() {
-    m_fop->stop();
-    m_thread.join();
+    , m_fileitem(fileitem) {
   }
 
   IFileItem* getFileItem() { return m_fileitem; }
   bool isDone() const { return m_fop->isDone(); }
   double getProgress() const { return m_fop->progress(); }
+  void stop() { m_fop->stop(); }
 
-private:
-  void loadBgThread() {
+  // Generates the thumbnail (from the cache or loading the file).
+  // It's called from one of the generator threads.
+  void generate(const ThumbnailCache& cache) {
     try {
-      m_fop->operate(nullptr);
-
-      // Post load
-      m_fop->postLoad();
-
-      // Convert the loaded document into the she::Surface.
-      const Sprite* sprite =
-        (m_fop->document() &&
-         m_fop->document()->sprite() ?
-         m_fop->document()->sprite(): nullptr);
-
-      if (!m_fop->isStop() && sprite) {
-        // The palette to convert the Image
-        m_palette = sprite->palette(frame_t(0))->clone();
-
-        // Render first frame of the sprite in 'image'
-        std::unique_ptr<Image> image(Image::create(
-            IMAGE_RGB, sprite->width(), sprite->height()));
-
-        AppRender render;
-        render.setupBackground(NULL, image->pixelFormat());
-        render.setBgType(render::BgType::CHECKED);
-        render.renderSprite(image.get(), sprite, frame_t(0));
-
-        // Calculate the thumbnail size
-        int thumb_w = MAX_THUMBNAIL_SIZE * image->width() / MAX(image->width(), image->height());
-        int thumb_h = MAX_THUMBNAIL_SIZE * image->height() / MAX(image->width(), image->height());
-        if (MAX(thumb_w, thumb_h) > MAX(image->width(), image->height())) {
-          thumb_w = image->width();
-          thumb_h = image->height();
-        }
-        thumb_w = MID(1, thumb_w, MAX_THUMBNAIL_SIZE);
-        thumb_h = MID(1, thumb_h, MAX_THUMBNAIL_SIZE);
-
-        // Stretch the 'image'
-        m_thumbnail.reset(Image::create(image->pixelFormat(), thumb_w, thumb_h));
-        clear_image(m_thumbnail.get(), 0);
-        algorithm::scale_image(m_thumbnail.get(), image.get(),
-                               0, 0, thumb_w, thumb_h,
-                               0, 0, image->width(), image->height());
+      m_thumbnail.reset(cache.load(m_fop->filename()));
+      if (!m_thumbnail) {
+        loadThumbnail();
+        if (m_thumbnail && !m_fop->isStop())
+          cache.save(m_fop->filename(), m_thumbnail.get());
       }
 
-      // Close file
-      delete m_fop->releaseDocument();
-
       // Set the thumbnail of the file-item.
-      if (m_thumbnail) {
+      if (m_thumbnail && !m_fop->isStop()) {
         she::Surface* thumbnail = she::instance()->createRgbaSurface(
           m_thumbnail->width(),
           m_thumbnail->height());
 
-        convert_image_to_surface(m_thumbnail.get(), m_palette.get(), thumbnail,
+        convert_image_to_surface(m_thumbnail.get(), nullptr, thumbnail,
           0, 0, 0, 0, m_thumbnail->width(), m_thumbnail->height());
 
         m_fileitem->setThumbnail(thumbnail);
@@ -116,11 +75,54 @@ private:
     m_fop->done();
   }
 
+private:
+  void loadThumbnail() {
+    m_fop->operate(nullptr);
+
+    // Post load
+    m_fop->postLoad();
+
+    // Convert the loaded document into the she::Surface.
+    const Sprite* sprite =
+      (m_fop->document() &&
+       m_fop->document()->sprite() ?
+       m_fop->document()->sprite(): nullptr);
+
+    if (!m_fop->isStop() && sprite) {
+      // Render first frame of the sprite in 'image'
+      std::unique_ptr<Image> image(Image::create(
+          IMAGE_RGB, sprite->width(), sprite->height()));
+
+      AppRender render;
+      render.setupBackground(NULL, image->pixelFormat());
+      render.setBgType(render::BgType::CHECKED);
+      render.renderSprite(image.get(), sprite, frame_t(0));
+
+      // Calculate the thumbnail size
+      int thumb_w = MAX_THUMBNAIL_SIZE * image->width() / MAX(image->width(), image->height());
+      int thumb_h = MAX_THUMBNAIL_SIZE * image->height() / MAX(image->width(), image->height());
+      if (MAX(thumb_w, thumb_h) > MAX(image->width(), image->height())) {
+        thumb_w = image->width();
+        thumb_h = image->height();
+      }
+      thumb_w = MID(1, thumb_w, MAX_THUMBNAIL_SIZE);
+      thumb_h = MID(1, thumb_h, MAX_THUMBNAIL_SIZE);
+
+      // Stretch the 'image'
+      m_thumbnail.reset(Image::create(image->pixelFormat(), thumb_w, thumb_h));
+      clear_image(m_thumbnail.get(), 0);
+      algorithm::scale_image(m_thumbnail.get(), image.get(),
+                             0, 0, thumb_w, thumb_h,
+                             0, 0, image->width(), image->height());
+    }
+
+    // Close file
+    delete m_fop->releaseDocument();
+  }
+
   std::unique_ptr<FileOp> m_fop;
   IFileItem* m_fileitem;
   std::unique_ptr<Image> m_thumbnail;
-  std::shared_ptr<Palette> m_palette;
-  base::thread m_thread;
 };
 
 static void delete_singleton(ThumbnailGenerator* singleton)
@@ -138,9 +140,33 @@ ThumbnailGenerator* ThumbnailGenerator::instance()
   return singleton;
 }
 
+ThumbnailGenerator::ThumbnailGenerator()
+  : m_stop(false)
+{
+  int n = MID(1, int(std::thread::hardware_concurrency()) / 2, MAX_THUMBNAIL_THREADS);
+  for (int i=0; i<n; ++i)
+    m_threads.emplace_back([this]{ threadProc(); });
+}
+
+ThumbnailGenerator::~ThumbnailGenerator()
+{
+  stopAllWorkers();
+  {
+    std::lock_guard<std::mutex> hold(m_workersAccess);
+    m_stop = true;
+  }
+  m_workerAvailable.notify_all();
+
+  for (auto& thread : m_threads)
+    thread.join();
+
+  for (Worker* worker : m_workers)
+    delete worker;
+}
+
 ThumbnailGenerator::WorkerStatus ThumbnailGenerator::getWorkerStatus(IFileItem* fileitem, double& progress)
 {
-  base::scoped_lock hold(m_workersAccess);
+  std::lock_guard<std::mutex> hold(m_workersAccess);
 
   for (WorkerList::iterator
          it=m_workers.begin(), end=m_workers.end(); it!=end; ++it) {
@@ -159,7 +185,7 @@ ThumbnailGenerator::WorkerStatus ThumbnailGenerator::getWorkerStatus(IFileItem*
 
 bool ThumbnailGenerator::checkWorkers()
 {
-  base::scoped_lock hold(m_workersAccess);
+  std::lock_guard<std::mutex> hold(m_workersAccess);
   bool doingWork = !m_workers.empty();
 
   for (WorkerList::iterator
@@ -176,15 +202,31 @@ bool ThumbnailGenerator::checkWorkers()
   return doingWork;
 }
 
-void ThumbnailGenerator::addWorkerToGenerateThumbnail(IFileItem* fileitem)
+void ThumbnailGenerator::addWorkerToGenerateThumbnail(IFileItem* fileitem, bool urgent)
 {
   double progress;
 
   if (fileitem->isBrowsable() ||
-      fileitem->getThumbnail() != NULL ||
-      getWorkerStatus(fileitem, progress) != WithoutWorker)
+      fileitem->getThumbnail() != NULL)
     return;
 
+  if (getWorkerStatus(fileitem, progress) != WithoutWorker) {
+    // Move the pending worker to the front of the queue
+    if (urgent) {
+      std::lock_guard<std::mutex> hold(m_workersAccess);
+      auto it = std::find_if(m_pending.begin(), m_pending.end(),
+                             [fileitem](Worker* worker) {
+                               return worker->getFileItem() == fileitem;
+                             });
+      if (it != m_pending.end()) {
+        Worker* worker = *it;
+        m_pending.erase(it);
+        m_pending.push_front(worker);
+      }
+    }
+    return;
+  }
+
   std::unique_ptr<FileOp> fop(
     FileOp::createLoadDocumentOperation(
       nullptr,
@@ -197,34 +239,70 @@ void ThumbnailGenerator::addWorkerToGenerateThumbnail(IFileItem* fileitem)
   if (fop->hasError())
     return;
 
-  Worker* worker = new Worker(fop.release(), fileitem);
-  try {
-    base::scoped_lock hold(m_workersAccess);
-    m_workers.push_back(worker);
+  // Formats that support it can decode a reduced first frame
+  fop->setPreviewSize(MAX_THUMBNAIL_SIZE);
+
+  std::unique_ptr<Worker> worker(new Worker(fop.release(), fileitem));
+  {
+    std::lock_guard<std::mutex> hold(m_workersAccess);
+    m_workers.push_back(worker.get());
+    if (urgent)
+      m_pending.push_front(worker.release());
+    else
+      m_pending.push_back(worker.release());
   }
-  catch (...) {
-    delete worker;
-    throw;
+  m_workerAvailable.notify_one();
+}
+
+void ThumbnailGenerator::cancelWorkersExcept(const std::set<IFileItem*>& fileitems)
+{
+  std::lock_guard<std::mutex> hold(m_workersAccess);
+  for (Worker* worker : WorkerList(m_workers)) {
+    if (fileitems.find(worker->getFileItem()) == fileitems.end())
+      cancelWorker(worker);
   }
 }
 
 void ThumbnailGenerator::stopAllWorkers()
 {
-  base::thread* ptr = new base::thread(base::Bind<void>(&ThumbnailGenerator::stopAllWorkersBackground, this));
-  m_stopThread.reset(ptr);
+  std::lock_guard<std::mutex> hold(m_workersAccess);
+  for (Worker* worker : WorkerList(m_workers))
+    cancelWorker(worker);
 }
 
-void ThumbnailGenerator::stopAllWorkersBackground()
+// Pending workers are destroyed, and running ones are stopped (they
+// will be destroyed in checkWorkers() when they are done). The
+// m_workersAccess must be locked.
+void ThumbnailGenerator::cancelWorker(Worker* worker)
 {
-  WorkerList workersCopy;
-  {
-    base::scoped_lock hold(m_workersAccess);
-    workersCopy = m_workers;
-    m_workers.clear();
+  auto it = std::find(m_pending.begin(), m_pending.end(), worker);
+  if (it != m_pending.end()) {
+    m_pending.erase(it);
+    m_workers.erase(std::find(m_workers.begin(), m_workers.end(), worker));
+    delete worker;
+  }
+  else {
+    worker->stop();
   }
+}
 
-  for (auto it=workersCopy.begin(), end=workersCopy.end(); it!=end; ++it)
-    delete *it;
+void ThumbnailGenerator::threadProc()
+{
+  while (true) {
+    Worker* worker;
+    {
+      std::unique_lock<std::mutex> lock(m_workersAccess);
+      m_workerAvailable.wait(lock, [this]{ return m_stop || !m_pending.empty(); });
+      if (m_stop)
+        return;
+
+      worker = m_pending.front();
+      m_pending.pop_front();
+    }
+
+    // The worker cannot be deleted until it's done
+    worker->generate(m_cache);
+  }
 }
 
 } // namespace app
@@ -7,15 +7,15 @@
 
 #pragma once
 
-#include "base/mutex.h"
+#include "app/thumbnail_cache.h"
 
-#include <memory>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <vector>
 
-namespace base {
-  class thread;
-}
-
 namespace app {
   class IFileItem;
 
@@ -25,9 +25,16 @@ namespace app {
 
     static ThumbnailGenerator* instance();
 
+    ~ThumbnailGenerator();
+
     // Generate a thumbnail for the given file-item.  It must be called
-    // from the GUI thread.
-    void addWorkerToGenerateThumbnail(IFileItem* fileitem);
+    // from the GUI thread. Urgent thumbnails (e.g. the selected item)
+    // are generated before the others (e.g. visible items).
+    void addWorkerToGenerateThumbnail(IFileItem* fileitem, bool urgent = true);
+
+    // Cancels the generation of thumbnails for all file-items that
+    // are not in the given set (e.g. items scrolled out of view).
+    void cancelWorkersExcept(const std::set<IFileItem*>& fileitems);
 
     // Returns the status of the worker that is generating the thumbnail
     // for the given file.
@@ -35,23 +42,31 @@ namespace app {
 
     // Checks the status of workers. If there are workers that already
     // done its job, we've to destroy them. This function must be called
-    // from the GUI thread (because a thread is joint to it).
+    // from the GUI thread.
     // Returns true if there are workers generating thumbnails.
     bool checkWorkers();
 
     // Stops all workers generating thumbnails. This is an non-blocking
-    // operation. The cancelation of all workers is done in a background
-    // thread.
+    // operation: pending workers are discarded and running ones are
+    // stopped (they are destroyed later in checkWorkers()).
     void stopAllWorkers();
 
   private:
-    void stopAllWorkersBackground();
-
     class Worker;
     typedef std::vector<Worker*> WorkerList;
 
+    ThumbnailGenerator();
+    void threadProc();
+    void cancelWorker(Worker* worker);
+
+    // All workers (pending, running, or done)
     WorkerList m_workers;
-    base::mutex m_workersAccess;
-    std::unique_ptr<base::thread> m_stopThread;
+    // Workers waiting for a free thread
+    std::deque<Worker*> m_pending;
+    std::mutex m_workersAccess;
+    std::condition_variable m_workerAvailable;
+    std::vector<std::thread> m_threads;
+    bool m_stop;
+    ThumbnailCache m_cache;
   };
 } // namespace app
@@ -22,6 +22,13 @@ namespace app {
       virtual bool isSpray() { return false; }
       virtual void preparePointShape(ToolLoop* loop) { }
 
+      // Called before and after transforming all points of a step of
+      // the tool loop. Between these calls transformPoint() can
+      // accumulate the covered pixels to call the ink just one time
+      // for each pixel in endPoints().
+      virtual void beginPoints(ToolLoop* loop) { }
+      virtual void endPoints(ToolLoop* loop) { }
+
       // The x, y position must be relative to the cel/src/dst image origin.
       virtual void transformPoint(ToolLoop* loop, int x, int y, float pressure) = 0;
       virtual void getModifiedArea(ToolLoop* loop, int x, int y, gfx::Rect& area) = 0;
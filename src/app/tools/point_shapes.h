@@ -8,6 +8,7 @@
 #pragma once
 
 #include "app/tools/point_shape.h"
+#include "app/tools/stamp_coverage.h"
 #include "app/tools/tool_loop.h"
 #include "doc/brush.h"
 #include "doc/compressed_image.h"
@@ -41,10 +42,18 @@ public:
 class BrushPointShape : public PointShape {
   doc::Brush* m_brush;
   doc::CompressedImage m_compressedImage;
+  StampCoverage m_coverage;
   bool m_firstPoint;
+  bool m_accumulate;
   int m_brushGen;
 
 public:
+  BrushPointShape()
+    : m_brush(nullptr)
+    , m_firstPoint(true)
+    , m_accumulate(false)
+    , m_brushGen(0) {
+  }
 
   void preparePointShape(ToolLoop* loop) override {
     m_brush = loop->getBrush();
@@ -52,6 +61,24 @@ public:
     m_firstPoint = true;
   }
 
+  void beginPoints(ToolLoop* loop) override {
+    m_coverage.clear();
+
+    // With the "paint brush" pattern each stamp has its own pattern
+    // origin, so stamps cannot be merged.
+    m_accumulate =
+      !(m_brush->type() == kImageBrushType &&
+        m_brush->pattern() == BrushPattern::PAINT_BRUSH);
+  }
+
+  void endPoints(ToolLoop* loop) override {
+    m_accumulate = false;
+    m_coverage.forEachHline([loop](int x1, int y, int x2) {
+      doInkHline(x1, y, x2, loop);
+    });
+    m_coverage.clear();
+  }
+
   void transformPoint(ToolLoop* loop, int x, int y, float pressure) override {
     auto srcImage = m_brush->image(pressure);
     if (!srcImage)
@@ -83,7 +110,10 @@ public:
 
     for (auto& scanline : m_compressedImage) {
       int u = x+scanline.x;
-      doInkHline(u, y+scanline.y, u+scanline.w-1, loop);
+      if (m_accumulate)
+        m_coverage.addHline(u, y+scanline.y, u+scanline.w-1);
+      else
+        doInkHline(u, y+scanline.y, u+scanline.w-1, loop);
     }
   }
 
@@ -157,6 +187,14 @@ public:
     m_subPointShape.preparePointShape(loop);
   }
 
+  void beginPoints(ToolLoop* loop) override {
+    m_subPointShape.beginPoints(loop);
+  }
+
+  void endPoints(ToolLoop* loop) override {
+    m_subPointShape.endPoints(loop);
+  }
+
   void transformPoint(ToolLoop* loop, int x, int y, float pressure) override {
     int spray_width = loop->getSprayWidth();
     int spray_speed = loop->getSpraySpeed();
@@ -0,0 +1,47 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/tools/stamp_coverage.h"
+
+#include <algorithm>
+
+namespace app {
+namespace tools {
+
+void StampCoverage::addHline(int x1, int y, int x2)
+{
+  if (x1 > x2)
+    return;
+
+  Spans& spans = m_rows[y];
+
+  // First span that overlaps or touches the new one, and the spans
+  // after it that can be joined
+  auto first = std::lower_bound(
+    spans.begin(), spans.end(), x1,
+    [](const Span& span, int x) { return span.x2+1 < x; });
+  auto last = first;
+  for (; last != spans.end() && last->x1 <= x2+1; ++last) {
+    x1 = std::min(x1, last->x1);
+    x2 = std::max(x2, last->x2);
+  }
+
+  if (first == last)
+    spans.insert(first, Span{ x1, x2 });
+  else {
+    first->x1 = x1;
+    first->x2 = x2;
+    spans.erase(first+1, last);
+  }
+}
+
+} // namespace tools
+} // namespace app
@@ -0,0 +1,52 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+namespace app {
+  namespace tools {
+
+    // Union of the scanlines of several brush stamps. Consecutive
+    // stamps of a stroke overlap almost completely, so instead of
+    // calling the ink for each scanline of each stamp, the scanlines
+    // are accumulated here and the ink is called just one time for
+    // each covered pixel.
+    //
+    // Scanlines are merged as they are added (each row keeps a sorted
+    // list of separated spans), so the memory used is bounded by the
+    // covered area, not by the number of stamps.
+    class StampCoverage {
+    public:
+      bool empty() const { return m_rows.empty(); }
+      void clear() { m_rows.clear(); }
+
+      void addHline(int x1, int y, int x2);
+
+      // Calls func(x1, y, x2) for each horizontal line of the union
+      // (sorted by y and x, and without overlapping pixels).
+      template<typename Func>
+      void forEachHline(Func&& func) const {
+        for (const auto& row : m_rows)
+          for (const auto& span : row.second)
+            func(span.x1, row.first, span.x2);
+      }
+
+    private:
+      struct Span {
+        int x1, x2;
+      };
+      typedef std::vector<Span> Spans;
+
+      // Spans of each row (y coordinate)
+      std::map<int, Spans> m_rows;
+    };
+
+  } // namespace tools
+} // namespace app
@@ -0,0 +1,94 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/test.h"
+
+#include "app/tools/stamp_coverage.h"
+
+#include <tuple>
+#include <vector>
+
+using namespace app::tools;
+
+typedef std::vector<std::tuple<int, int, int>> Hlines;
+
+static Hlines hlines_of(StampCoverage& coverage)
+{
+  Hlines result;
+  coverage.forEachHline([&](int x1, int y, int x2) {
+    result.emplace_back(x1, y, x2);
+  });
+  return result;
+}
+
+TEST(StampCoverage, Empty)
+{
+  StampCoverage coverage;
+  EXPECT_TRUE(coverage.empty());
+  EXPECT_TRUE(hlines_of(coverage).empty());
+
+  coverage.addHline(5, 0, 4);
+  EXPECT_TRUE(coverage.empty());
+}
+
+TEST(StampCoverage, OverlappedStamps)
+{
+  StampCoverage coverage;
+
+  // A 3x2 stamp moved one pixel to the right three times
+  for (int x=0; x<3; ++x) {
+    coverage.addHline(x, 0, x+2);
+    coverage.addHline(x, 1, x+2);
+  }
+
+  Hlines expected = { {0, 0, 4}, {0, 1, 4} };
+  EXPECT_EQ(expected, hlines_of(coverage));
+}
+
+TEST(StampCoverage, SeparatedHlines)
+{
+  StampCoverage coverage;
+  coverage.addHline(10, 2, 12);
+  coverage.addHline(0, 1, 3);
+  coverage.addHline(5, 1, 6);
+  coverage.addHline(4, 1, 4);
+  coverage.addHline(0, 2, 1);
+  coverage.addHline(11, 2, 20);
+
+  Hlines expected = { {0, 1, 6}, {0, 2, 1}, {10, 2, 20} };
+  EXPECT_EQ(expected, hlines_of(coverage));
+
+  coverage.clear();
+  EXPECT_TRUE(coverage.empty());
+}
+
+TEST(StampCoverage, JoinSeveralSpans)
+{
+  StampCoverage coverage;
+  coverage.addHline(0, 0, 1);
+  coverage.addHline(5, 0, 6);
+  coverage.addHline(10, 0, 11);
+  coverage.addHline(20, 0, 21);
+  coverage.addHline(2, 0, 9);
+
+  Hlines expected = { {0, 0, 11}, {20, 0, 21} };
+  EXPECT_EQ(expected, hlines_of(coverage));
+}
+
+TEST(StampCoverage, StampsOfAFilledShape)
+{
+  StampCoverage coverage;
+
+  // The same rows are covered again and again by stamps that aren't
+  // consecutive (e.g. when a shape is filled with a brush)
+  for (int i=0; i<100; ++i)
+    for (int y=0; y<4; ++y)
+      coverage.addHline((i*7) % 50, y, (i*7) % 50 + 2);
+
+  Hlines expected = { {0, 0, 51}, {0, 1, 51}, {0, 2, 51}, {0, 3, 51} };
+  EXPECT_EQ(expected, hlines_of(coverage));
+}
@@ -189,10 +189,13 @@ void ToolLoopManager::doLoopStep(bool last_step)
   m_toolLoop->validateDstImage(m_dirtyArea);
 
   // Join or fill user points
+  PointShape* pointShape = m_toolLoop->getPointShape();
+  pointShape->beginPoints(m_toolLoop);
   if (!m_toolLoop->getFilled() || (!last_step && !m_toolLoop->getPreviewFilled()))
     m_toolLoop->getIntertwine()->joinStroke(m_toolLoop, main_stroke);
   else
     m_toolLoop->getIntertwine()->fillStroke(m_toolLoop, main_stroke);
+  pointShape->endPoints(m_toolLoop);
 
   if (m_toolLoop->getTracePolicy() == TracePolicy::Overlap) {
     // Copy destination to source (yes, destination to source). In
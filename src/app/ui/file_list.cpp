@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <cctype>
 #include <cstring>
+#include <set>
 
 #define ISEARCH_KEYPRESS_INTERVAL_MSECS 500
 
@@ -331,11 +332,21 @@ void FileList::onPaint(ui::PaintEvent& ev)
 
   g->fillRect(theme->colors.background(), bounds);
 
+  // Visible area of the list to generate thumbnails of visible items
+  gfx::Rect vp = bounds;
+  if (View* view = View::getView(this))
+    vp = view->viewportBounds().offset(-this->bounds().origin());
+  FileItemList visibleItems;
+
   // rows
   m_thumbnail = nullptr;
   for (IFileItem* fi : m_list) {
     gfx::Size itemSize = getFileItemSize(fi);
 
+    if (!fi->isFolder() &&
+        vp.intersects(gfx::Rect(bounds.x, y, bounds.w, itemSize.h)))
+      visibleItems.push_back(fi);
+
     if (fi == m_selected) {
       fgcolor = theme->colors.filelistSelectedRowText();
       bgcolor = theme->colors.filelistSelectedRowFace();
@@ -392,6 +403,11 @@ void FileList::onPaint(ui::PaintEvent& ev)
     evenRow ^= 1;
   }
 
+  if (m_visibleItems != visibleItems) {
+    m_visibleItems = visibleItems;
+    m_generateThumbnailTimer.start();
+  }
+
   // Draw the thumbnail
   if (m_thumbnail) {
     gfx::Rect tbounds = thumbnailBounds();
@@ -464,9 +480,20 @@ void FileList::onGenerateThumbnailTick()
 {
   m_generateThumbnailTimer.stop();
 
+  ThumbnailGenerator* generator = ThumbnailGenerator::instance();
   IFileItem* fileitem = m_itemToGenerateThumbnail;
+
+  // Cancel thumbnails of items that are not visible anymore
+  std::set<IFileItem*> items(m_visibleItems.begin(), m_visibleItems.end());
+  if (fileitem)
+    items.insert(fileitem);
+  generator->cancelWorkersExcept(items);
+
+  // The selected item goes first, then the visible ones
   if (fileitem)
-    ThumbnailGenerator::instance()->addWorkerToGenerateThumbnail(fileitem);
+    generator->addWorkerToGenerateThumbnail(fileitem);
+  for (IFileItem* fi : m_visibleItems)
+    generator->addWorkerToGenerateThumbnail(fi, false);
 }
 
 gfx::Size FileList::getFileItemSize(IFileItem* fi) const
@@ -84,6 +84,10 @@ namespace app {
     // thumbnail to generate when the m_generateThumbnailTimer ticks.
     IFileItem* m_itemToGenerateThumbnail;
 
+    // Items visible in the view in the last onPaint(), their
+    // thumbnails are generated in background.
+    FileItemList m_visibleItems;
+
     she::Surface* m_thumbnail;
   };
 
@@ -28,6 +28,8 @@
 #include "doc/site.h"
 #include "doc/sprite.h"
 
+#include <vector>
+
 namespace {
 
 // We cannot have two ExpandCelCanvas instances at the same time
@@ -117,6 +119,9 @@ ExpandCelCanvas::ExpandCelCanvas(
   // draw this cel).
   m_cel->setPosition(m_bounds.x, m_bounds.y);
 
+  m_validSrcTiles.reset(m_bounds.size());
+  m_validDstTiles.reset(m_bounds.size());
+
   if (m_celCreated) {
     getDestCanvas();
     m_cel->data()->setImage(m_dstImage);
@@ -182,28 +187,27 @@ void ExpandCelCanvas::commit()
 
     ASSERT(m_cel->image() == m_celImage.get());
 
-    gfx::Region* regionToPatch = &m_validDstRegion;
-    gfx::Region reduced;
-
-    if (m_canCompareSrcVsDst) {
-      ASSERT(gfx::Region().createSubtraction(m_validDstRegion, m_validSrcRegion).isEmpty());
-
-      for (gfx::Rect rc : m_validDstRegion) {
-        if (algorithm::shrink_bounds2(getSourceCanvas(),
-                                      getDestCanvas(), rc, rc)) {
-          reduced |= gfx::Region(rc);
+    // Patch only the modified tiles
+    std::vector<gfx::Rect> rects;
+    m_validDstTiles.forEachTile(
+      true, [this, &rects](int col, int row) {
+        gfx::Rect rc = m_validDstTiles.tileBounds(col, row);
+        if (m_canCompareSrcVsDst) {
+          ASSERT(m_validSrcTiles.get(col, row));
+          if (!algorithm::shrink_bounds2(getSourceCanvas(),
+                                         getDestCanvas(), rc, rc))
+            return;
         }
-      }
-
-      regionToPatch = &reduced;
-    }
+        rects.push_back(rc);
+      });
+    gfx::Region regionToPatch(rects);
 
     if (m_layer->isBackground()) {
       m_transaction.execute(
         new cmd::CopyRegion(
           m_cel->image(),
           m_dstImage.get(),
-          *regionToPatch,
+          regionToPatch,
           m_bounds.origin()));
     }
     else {
@@ -211,7 +215,7 @@ void ExpandCelCanvas::commit()
         new cmd::PatchCel(
           m_cel,
           m_dstImage.get(),
-          *regionToPatch,
+          regionToPatch,
           m_bounds.origin()));
     }
   }
@@ -270,99 +274,81 @@ void ExpandCelCanvas::validateSourceCanvas(const gfx::Region& rgn)
 
   gfx::Region rgnToValidate(rgn);
   rgnToValidate.offset(-m_bounds.origin());
-  rgnToValidate.createSubtraction(rgnToValidate, m_validSrcRegion);
-  rgnToValidate.createIntersection(rgnToValidate, gfx::Region(m_srcImage->bounds()));
-
-  if (m_celImage) {
-    gfx::Region rgnToClear;
-    rgnToClear.createSubtraction(rgnToValidate,
-      gfx::Region(m_celImage->bounds()
-        .offset(m_origCelPos)
-        .offset(-m_bounds.origin())));
-    for (const auto& rc : rgnToClear)
-      fill_rect(m_srcImage.get(), rc, m_srcImage->maskColor());
 
-    for (const auto& rc : rgnToValidate)
-      m_srcImage->copy(m_celImage.get(),
-        gfx::Clip(rc.x, rc.y,
-          rc.x+m_bounds.x-m_origCelPos.x,
-          rc.y+m_bounds.y-m_origCelPos.y, rc.w, rc.h));
-  }
-  else {
-    for (const auto& rc : rgnToValidate)
-      fill_rect(m_srcImage.get(), rc, m_srcImage->maskColor());
+  for (const auto& rc : rgnToValidate) {
+    m_validSrcTiles.forEachTile(
+      rc, [this](int col, int row) {
+        if (!m_validSrcTiles.get(col, row)) {
+          copyCelToSource(m_validSrcTiles.tileBounds(col, row));
+          m_validSrcTiles.set(col, row, true);
+        }
+      });
   }
-
-  m_validSrcRegion.createUnion(m_validSrcRegion, rgnToValidate);
 }
 
 void ExpandCelCanvas::validateDestCanvas(const gfx::Region& rgn)
 {
-  Image* src;
-  int src_x, src_y;
-  if ((m_flags & NeedsSource) == NeedsSource) {
+  if ((m_flags & NeedsSource) == NeedsSource)
     validateSourceCanvas(rgn);
-    src = m_srcImage.get();
-    src_x = m_bounds.x;
-    src_y = m_bounds.y;
-  }
-  else {
-    src = m_celImage.get();
-    src_x = m_origCelPos.x;
-    src_y = m_origCelPos.y;
-  }
 
   getDestCanvas();
 
   gfx::Region rgnToValidate(rgn);
   rgnToValidate.offset(-m_bounds.origin());
-  rgnToValidate.createSubtraction(rgnToValidate, m_validDstRegion);
-  rgnToValidate.createIntersection(rgnToValidate, gfx::Region(m_dstImage->bounds()));
-
-  if (src) {
-    gfx::Region rgnToClear;
-    rgnToClear.createSubtraction(rgnToValidate,
-      gfx::Region(src->bounds()
-        .offset(src_x, src_y)
-        .offset(-m_bounds.origin())));
-    for (const auto& rc : rgnToClear)
-      fill_rect(m_dstImage.get(), rc, m_dstImage->maskColor());
 
-    for (const auto& rc : rgnToValidate)
-      m_dstImage->copy(src,
-        gfx::Clip(rc.x, rc.y,
-          rc.x+m_bounds.x-src_x,
-          rc.y+m_bounds.y-src_y, rc.w, rc.h));
-  }
-  else {
-    for (const auto& rc : rgnToValidate)
-      fill_rect(m_dstImage.get(), rc, m_dstImage->maskColor());
+  for (const auto& rc : rgnToValidate) {
+    m_validDstTiles.forEachTile(
+      rc, [this](int col, int row) {
+        if (!m_validDstTiles.get(col, row)) {
+          copySourceToDest(m_validDstTiles.tileBounds(col, row));
+          m_validDstTiles.set(col, row, true);
+        }
+      });
   }
-
-  m_validDstRegion.createUnion(m_validDstRegion, rgnToValidate);
 }
 
 void ExpandCelCanvas::invalidateDestCanvas()
 {
-  m_validDstRegion.clear();
+  m_validDstTiles.clear();
 }
 
 void ExpandCelCanvas::invalidateDestCanvas(const gfx::Region& rgn)
 {
+  // As tiles can be partially invalidated, we restore the source
+  // pixels of the given region right now in the already valid tiles.
+  if ((m_flags & NeedsSource) == NeedsSource)
+    validateSourceCanvas(rgn);
+
   gfx::Region rgnToInvalidate(rgn);
   rgnToInvalidate.offset(-m_bounds.origin());
-  m_validDstRegion.createSubtraction(m_validDstRegion, rgnToInvalidate);
+
+  for (const auto& rc : rgnToInvalidate) {
+    m_validDstTiles.forEachTile(
+      rc, [this, rc](int col, int row) {
+        if (m_validDstTiles.get(col, row))
+          copySourceToDest(rc.createIntersection(
+                             m_validDstTiles.tileBounds(col, row)));
+      });
+  }
 }
 
 void ExpandCelCanvas::copyValidDestToSourceCanvas(const gfx::Region& rgn)
 {
   gfx::Region rgn2(rgn);
   rgn2.offset(-m_bounds.origin());
-  rgn2.createIntersection(rgn2, m_validSrcRegion);
-  rgn2.createIntersection(rgn2, m_validDstRegion);
-  for (const auto& rc : rgn2)
-    m_srcImage->copy(m_dstImage.get(),
-      gfx::Clip(rc.x, rc.y, rc.x, rc.y, rc.w, rc.h));
+
+  for (const auto& rc : rgn2) {
+    m_validDstTiles.forEachTile(
+      rc, [this, rc](int col, int row) {
+        if (m_validSrcTiles.get(col, row) &&
+            m_validDstTiles.get(col, row)) {
+          gfx::Rect rc2 = rc.createIntersection(
+            m_validDstTiles.tileBounds(col, row));
+          m_srcImage->copy(m_dstImage.get(),
+            gfx::Clip(rc2.x, rc2.y, rc2.x, rc2.y, rc2.w, rc2.h));
+        }
+      });
+  }
 
   // We cannot compare src vs dst in this case (e.g. on tools like
   // spray and jumble that updated the source image form the modified
@@ -370,6 +356,61 @@ void ExpandCelCanvas::copyValidDestToSourceCanvas(const gfx::Region& rgn)
   m_canCompareSrcVsDst = false;
 }
 
+// Copies the original cel pixels in the given rectangle (in canvas
+// coordinates) of m_srcImage.
+void ExpandCelCanvas::copyCelToSource(const gfx::Rect& rc)
+{
+  if (m_celImage) {
+    gfx::Rect celBounds = m_celImage->bounds()
+      .offset(m_origCelPos)
+      .offset(-m_bounds.origin());
+    if (!celBounds.contains(rc))
+      fill_rect(m_srcImage.get(), rc, m_srcImage->maskColor());
+
+    m_srcImage->copy(m_celImage.get(),
+      gfx::Clip(rc.x, rc.y,
+        rc.x+m_bounds.x-m_origCelPos.x,
+        rc.y+m_bounds.y-m_origCelPos.y, rc.w, rc.h));
+  }
+  else {
+    fill_rect(m_srcImage.get(), rc, m_srcImage->maskColor());
+  }
+}
+
+// Resets the given rectangle (in canvas coordinates) of m_dstImage
+// with the source pixels.
+void ExpandCelCanvas::copySourceToDest(const gfx::Rect& rc)
+{
+  Image* src;
+  int src_x, src_y;
+  if ((m_flags & NeedsSource) == NeedsSource) {
+    src = m_srcImage.get();
+    src_x = m_bounds.x;
+    src_y = m_bounds.y;
+  }
+  else {
+    src = m_celImage.get();
+    src_x = m_origCelPos.x;
+    src_y = m_origCelPos.y;
+  }
+
+  if (src) {
+    gfx::Rect srcBounds = src->bounds()
+      .offset(src_x, src_y)
+      .offset(-m_bounds.origin());
+    if (!srcBounds.contains(rc))
+      fill_rect(m_dstImage.get(), rc, m_dstImage->maskColor());
+
+    m_dstImage->copy(src,
+      gfx::Clip(rc.x, rc.y,
+        rc.x+m_bounds.x-src_x,
+        rc.y+m_bounds.y-src_y, rc.w, rc.h));
+  }
+  else {
+    fill_rect(m_dstImage.get(), rc, m_dstImage->maskColor());
+  }
+}
+
 gfx::Rect ExpandCelCanvas::getTrimDstImageBounds() const
 {
   if (m_layer->isBackground())
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "app/util/tile_mask.h"
 #include "doc/frame.h"
 #include "doc/image_ref.h"
 #include "filters/tiled_mode.h"
@@ -69,6 +70,8 @@ namespace app {
     const Cel* getCel() const { return m_cel.get(); }
 
   private:
+    void copyCelToSource(const gfx::Rect& rc);
+    void copySourceToDest(const gfx::Rect& rc);
     gfx::Rect getTrimDstImageBounds() const;
     ImageRef trimDstImage(const gfx::Rect& bounds) const;
 
@@ -87,8 +90,9 @@ namespace app {
     bool m_closed;
     bool m_committed;
     Transaction& m_transaction;
-    gfx::Region m_validSrcRegion;
-    gfx::Region m_validDstRegion;
+    // Valid tiles of m_srcImage/m_dstImage (in canvas coordinates).
+    TileMask m_validSrcTiles;
+    TileMask m_validDstTiles;
 
     // True if we can compare src image with dst image to patch the
     // cel. This is false when dst is copied to the src, so we cannot
@@ -0,0 +1,86 @@
+// LibreSprite
+// Copyright (C) 2026  LibreSprite contributors
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#pragma once
+
+#include "gfx/rect.h"
+#include "gfx/size.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace app {
+
+  // Bitmap of fixed-size tiles that covers a canvas. It's used to
+  // track which parts of the canvas are valid/dirty with a constant
+  // cost per operation, instead of gfx::Region operations which get
+  // slower as the region gets fragmented.
+  class TileMask {
+  public:
+    static const int kTileSize = 32;
+
+    TileMask() : m_size(0, 0), m_cols(0), m_rows(0) { }
+
+    void reset(const gfx::Size& canvasSize) {
+      m_size = canvasSize;
+      m_cols = (canvasSize.w + kTileSize - 1) / kTileSize;
+      m_rows = (canvasSize.h + kTileSize - 1) / kTileSize;
+      m_tiles.assign(m_cols * m_rows, false);
+    }
+
+    void clear() {
+      std::fill(m_tiles.begin(), m_tiles.end(), false);
+    }
+
+    bool get(int col, int row) const {
+      return m_tiles[row*m_cols + col];
+    }
+
+    void set(int col, int row, bool state) {
+      m_tiles[row*m_cols + col] = state;
+    }
+
+    // Bounds of the given tile clipped to the canvas.
+    gfx::Rect tileBounds(int col, int row) const {
+      return gfx::Rect(col*kTileSize, row*kTileSize, kTileSize, kTileSize)
+        .createIntersection(gfx::Rect(m_size));
+    }
+
+    // Calls f(col, row) for each tile that intersects the given
+    // rectangle (in canvas coordinates).
+    template<typename F>
+    void forEachTile(const gfx::Rect& rect, F f) const {
+      gfx::Rect rc = rect.createIntersection(gfx::Rect(m_size));
+      if (rc.isEmpty())
+        return;
+
+      const int col1 = rc.x / kTileSize;
+      const int row1 = rc.y / kTileSize;
+      const int col2 = (rc.x2()-1) / kTileSize;
+      const int row2 = (rc.y2()-1) / kTileSize;
+      for (int row=row1; row<=row2; ++row)
+        for (int col=col1; col<=col2; ++col)
+          f(col, row);
+    }
+
+    // Calls f(col, row) for each tile in the "state" state.
+    template<typename F>
+    void forEachTile(bool state, F f) const {
+      for (int row=0; row<m_rows; ++row)
+        for (int col=0; col<m_cols; ++col)
+          if (get(col, row) == state)
+            f(col, row);
+    }
+
+  private:
+    gfx::Size m_size;
+    int m_cols;
+    int m_rows;
+    std::vector<bool> m_tiles;
+  };
+
+} // namespace app
@@ -26,6 +26,11 @@ namespace base {
 
   Time get_modification_time(const std::string& path);
 
+  // Returns a string that changes when the file is modified (its size
+  // and modification time with the best resolution available), or an
+  // empty string if the file doesn't exist.
+  std::string get_file_stamp(const std::string& path);
+
   void make_directory(const std::string& path);
   void make_all_directories(const std::string& path);
   void remove_directory(const std::string& path);
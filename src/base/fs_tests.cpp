@@ -8,6 +8,8 @@
 
 #include "base/fs.h"
 
+#include <fstream>
+
 using namespace base;
 
 TEST(FileSystem, MakeDirectory)
@@ -43,6 +45,22 @@ TEST(FileSystem, MakeAllDirectories)
   EXPECT_FALSE(is_directory("a"));
 }
 
+TEST(FileSystem, FileStamp)
+{
+  EXPECT_EQ("", get_file_stamp("stamp.txt"));
+
+  std::ofstream("stamp.txt") << "a";
+  std::string stamp1 = get_file_stamp("stamp.txt");
+  EXPECT_NE("", stamp1);
+  EXPECT_EQ(stamp1, get_file_stamp("stamp.txt"));
+
+  std::ofstream("stamp.txt") << "ab";
+  EXPECT_NE(stamp1, get_file_stamp("stamp.txt"));
+
+  delete_file("stamp.txt");
+  EXPECT_EQ("", get_file_stamp("stamp.txt"));
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
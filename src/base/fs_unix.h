@@ -108,6 +108,25 @@ Time get_modification_time(const std::string& path)
     t->tm_hour, t->tm_min, t->tm_sec);
 }
 
+std::string get_file_stamp(const std::string& path)
+{
+  struct stat sts;
+  if (stat(path.c_str(), &sts) != 0)
+    return std::string();
+
+#if __APPLE__
+  const struct timespec& mtime = sts.st_mtimespec;
+#else
+  const struct timespec& mtime = sts.st_mtim;
+#endif
+
+  char buf[128];
+  std::snprintf(buf, sizeof(buf), "%lld.%09ld|%lld",
+                (long long)mtime.tv_sec, (long)mtime.tv_nsec,
+                (long long)sts.st_size);
+  return buf;
+}
+
 void remove_directory(const std::string& path)
 {
   int result = rmdir(path.c_str());
@@ -4,6 +4,7 @@
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
 
+#include <cstdio>
 #include <stdexcept>
 #include <windows.h>
 #include <shlobj.h>
@@ -87,6 +88,23 @@ Time get_modification_time(const std::string& path)
     local.wHour, local.wMinute, local.wSecond);
 }
 
+std::string get_file_stamp(const std::string& path)
+{
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  ZeroMemory(&data, sizeof(data));
+
+  std::wstring fn = from_utf8(path);
+  if (!GetFileAttributesExW(fn.c_str(), GetFileExInfoStandard, (LPVOID)&data))
+    return std::string();
+
+  char buf[128];
+  std::snprintf(buf, sizeof(buf), "%08lx%08lx|%08lx%08lx",
+                data.ftLastWriteTime.dwHighDateTime,
+                data.ftLastWriteTime.dwLowDateTime,
+                data.nFileSizeHigh, data.nFileSizeLow);
+  return buf;
+}
+
 void make_directory(const std::string& path)
 {
   BOOL result = ::CreateDirectoryW(from_utf8(path).c_str(), NULL);
@@ -10,16 +10,31 @@
 
 #include "base/process.h"
 
+#include <mutex>
+
 #ifdef _WIN32
+#include "base/string.h"
+
+#include <thread>
 #include <windows.h>
 #else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #endif
 
 namespace base {
 
+// Pipes are created and inherited by the child process with this
+// mutex locked, so a child process created from other thread doesn't
+// inherit the pipes of this one (and the pipes are closed when the
+// child process finishes).
+static std::mutex spawn_mutex;
+
 #ifdef _WIN32
 
 pid get_current_process_id()
@@ -43,6 +58,110 @@ bool is_process_running(pid pid)
   return running;
 }
 
+static void read_pipe(HANDLE pipe, std::string& data)
+{
+  char buf[4096];
+  DWORD bytes;
+  while (ReadFile(pipe, buf, sizeof(buf), &bytes, NULL) && bytes > 0)
+    data.append(buf, bytes);
+}
+
+// Quotes an argument for CommandLineToArgvW()
+static std::wstring quote_argument(const std::wstring& arg)
+{
+  std::wstring result = L"\"";
+  int backslashes = 0;
+  for (wchar_t chr : arg) {
+    if (chr == L'\\') {
+      ++backslashes;
+      continue;
+    }
+    if (chr == L'"')
+      backslashes = 2*backslashes + 1;
+    result.append(backslashes, L'\\');
+    result.push_back(chr);
+    backslashes = 0;
+  }
+  result.append(2*backslashes, L'\\');
+  result.push_back(L'"');
+  return result;
+}
+
+int run_process(const std::vector<std::string>& args,
+                std::string& out,
+                std::string& err,
+                process_status* status)
+{
+  if (status)
+    *status = process_status::cannot_execute;
+  if (args.empty())
+    return -1;
+
+  std::wstring cmdline;
+  for (const auto& arg : args) {
+    if (!cmdline.empty())
+      cmdline.push_back(L' ');
+    cmdline += quote_argument(from_utf8(arg));
+  }
+
+  SECURITY_ATTRIBUTES sa;
+  sa.nLength = sizeof(sa);
+  sa.lpSecurityDescriptor = NULL;
+  sa.bInheritHandle = TRUE;
+
+  HANDLE outRead, outWrite, errRead, errWrite;
+  PROCESS_INFORMATION pi;
+  {
+    std::lock_guard<std::mutex> lock(spawn_mutex);
+
+    if (!CreatePipe(&outRead, &outWrite, &sa, 0))
+      return -1;
+    if (!CreatePipe(&errRead, &errWrite, &sa, 0)) {
+      CloseHandle(outRead);
+      CloseHandle(outWrite);
+      return -1;
+    }
+    SetHandleInformation(outRead, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(errRead, HANDLE_FLAG_INHERIT, 0);
+
+    STARTUPINFOW si;
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    si.hStdOutput = outWrite;
+    si.hStdError = errWrite;
+
+    BOOL created = CreateProcessW(
+      from_utf8(args[0]).c_str(), &cmdline[0],
+      NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi);
+
+    CloseHandle(outWrite);
+    CloseHandle(errWrite);
+
+    if (!created) {
+      CloseHandle(outRead);
+      CloseHandle(errRead);
+      return -1;
+    }
+  }
+
+  std::thread errThread([errRead, &err]{ read_pipe(errRead, err); });
+  read_pipe(outRead, out);
+  errThread.join();
+  CloseHandle(outRead);
+  CloseHandle(errRead);
+
+  DWORD exitCode = DWORD(-1);
+  WaitForSingleObject(pi.hProcess, INFINITE);
+  GetExitCodeProcess(pi.hProcess, &exitCode);
+  CloseHandle(pi.hProcess);
+  CloseHandle(pi.hThread);
+  if (status)
+    *status = process_status::exited;
+  return int(exitCode);
+}
+
 #else
 
 pid get_current_process_id()
@@ -55,6 +174,134 @@ bool is_process_running(pid pid)
   return (kill(pid, 0) == 0);
 }
 
+int run_process(const std::vector<std::string>& args,
+                std::string& out,
+                std::string& err,
+                process_status* status)
+{
+  if (status)
+    *status = process_status::cannot_execute;
+  if (args.empty())
+    return -1;
+
+  // The argv must be prepared before fork()
+  std::vector<char*> argv;
+  for (const auto& arg : args)
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  argv.push_back(nullptr);
+
+  // The child writes errno in "execPipe" if execv() fails (the pipe
+  // is closed without data when execv() succeeds, as it's
+  // FD_CLOEXEC).
+  int outPipe[2], errPipe[2], execPipe[2];
+  pid_t child;
+  {
+    std::lock_guard<std::mutex> lock(spawn_mutex);
+
+    if (pipe(outPipe) != 0)
+      return -1;
+    if (pipe(errPipe) != 0) {
+      close(outPipe[0]);
+      close(outPipe[1]);
+      return -1;
+    }
+    if (pipe(execPipe) != 0) {
+      close(outPipe[0]);
+      close(outPipe[1]);
+      close(errPipe[0]);
+      close(errPipe[1]);
+      return -1;
+    }
+    fcntl(outPipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(errPipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(execPipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(execPipe[1], F_SETFD, FD_CLOEXEC);
+
+    child = fork();
+    if (child == 0) {
+      dup2(outPipe[1], STDOUT_FILENO);
+      dup2(errPipe[1], STDERR_FILENO);
+      close(outPipe[1]);
+      close(errPipe[1]);
+      execv(argv[0], &argv[0]);
+
+      int error = errno;
+      ssize_t ignored = write(execPipe[1], &error, sizeof(error));
+      (void)ignored;
+      _exit(127);
+    }
+
+    close(outPipe[1]);
+    close(errPipe[1]);
+    close(execPipe[1]);
+  }
+
+  if (child < 0) {
+    close(outPipe[0]);
+    close(errPipe[0]);
+    close(execPipe[0]);
+    return -1;
+  }
+
+  // Wait until execv() is done
+  int execError = 0;
+  ssize_t execBytes;
+  while ((execBytes = read(execPipe[0], &execError, sizeof(execError))) < 0 &&
+         errno == EINTR)
+    ;
+  close(execPipe[0]);
+  bool executed = (execBytes == 0);
+
+  // Read both pipes until the child closes them
+  pollfd fds[2] = { { outPipe[0], POLLIN, 0 },
+                    { errPipe[0], POLLIN, 0 } };
+  std::string* data[2] = { &out, &err };
+  int pending = 2;
+  while (pending > 0) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    for (int i=0; i<2; ++i) {
+      if (fds[i].fd < 0 || fds[i].revents == 0)
+        continue;
+
+      char buf[4096];
+      ssize_t bytes = read(fds[i].fd, buf, sizeof(buf));
+      if (bytes > 0)
+        data[i]->append(buf, bytes);
+      else if (bytes == 0 || errno != EINTR) {
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        --pending;
+      }
+    }
+  }
+  for (int i=0; i<2; ++i)
+    if (fds[i].fd >= 0)
+      close(fds[i].fd);
+
+  int wstatus;
+  while (waitpid(child, &wstatus, 0) < 0) {
+    if (errno != EINTR)
+      return -1;
+  }
+
+  if (!executed)
+    return -1;
+
+  if (WIFSIGNALED(wstatus)) {
+    if (status)
+      *status = process_status::signaled;
+    return 128 + WTERMSIG(wstatus);
+  }
+
+  if (status)
+    *status = process_status::exited;
+  return (WIFEXITED(wstatus) ? WEXITSTATUS(wstatus): -1);
+}
+
 #endif
 
 } // namespace base
@@ -8,6 +8,9 @@
 
 #include "base/ints.h"
 
+#include <string>
+#include <vector>
+
 namespace base {
 
   typedef uint32_t pid;
@@ -16,4 +19,22 @@ namespace base {
 
   bool is_process_running(pid pid);
 
+  // How a program run with run_process() finished.
+  enum class process_status {
+    exited,                     // It returned an exit code
+    signaled,                   // It was terminated by a signal
+    cannot_execute,             // It couldn't be executed
+  };
+
+  // Runs the program args[0] with the given arguments and waits until
+  // it finishes. Its standard output and error are returned in "out"
+  // and "err". Returns the exit code of the program, 128+signal if it
+  // was terminated by a signal, or -1 if it couldn't be executed (see
+  // "status" to know which case it was). It can be called from any
+  // thread.
+  int run_process(const std::vector<std::string>& args,
+                  std::string& out,
+                  std::string& err,
+                  process_status* status = nullptr);
+
 } // namespace base
@@ -0,0 +1,57 @@
+// LibreSprite
+// Copyright (c) 2026 LibreSprite contributors
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/process.h"
+
+using namespace base;
+
+#ifndef _WIN32
+
+TEST(Process, RunProcess)
+{
+  std::string out, err;
+  int exitCode = run_process(
+    { "/bin/sh", "-c", "echo \"$0\"; echo error >&2; exit 3", "a b" },
+    out, err);
+
+  EXPECT_EQ(3, exitCode);
+  EXPECT_EQ("a b\n", out);
+  EXPECT_EQ("error\n", err);
+}
+
+TEST(Process, RunProcessNotFound)
+{
+  std::string out, err;
+  process_status status;
+  EXPECT_EQ(-1, run_process({ "/nonexistent/program" }, out, err, &status));
+  EXPECT_EQ(process_status::cannot_execute, status);
+}
+
+TEST(Process, RunProcessExitCode127)
+{
+  std::string out, err;
+  process_status status;
+  EXPECT_EQ(127, run_process({ "/bin/sh", "-c", "exit 127" }, out, err, &status));
+  EXPECT_EQ(process_status::exited, status);
+}
+
+TEST(Process, RunProcessSignaled)
+{
+  std::string out, err;
+  process_status status;
+  EXPECT_EQ(128+9, run_process({ "/bin/sh", "-c", "kill -9 $$" }, out, err, &status));
+  EXPECT_EQ(process_status::signaled, status);
+}
+
+#endif
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
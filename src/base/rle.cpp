@@ -0,0 +1,106 @@
+// LibreSprite
+// Copyright (c) 2026 LibreSprite contributors
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/rle.h"
+
+namespace base {
+
+// Minimum number of equal bytes to emit a run packet instead of
+// including them in a literal packet.
+static const std::size_t kMinRun = 3;
+
+static void write_header(buffer& output, std::size_t n)
+{
+  while (n >= 0x80) {
+    output.push_back(uint8_t(n | 0x80));
+    n >>= 7;
+  }
+  output.push_back(uint8_t(n));
+}
+
+static bool read_header(const buffer& input, std::size_t& pos, std::size_t& n)
+{
+  n = 0;
+  for (int shift=0; pos < input.size() && shift < 64; shift += 7) {
+    uint8_t b = input[pos++];
+    n |= std::size_t(b & 0x7f) << shift;
+    if ((b & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+static void write_literal(buffer& output, const uint8_t* p, std::size_t n)
+{
+  if (n == 0)
+    return;
+  write_header(output, n << 1);
+  output.insert(output.end(), p, p+n);
+}
+
+void encode_rle(const uint8_t* input, std::size_t size, buffer& output)
+{
+  output.clear();
+
+  const uint8_t* end = input+size;
+  const uint8_t* literal = input;
+  const uint8_t* p = input;
+
+  while (p < end) {
+    const uint8_t* q = p+1;
+    while (q < end && *q == *p)
+      ++q;
+
+    std::size_t run = std::size_t(q-p);
+    if (run >= kMinRun) {
+      write_literal(output, literal, std::size_t(p-literal));
+      write_header(output, (run << 1) | 1);
+      output.push_back(*p);
+      literal = q;
+    }
+    p = q;
+  }
+  write_literal(output, literal, std::size_t(end-literal));
+}
+
+void encode_rle(const buffer& input, buffer& output)
+{
+  encode_rle(input.data(), input.size(), output);
+}
+
+bool decode_rle(const buffer& input, buffer& output)
+{
+  output.clear();
+
+  std::size_t pos = 0;
+  while (pos < input.size()) {
+    std::size_t n;
+    if (!read_header(input, pos, n))
+      return false;
+
+    std::size_t count = (n >> 1);
+    if (n & 1) {
+      if (pos >= input.size())
+        return false;
+      output.insert(output.end(), count, input[pos++]);
+    }
+    else {
+      if (count > input.size() - pos)
+        return false;
+      output.insert(output.end(),
+                    input.begin()+pos,
+                    input.begin()+pos+count);
+      pos += count;
+    }
+  }
+  return true;
+}
+
+} // namespace base
@@ -0,0 +1,30 @@
+// LibreSprite
+// Copyright (c) 2026 LibreSprite contributors
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#pragma once
+
+#include "base/buffer.h"
+
+#include <cstddef>
+
+namespace base {
+
+// Fast byte-oriented run-length codec. It's designed for data with
+// long runs of repeated bytes (e.g. XOR deltas between two versions
+// of the same image, which are mostly zeros).
+//
+// The encoded stream is a sequence of packets, each one starting
+// with a variable-length header "n": if the lowest bit is 0, n>>1
+// literal bytes follow; if it's 1, the next byte is repeated n>>1
+// times.
+
+void encode_rle(const uint8_t* input, std::size_t size, buffer& output);
+void encode_rle(const buffer& input, buffer& output);
+
+// Returns false if the input is corrupted.
+bool decode_rle(const buffer& input, buffer& output);
+
+} // namespace base
@@ -0,0 +1,70 @@
+// LibreSprite
+// Copyright (c) 2026 LibreSprite contributors
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/rle.h"
+
+using namespace base;
+
+static buffer roundtrip(const buffer& input)
+{
+  buffer encoded, decoded;
+  encode_rle(input, encoded);
+  EXPECT_TRUE(decode_rle(encoded, decoded));
+  return decoded;
+}
+
+TEST(Rle, Empty)
+{
+  buffer encoded, decoded;
+  encode_rle(buffer(), encoded);
+  EXPECT_TRUE(encoded.empty());
+  EXPECT_TRUE(decode_rle(encoded, decoded));
+  EXPECT_TRUE(decoded.empty());
+}
+
+TEST(Rle, Literals)
+{
+  buffer data = { 1, 2, 3, 4, 5, 5, 6 };
+  EXPECT_EQ(data, roundtrip(data));
+}
+
+TEST(Rle, Runs)
+{
+  buffer data(10000, 0);
+  data[5000] = 7;
+  data[5001] = 8;
+
+  buffer encoded;
+  encode_rle(data, encoded);
+  EXPECT_GT(16u, encoded.size());
+  EXPECT_EQ(data, roundtrip(data));
+}
+
+TEST(Rle, Mixed)
+{
+  buffer data;
+  for (int i=0; i<1000; ++i) {
+    data.insert(data.end(), i % 7, uint8_t(i));
+    data.push_back(uint8_t(i*31));
+  }
+  EXPECT_EQ(data, roundtrip(data));
+}
+
+TEST(Rle, Corrupted)
+{
+  buffer decoded;
+  EXPECT_FALSE(decode_rle(buffer({ 10, 1 }), decoded)); // Literal too short
+  EXPECT_FALSE(decode_rle(buffer({ 3 }), decoded));     // Run without value
+  EXPECT_FALSE(decode_rle(buffer({ 0x80 }), decoded));  // Unfinished header
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
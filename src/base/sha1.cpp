@@ -12,6 +12,7 @@
 #include "base/sha1.h"
 #include "base/sha1_rfc3174.h"
 
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 
@@ -37,21 +38,16 @@ Sha1 Sha1::calculateFromFile(const std::string& fileName)
   if (!file.good())
     return Sha1();
 
-  SHA1Context sha;
-  SHA1Reset(&sha);
-
+  Builder builder;
   unsigned char buf[1024];
   while (file.good()) {
     file.read((char*)buf, 1024);
     unsigned int len = (unsigned int)file.gcount();
     if (len > 0)
-      SHA1Input(&sha, buf, len);
+      builder.add(buf, len);
   }
 
-  vector<uint8_t> digest(HashSize);
-  SHA1Result(&sha, &digest[0]);
-
-  return Sha1(digest);
+  return builder.result();
 }
 
 bool Sha1::operator==(const Sha1& other) const
@@ -64,4 +60,33 @@ bool Sha1::operator!=(const Sha1& other) const
   return m_digest != other.m_digest;
 }
 
+Sha1::Builder::Builder()
+  : m_context(new SHA1Context)
+{
+  SHA1Reset(m_context);
+}
+
+Sha1::Builder::~Builder()
+{
+  delete m_context;
+}
+
+void Sha1::Builder::add(const void* data, std::size_t size)
+{
+  const uint8_t* p = (const uint8_t*)data;
+  while (size > 0) {
+    unsigned int len = (unsigned int)std::min<std::size_t>(size, 0x10000000);
+    SHA1Input(m_context, p, len);
+    p += len;
+    size -= len;
+  }
+}
+
+Sha1 Sha1::Builder::result()
+{
+  std::vector<uint8_t> digest(HashSize);
+  SHA1Result(m_context, &digest[0]);
+  return Sha1(digest);
+}
+
 } // namespace base
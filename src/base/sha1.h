@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <string>
@@ -18,6 +19,26 @@ namespace base {
   public:
     enum { HashSize = 20 };
 
+    // Calculates the SHA1 of data given in several pieces.
+    class Builder {
+    public:
+      Builder();
+      ~Builder();
+
+      void add(const void* data, std::size_t size);
+      void add(const std::string& str) { add(str.data(), str.size()); }
+
+      // Returns the SHA1 of all added data (the builder cannot be
+      // used after this).
+      Sha1 result();
+
+    private:
+      SHA1Context* m_context;
+
+      Builder(const Builder&) = delete;
+      Builder& operator=(const Builder&) = delete;
+    };
+
     Sha1();
     explicit Sha1(const std::vector<uint8_t>& digest);
 
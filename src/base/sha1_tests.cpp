@@ -0,0 +1,50 @@
+// LibreSprite
+// Copyright (c) 2026 LibreSprite contributors
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/convert_to.h"
+#include "base/sha1.h"
+
+using namespace base;
+
+static std::string hex(const Sha1& sha1)
+{
+  return convert_to<std::string>(sha1);
+}
+
+TEST(Sha1, Builder)
+{
+  Sha1::Builder empty;
+  EXPECT_EQ("da39a3ee5e6b4b0d3255bfef95601890afd80709", hex(empty.result()));
+
+  Sha1::Builder abc;
+  abc.add("abc");
+  EXPECT_EQ("a9993e364706816aba3e25717850c26c9cd0d89d", hex(abc.result()));
+}
+
+TEST(Sha1, BuilderPieces)
+{
+  std::string data;
+  for (int i=0; i<5000; ++i)
+    data.push_back(char(i*7));
+
+  Sha1::Builder whole;
+  whole.add(data);
+
+  Sha1::Builder pieces;
+  pieces.add(data.substr(0, 1));
+  pieces.add(data.substr(1, 999));
+  pieces.add(data.data()+1000, 4000);
+
+  EXPECT_EQ(whole.result(), pieces.result());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,117 @@
+// LibreSprite
+// Copyright (c) 2026 LibreSprite contributors
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/thread_pool.h"
+
+#include <algorithm>
+
+namespace base {
+
+// True in threads created by thread_pool
+static thread_local bool worker_thread = false;
+
+thread_pool::thread_pool(std::size_t n)
+  : m_running(0)
+  , m_stop(false)
+{
+  if (n == 0)
+    n = default_size();
+
+  m_threads.reserve(n);
+  for (std::size_t i=0; i<n; ++i)
+    m_threads.emplace_back([this]{ worker(); });
+}
+
+thread_pool::~thread_pool()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobsDone.wait(lock, [this]{ return m_jobs.empty() && m_running == 0; });
+    m_stop = true;
+  }
+  m_jobAvailable.notify_all();
+
+  for (auto& thread : m_threads)
+    thread.join();
+}
+
+void thread_pool::execute(std::function<void()>&& func)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(std::move(func));
+  }
+  m_jobAvailable.notify_one();
+}
+
+void thread_pool::wait_all()
+{
+  std::exception_ptr exception;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobsDone.wait(lock, [this]{ return m_jobs.empty() && m_running == 0; });
+    std::swap(exception, m_exception);
+  }
+  if (exception)
+    std::rethrow_exception(exception);
+}
+
+// static
+std::size_t thread_pool::default_size()
+{
+  if (worker_thread)
+    return 1;
+
+  return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+// static
+bool thread_pool::is_worker_thread()
+{
+  return worker_thread;
+}
+
+void thread_pool::worker()
+{
+  worker_thread = true;
+
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_jobAvailable.wait(lock, [this]{ return m_stop || !m_jobs.empty(); });
+      if (m_jobs.empty())       // m_stop is true
+        return;
+
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+      ++m_running;
+    }
+
+    std::exception_ptr exception;
+    try {
+      job();
+    }
+    catch (...) {
+      exception = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (exception && !m_exception)
+        m_exception = exception;
+      --m_running;
+      if (m_jobs.empty() && m_running == 0)
+        m_jobsDone.notify_all();
+    }
+  }
+}
+
+} // namespace base
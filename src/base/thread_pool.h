@@ -0,0 +1,87 @@
+// LibreSprite
+// Copyright (c) 2026 LibreSprite contributors
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace base {
+
+  // Fixed-size pool of worker threads to run CPU-bound jobs
+  // (e.g. compress/decompress images) in parallel.
+  //
+  // Unlike app::TaskManager (which delivers results in the UI
+  // thread), this can be used from any thread (e.g. a FileOp running
+  // in background or in batch mode) to wait the completion of a set
+  // of jobs with wait_all().
+  class thread_pool {
+  public:
+    // Creates a pool with "n" threads, or one thread per hardware
+    // core if "n" is 0.
+    explicit thread_pool(std::size_t n = 0);
+
+    // Waits all pending jobs and stops the threads.
+    ~thread_pool();
+
+    std::size_t size() const { return m_threads.size(); }
+
+    void execute(std::function<void()>&& func);
+
+    // Waits until all jobs are finished. If some job threw an
+    // exception, the first one is re-thrown here.
+    void wait_all();
+
+    // Number of hardware cores, or 1 if it's called from a worker
+    // thread of some pool (nested pools, e.g. an encoder running in
+    // a worker of a parallel sequence export, would create
+    // cores*cores threads).
+    static std::size_t default_size();
+
+    // Returns true if the current thread is a worker of some pool.
+    static bool is_worker_thread();
+
+  private:
+    void worker();
+
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_jobAvailable;
+    std::condition_variable m_jobsDone;
+    std::size_t m_running;
+    bool m_stop;
+    std::exception_ptr m_exception;
+
+    DISABLE_COPYING(thread_pool);
+  };
+
+  // Calls f(i) for each i in [0, n) using the given pool, and waits
+  // for all of them. If it's called from a worker thread, all calls
+  // are done in the current thread (the CPU is already used by the
+  // other workers of the outer pool).
+  template<typename F>
+  void parallel_for(thread_pool& pool, std::size_t n, F f) {
+    if (thread_pool::is_worker_thread()) {
+      for (std::size_t i=0; i<n; ++i)
+        f(i);
+      return;
+    }
+
+    for (std::size_t i=0; i<n; ++i)
+      pool.execute([&f, i]{ f(i); });
+    pool.wait_all();
+  }
+
+} // namespace base
@@ -0,0 +1,80 @@
+// LibreSprite
+// Copyright (c) 2026 LibreSprite contributors
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/thread_pool.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace base;
+
+TEST(ThreadPool, ParallelFor)
+{
+  thread_pool pool(4);
+  EXPECT_EQ(4u, pool.size());
+
+  std::vector<int> values(1000, 0);
+  parallel_for(pool, values.size(), [&values](std::size_t i){
+    values[i] = int(i*2);
+  });
+
+  for (std::size_t i=0; i<values.size(); ++i)
+    EXPECT_EQ(int(i*2), values[i]);
+}
+
+TEST(ThreadPool, WaitAll)
+{
+  std::atomic<int> count(0);
+  thread_pool pool(3);
+  for (int i=0; i<100; ++i)
+    pool.execute([&count]{ ++count; });
+  pool.wait_all();
+  EXPECT_EQ(100, count);
+
+  // The pool can be reused
+  for (int i=0; i<100; ++i)
+    pool.execute([&count]{ ++count; });
+  pool.wait_all();
+  EXPECT_EQ(200, count);
+}
+
+TEST(ThreadPool, Exception)
+{
+  thread_pool pool(2);
+  pool.execute([]{ throw std::runtime_error("error"); });
+  EXPECT_THROW(pool.wait_all(), std::runtime_error);
+  EXPECT_NO_THROW(pool.wait_all());
+}
+
+TEST(ThreadPool, NestedPools)
+{
+  EXPECT_FALSE(thread_pool::is_worker_thread());
+
+  thread_pool pool(2);
+  std::atomic<int> count(0);
+  parallel_for(pool, 4, [&count](size_t){
+    EXPECT_TRUE(thread_pool::is_worker_thread());
+    EXPECT_EQ(1, thread_pool::default_size());
+
+    // The inner loop runs in the worker thread
+    thread_pool inner(thread_pool::default_size());
+    std::thread::id id = std::this_thread::get_id();
+    parallel_for(inner, 10, [&count, id](size_t){
+      EXPECT_EQ(id, std::this_thread::get_id());
+      ++count;
+    });
+  });
+  EXPECT_EQ(40, count);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -28,6 +28,7 @@ CelData::CelData(const ImageRef& image)
 CelData::CelData(const CelData& celData)
   : WithUserData(ObjectType::CelData)
   , m_image(celData.m_image)
+  , m_imageLoader(celData.m_imageLoader)
   , m_position(celData.m_position)
   , m_opacity(celData.m_opacity)
 {
@@ -38,6 +39,7 @@ void CelData::setImage(const ImageRef& image)
   ASSERT(image.get());
 
   m_image = image;
+  m_imageLoader.reset();
 }
 
 } // namespace doc
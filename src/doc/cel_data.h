@@ -7,6 +7,7 @@
 #pragma once
 
 #include "base/shared_ptr.h"
+#include "doc/image_loader.h"
 #include "doc/image_ref.h"
 #include "doc/object.h"
 #include "doc/with_user_data.h"
@@ -20,10 +21,27 @@ namespace doc {
 
     const gfx::Point& position() const { return m_position; }
     int opacity() const { return m_opacity; }
-    Image* image() const { return const_cast<Image*>(m_image.get()); };
-    ImageRef imageRef() const { return m_image; }
+    Image* image() const {
+      if (m_imageLoader)
+        m_imageLoader->load(m_image.get());
+      return const_cast<Image*>(m_image.get());
+    }
+    ImageRef imageRef() const {
+      image();
+      return m_image;
+    }
 
     void setImage(const ImageRef& image);
+
+    // The pixels of the image will be loaded with the given loader
+    // the first time the image is accessed.
+    void setImageLoader(const ImageLoaderRef& loader) { m_imageLoader = loader; }
+
+    // Returns true if the image was loaded with a loader and it
+    // failed (the image pixels are not valid).
+    bool imageLoadFailed() const {
+      return (m_imageLoader && m_imageLoader->failed());
+    }
     void setPosition(int x, int y) {
       m_position.x = x;
       m_position.y = y;
@@ -38,6 +56,7 @@ namespace doc {
 
   private:
     ImageRef m_image;
+    ImageLoaderRef m_imageLoader;
     gfx::Point m_position;      // X/Y screen position
     int m_opacity;              // Opacity level
   };
@@ -0,0 +1,102 @@
+// LibreSprite Document Library
+// Copyright (c) 2026 LibreSprite contributors
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/cel_data.h"
+#include "doc/image_loader.h"
+#include "doc/primitives.h"
+
+#include <memory>
+
+using namespace doc;
+
+namespace {
+
+  class FillLoader : public ImageLoader {
+  public:
+    FillLoader(color_t color) : m_color(color), m_calls(0) { }
+    int calls() const { return m_calls; }
+  protected:
+    void onLoad(Image* image) override {
+      ++m_calls;
+      clear_image(image, m_color);
+    }
+  private:
+    color_t m_color;
+    int m_calls;
+  };
+
+  class FailingLoader : public ImageLoader {
+  protected:
+    void onLoad(Image* image) override {
+      setFailed();
+    }
+  };
+
+}
+
+TEST(CelData, LazyImageLoader)
+{
+  ImageRef image(Image::create(IMAGE_INDEXED, 4, 4));
+  CelData celData(image);
+
+  auto loader = std::make_shared<FillLoader>(3);
+  celData.setImageLoader(loader);
+  EXPECT_EQ(0, loader->calls());
+
+  EXPECT_EQ(image.get(), celData.image());
+  EXPECT_EQ(1, loader->calls());
+  EXPECT_EQ(3, get_pixel(celData.image(), 2, 2));
+
+  // Copies share the same image and loader
+  CelData copy(celData);
+  EXPECT_EQ(image, copy.imageRef());
+  EXPECT_EQ(1, loader->calls());
+}
+
+TEST(CelData, SetImageDiscardsLoader)
+{
+  ImageRef image(Image::create(IMAGE_INDEXED, 4, 4));
+  CelData celData(image);
+
+  auto loader = std::make_shared<FillLoader>(3);
+  celData.setImageLoader(loader);
+
+  ImageRef newImage(Image::create(IMAGE_INDEXED, 2, 2));
+  clear_image(newImage.get(), 5);
+  celData.setImage(newImage);
+
+  EXPECT_EQ(5, get_pixel(celData.image(), 1, 1));
+  EXPECT_EQ(0, loader->calls());
+}
+
+TEST(CelData, FailedImageLoader)
+{
+  ImageRef image(Image::create(IMAGE_INDEXED, 4, 4));
+  CelData celData(image);
+  EXPECT_FALSE(celData.imageLoadFailed());
+
+  celData.setImageLoader(std::make_shared<FailingLoader>());
+  EXPECT_FALSE(celData.imageLoadFailed());
+
+  celData.image();
+  EXPECT_TRUE(celData.imageLoadFailed());
+
+  // A new image is valid
+  celData.setImage(ImageRef(Image::create(IMAGE_INDEXED, 2, 2)));
+  EXPECT_FALSE(celData.imageLoadFailed());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -19,6 +19,7 @@
 #include "doc/frame_tags.h"
 #include "doc/image.h"
 #include "doc/image_impl.h"
+#include "doc/image_loader.h"
 #include "doc/image_ref.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
@@ -6,29 +6,57 @@
 
 #pragma once
 
+#include "base/disable_copying.h"
 #include "base/ints.h"
 #include "base/shared_ptr.h"
 
-#include <vector>
+#include <algorithm>
 #include <cstddef>
+#include <cstdlib>
+#include <new>
 
 namespace doc {
 
+  // Memory of images. It's allocated with calloc() instead of
+  // filling it with zeros, so big blocks can be mapped lazily by the
+  // OS (e.g. pages of images that are decoded lazily are used only
+  // when their pixels are decoded).
   class ImageBuffer {
   public:
-    ImageBuffer(std::size_t size = 1) : m_buffer(size) {
+    ImageBuffer(std::size_t size = 1)
+      : m_size(size)
+      , m_buffer(allocate(size)) {
     }
 
-    std::size_t size() const { return m_buffer.size(); }
-    uint8_t* buffer() { return &m_buffer[0]; }
+    ~ImageBuffer() {
+      std::free(m_buffer);
+    }
+
+    std::size_t size() const { return m_size; }
+    uint8_t* buffer() { return m_buffer; }
 
     void resizeIfNecessary(std::size_t size) {
-      if (size > m_buffer.size())
-        m_buffer.resize(size);
+      if (size > m_size) {
+        uint8_t* buffer = allocate(size);
+        std::copy(m_buffer, m_buffer+m_size, buffer);
+        std::free(m_buffer);
+        m_buffer = buffer;
+        m_size = size;
+      }
     }
 
   private:
-    std::vector<uint8_t> m_buffer;
+    static uint8_t* allocate(std::size_t size) {
+      uint8_t* buffer = (uint8_t*)std::calloc(std::max<std::size_t>(size, 1), 1);
+      if (!buffer)
+        throw std::bad_alloc();
+      return buffer;
+    }
+
+    std::size_t m_size;
+    uint8_t* m_buffer;
+
+    DISABLE_COPYING(ImageBuffer);
   };
 
   typedef base::SharedPtr<ImageBuffer> ImageBufferPtr;
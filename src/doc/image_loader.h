@@ -0,0 +1,55 @@
+// LibreSprite Document Library
+// Copyright (c) 2026 LibreSprite contributors
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace doc {
+
+  class Image;
+
+  // Fills the pixels of an image on demand. It's used to open big
+  // files lazily: the image is created with its final size, but its
+  // pixels are decoded from the file the first time they are needed
+  // (see CelData::image()).
+  class ImageLoader {
+  public:
+    ImageLoader() : m_failed(false) { }
+    virtual ~ImageLoader() { }
+
+    // Loads the pixels of the given image, only the first time it's
+    // called. It can be called from different threads.
+    void load(Image* image) {
+      std::call_once(m_loaded, [this, image]{ onLoad(image); });
+    }
+
+    // Returns true if the pixels couldn't be loaded. In that case the
+    // image content is not the real one (the user is warned before
+    // saving it).
+    bool failed() const { return m_failed; }
+
+  protected:
+    // Must not throw exceptions (e.g. it should leave the image
+    // empty and call setFailed() if the pixels cannot be read).
+    virtual void onLoad(Image* image) = 0;
+
+    void setFailed() { m_failed = true; }
+
+  private:
+    std::once_flag m_loaded;
+    std::atomic<bool> m_failed;
+
+    DISABLE_COPYING(ImageLoader);
+  };
+
+  typedef std::shared_ptr<ImageLoader> ImageLoaderRef;
+
+} // namespace doc
@@ -10,19 +10,32 @@
 
 #include "gfx/packing_rects.h"
 
-#include "gfx/region.h"
 #include "gfx/size.h"
 
+#include <algorithm>
+#include <climits>
+
 namespace gfx {
 
+PackingRects::PackingRects()
+  : m_borderPadding(0)
+  , m_shapePadding(0)
+  , m_allowRotation(false)
+{
+}
+
 void PackingRects::add(const Size& sz)
 {
   m_rects.push_back(Rect(sz));
+  m_rotated.push_back(false);
+  m_pages.push_back(0);
 }
 
 void PackingRects::add(const Rect& rc)
 {
   m_rects.push_back(rc);
+  m_rotated.push_back(false);
+  m_pages.push_back(0);
 }
 
 Size PackingRects::bestFit()
@@ -33,7 +46,7 @@ Size PackingRects::bestFit()
   // be smaller than that.
   int neededArea = 0;
   for (const auto& rc : m_rects) {
-    neededArea += rc.w * rc.h;
+    neededArea += (rc.w+m_shapePadding) * (rc.h+m_shapePadding);
   }
 
   int w = 1;
@@ -66,33 +79,266 @@ bool PackingRects::pack(const Size& size)
 {
   m_bounds = Rect(size);
 
-  // We cannot sort m_rects because we want to 
-  std::vector<Rect*> rectPtrs(m_rects.size());
+  m_freeRects.clear();
+  addPage(m_freeRects, size);
+
+  for (std::size_t index : sortedByArea()) {
+    Rect best;
+    bool rotated;
+    if (!findPosition(m_freeRects, index, best, rotated))
+      return false; // There is not enough room for the rectangle
+
+    place(m_freeRects, index, best, rotated);
+    m_pages[index] = 0;
+  }
+
+  return true;
+}
+
+int PackingRects::packPages(const Size& size)
+{
+  // Use as few pages as possible...
+  int pages = packInPages(size, 0);
+
+  // ...and then try to distribute the rectangles in the same number
+  // of pages with a similar used area in each one.
+  if (pages > 1) {
+    Rects rects = m_rects;
+    std::vector<bool> rotated = m_rotated;
+    std::vector<int> rectPages = m_pages;
+    if (packInPages(size, pages) != pages) {
+      m_rects = rects;
+      m_rotated = rotated;
+      m_pages = rectPages;
+    }
+  }
+  if (pages == 0)
+    return 0;
+
+  // The bounds include all pages (with power of two dimensions)
+  Size used(0, 0);
+  for (const auto& rc : m_rects) {
+    used.w = std::max(used.w, rc.x2()+m_borderPadding);
+    used.h = std::max(used.h, rc.y2()+m_borderPadding);
+  }
+  Size bounds(1, 1);
+  while (bounds.w < used.w) bounds.w *= 2;
+  while (bounds.h < used.h) bounds.h *= 2;
+  m_bounds = Rect(0, 0,
+                  std::min(bounds.w, size.w),
+                  std::min(bounds.h, size.h));
+  return pages;
+}
+
+// Packs the rectangles in pages of the given size. If "pages" is 0,
+// each rectangle is placed in the first page where it fits (adding
+// pages as needed), in other case each rectangle is placed in the
+// page with less used area where it fits. Returns the number of
+// pages or 0 if some rectangle doesn't fit in a page.
+int PackingRects::packInPages(const Size& size, int pages)
+{
+  std::vector<Rects> freeRects(std::max(pages, 1));
+  std::vector<int> usedArea(freeRects.size(), 0);
+  for (auto& pageFreeRects : freeRects)
+    addPage(pageFreeRects, size);
+
+  std::vector<int> order;
+  for (std::size_t index : sortedByArea()) {
+    order.resize(freeRects.size());
+    for (int i=0; i<int(order.size()); ++i)
+      order[i] = i;
+
+    if (pages > 0) {
+      std::stable_sort(
+        order.begin(), order.end(),
+        [&usedArea](int a, int b) { return usedArea[a] < usedArea[b]; });
+    }
+
+    Rect best;
+    bool rotated = false;
+    int page = -1;
+    for (int i : order) {
+      if (findPosition(freeRects[i], index, best, rotated)) {
+        page = i;
+        break;
+      }
+    }
+
+    if (page < 0) {
+      if (pages > 0)
+        return 0;
+
+      // New page
+      freeRects.emplace_back();
+      usedArea.push_back(0);
+      addPage(freeRects.back(), size);
+
+      page = int(freeRects.size())-1;
+      if (!findPosition(freeRects[page], index, best, rotated))
+        return 0; // The rectangle is bigger than a page
+    }
+
+    place(freeRects[page], index, best, rotated);
+    m_pages[index] = page;
+    usedArea[page] += best.w*best.h;
+  }
+
+  return int(freeRects.size());
+}
+
+// Returns the indexes of the rectangles from the biggest to the
+// smallest one (we cannot sort m_rects because we want to keep the
+// same order given by the user).
+std::vector<std::size_t> PackingRects::sortedByArea() const
+{
+  std::vector<const Rect*> rectPtrs(m_rects.size());
   int i = 0;
   for (auto& rc : m_rects)
     rectPtrs[i++] = &rc;
-  std::sort(rectPtrs.begin(), rectPtrs.end(), by_area);
-
-  gfx::Region rgn(m_bounds);
-  for (auto rcPtr : rectPtrs) {
-    gfx::Rect& rc = *rcPtr;
-
-    for (int v=0; v<=m_bounds.h-rc.h; ++v) {
-      for (int u=0; u<=m_bounds.w-rc.w; ++u) {
-        gfx::Rect possible(u, v, rc.w, rc.h);
-        Region::Overlap overlap = rgn.contains(possible);
-        if (overlap == Region::In) {
-          rc = possible;
-          rgn.createSubtraction(rgn, gfx::Region(rc));
-          goto next_rc;
-        }
+  std::stable_sort(rectPtrs.begin(), rectPtrs.end(), by_area);
+
+  std::vector<std::size_t> indexes(rectPtrs.size());
+  for (std::size_t j=0; j<rectPtrs.size(); ++j)
+    indexes[j] = rectPtrs[j] - &m_rects[0];
+  return indexes;
+}
+
+// Adds the free area of a new page of the given size.
+void PackingRects::addPage(Rects& freeRects, const Size& size) const
+{
+  // Each rectangle uses its size plus the shape padding, so the
+  // available area includes the padding of the last row/column.
+  Rect available(size);
+  available.shrink(m_borderPadding);
+  available.w += m_shapePadding;
+  available.h += m_shapePadding;
+
+  if (!available.isEmpty())
+    freeRects.push_back(available);
+}
+
+// Finds the free rectangle with the best short side fit (the long
+// side and position are used to break ties) for the given rectangle.
+// Returns false if there is not enough room for it.
+bool PackingRects::findPosition(const Rects& freeRects,
+                                std::size_t index,
+                                Rect& best,
+                                bool& bestRotated) const
+{
+  // Logical size of the rectangle (without rotation)
+  const Rect& rc = m_rects[index];
+  Size sz(m_rotated[index] ? Size(rc.h, rc.w): rc.size());
+  Size padded(sz.w+m_shapePadding, sz.h+m_shapePadding);
+
+  int bestShort = INT_MAX;
+  int bestLong = INT_MAX;
+
+  for (const auto& fr : freeRects) {
+    for (int r=0; r<(m_allowRotation && sz.w != sz.h ? 2: 1); ++r) {
+      int w = (r ? padded.h: padded.w);
+      int h = (r ? padded.w: padded.h);
+      if (w > fr.w || h > fr.h)
+        continue;
+
+      int leftoverW = fr.w - w;
+      int leftoverH = fr.h - h;
+      int shortSide = std::min(leftoverW, leftoverH);
+      int longSide = std::max(leftoverW, leftoverH);
+
+      if (shortSide < bestShort ||
+          (shortSide == bestShort &&
+           (longSide < bestLong ||
+            (longSide == bestLong &&
+             (fr.y < best.y || (fr.y == best.y && fr.x < best.x)))))) {
+        best = Rect(fr.x, fr.y, w, h);
+        bestRotated = (r == 1);
+        bestShort = shortSide;
+        bestLong = longSide;
       }
     }
-    return false; // There is not enough room for "rc"
-  next_rc:;
   }
 
-  return true;
+  return (bestShort != INT_MAX);
+}
+
+// Places the rectangle in the given (padded) area.
+void PackingRects::place(Rects& freeRects, std::size_t index,
+                         const Rect& area, bool rotated)
+{
+  splitFreeRects(freeRects, area);
+
+  m_rotated[index] = rotated;
+  m_rects[index] = Rect(area.x, area.y,
+                        area.w-m_shapePadding,
+                        area.h-m_shapePadding);
+}
+
+// Removes the "used" area from all free rectangles, each intersected
+// free rectangle is replaced by the (maximal) rectangles around
+// "used". New free rectangles that are contained in other free
+// rectangle are discarded.
+void PackingRects::splitFreeRects(Rects& freeRects, const Rect& used)
+{
+  Rects newRects;
+
+  for (std::size_t i=0; i<freeRects.size(); ) {
+    const Rect fr = freeRects[i];
+    if (!fr.intersects(used)) {
+      ++i;
+      continue;
+    }
+
+    if (used.x > fr.x)
+      newRects.push_back(Rect(fr.x, fr.y, used.x-fr.x, fr.h));
+    if (used.x2() < fr.x2())
+      newRects.push_back(Rect(used.x2(), fr.y, fr.x2()-used.x2(), fr.h));
+    if (used.y > fr.y)
+      newRects.push_back(Rect(fr.x, fr.y, fr.w, used.y-fr.y));
+    if (used.y2() < fr.y2())
+      newRects.push_back(Rect(fr.x, used.y2(), fr.w, fr.y2()-used.y2()));
+
+    // Remove without keeping the order (it's not needed)
+    freeRects[i] = freeRects.back();
+    freeRects.pop_back();
+  }
+
+  // Old free rectangles cannot contain each other, so we only need
+  // to compare the new ones.
+  std::size_t oldCount = freeRects.size();
+  for (std::size_t i=0; i<newRects.size(); ++i) {
+    const Rect& rc = newRects[i];
+    bool contained = false;
+
+    for (std::size_t j=0; j<newRects.size() && !contained; ++j) {
+      if (i != j && newRects[j].contains(rc) &&
+          // Keep one of two equal rectangles
+          (newRects[j] != rc || j < i))
+        contained = true;
+    }
+    for (std::size_t j=0; j<oldCount && !contained; ++j) {
+      if (freeRects[j].contains(rc))
+        contained = true;
+    }
+
+    if (!contained)
+      freeRects.push_back(rc);
+  }
+
+  // Remove old free rectangles contained in the new ones
+  for (std::size_t i=0; i<oldCount; ) {
+    bool contained = false;
+    for (std::size_t j=oldCount; j<freeRects.size() && !contained; ++j) {
+      if (freeRects[j].contains(freeRects[i]))
+        contained = true;
+    }
+
+    if (contained) {
+      freeRects[i] = freeRects[--oldCount];
+      freeRects.erase(freeRects.begin()+oldCount);
+    }
+    else
+      ++i;
+  }
 }
 
 } // namespace gfx
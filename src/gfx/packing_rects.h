@@ -12,12 +12,16 @@
 
 namespace gfx {
 
-  // TODO add support for rotations
+  // Packs rectangles in a texture using the MaxRects algorithm with
+  // the "best short side fit" heuristic (each rectangle is placed in
+  // the free area where the shortest leftover side is minimal).
   class PackingRects {
   public:
     typedef std::vector<Rect> Rects;
     typedef Rects::const_iterator const_iterator;
 
+    PackingRects();
+
     // Iterate over all given rectangles (in the same order they where
     // given in addSize() calls).
     const_iterator begin() const { return m_rects.begin(); }
@@ -26,10 +30,27 @@ namespace gfx {
     std::size_t size() const { return m_rects.size(); }
     const Rect& operator[](int i) const { return m_rects[i]; }
 
+    // Returns true if the given rectangle was rotated 90 degrees to
+    // be packed (its width and height are swapped).
+    bool isRotated(int i) const { return m_rotated[i]; }
+
+    // Returns the page where the given rectangle was packed (see
+    // packPages()).
+    int page(int i) const { return m_pages[i]; }
+
     // Adds a new rectangle.
     void add(const Size& sz);
     void add(const Rect& rc);
 
+    // Space between the texture edges and the rectangles.
+    void setBorderPadding(int padding) { m_borderPadding = padding; }
+
+    // Space between each pair of rectangles.
+    void setShapePadding(int padding) { m_shapePadding = padding; }
+
+    // Allows to rotate rectangles 90 degrees if they fit better.
+    void setAllowRotation(bool allow) { m_allowRotation = allow; }
+
     // Returns the best size for the texture.
     Size bestFit();
 
@@ -38,12 +59,34 @@ namespace gfx {
     // if there is not enough space.
     bool pack(const Size& size);
 
+    // Rearrange all given rectangles in pages (textures) of the given
+    // size, using as few pages as possible and a similar area of each
+    // page. Returns the number of pages, or 0 if some rectangle is
+    // bigger than a page. The bounds() will contain the rectangles
+    // of all pages (with power of two dimensions).
+    int packPages(const Size& size);
+
     // Returns the bounds of the packed area.
     const Rect& bounds() const { return m_bounds; }
 
   private:
+    int packInPages(const Size& size, int pages);
+    std::vector<std::size_t> sortedByArea() const;
+    void addPage(Rects& freeRects, const Size& size) const;
+    bool findPosition(const Rects& freeRects, std::size_t index,
+                      Rect& best, bool& bestRotated) const;
+    void place(Rects& freeRects, std::size_t index,
+               const Rect& area, bool rotated);
+    static void splitFreeRects(Rects& freeRects, const Rect& used);
+
     Rect m_bounds;
     Rects m_rects;
+    std::vector<bool> m_rotated;
+    std::vector<int> m_pages;
+    Rects m_freeRects;
+    int m_borderPadding;
+    int m_shapePadding;
+    bool m_allowRotation;
   };
 
 } // namespace gfx
@@ -72,11 +72,11 @@ TEST(PackingRects, BestFit6Frames100x100)
 
   EXPECT_EQ(Rect(0, 0, 512, 256), pr.bounds());
   EXPECT_EQ(Rect(0, 0, 100, 100), pr[0]);
-  EXPECT_EQ(Rect(100, 0, 100, 100), pr[1]);
-  EXPECT_EQ(Rect(200, 0, 100, 100), pr[2]);
-  EXPECT_EQ(Rect(300, 0, 100, 100), pr[3]);
-  EXPECT_EQ(Rect(400, 0, 100, 100), pr[4]);
-  EXPECT_EQ(Rect(0, 100, 100, 100), pr[5]);
+  EXPECT_EQ(Rect(0, 100, 100, 100), pr[1]);
+  EXPECT_EQ(Rect(100, 0, 100, 100), pr[2]);
+  EXPECT_EQ(Rect(100, 100, 100, 100), pr[3]);
+  EXPECT_EQ(Rect(200, 0, 100, 100), pr[4]);
+  EXPECT_EQ(Rect(200, 100, 100, 100), pr[5]);
 }
 
 TEST(PackingRects, KeepSameRectsOrder)
@@ -88,11 +88,145 @@ TEST(PackingRects, KeepSameRectsOrder)
   pr.bestFit();
 
   EXPECT_EQ(Rect(0, 0, 64, 32), pr.bounds());
-  EXPECT_EQ(Rect(50, 0, 10, 10), pr[0]);
+  EXPECT_EQ(Rect(30, 20, 10, 10), pr[0]);
   EXPECT_EQ(Rect(30, 0, 20, 20), pr[1]);
   EXPECT_EQ(Rect(0, 0, 30, 30), pr[2]);
 }
 
+TEST(PackingRects, ShapePadding)
+{
+  PackingRects pr;
+  pr.setShapePadding(2);
+  pr.add(Size(10, 10));
+  pr.add(Size(10, 10));
+  EXPECT_FALSE(pr.pack(Size(21, 10)));
+  EXPECT_TRUE(pr.pack(Size(22, 10)));
+
+  EXPECT_EQ(Rect(0, 0, 10, 10), pr[0]);
+  EXPECT_EQ(Rect(12, 0, 10, 10), pr[1]);
+}
+
+TEST(PackingRects, BorderPadding)
+{
+  PackingRects pr;
+  pr.setBorderPadding(3);
+  pr.add(Size(10, 10));
+  EXPECT_FALSE(pr.pack(Size(15, 16)));
+  EXPECT_TRUE(pr.pack(Size(16, 16)));
+
+  EXPECT_EQ(Rect(3, 3, 10, 10), pr[0]);
+}
+
+TEST(PackingRects, Rotation)
+{
+  PackingRects pr;
+  pr.add(Size(32, 8));
+  pr.add(Size(8, 24));
+  EXPECT_FALSE(pr.pack(Size(32, 16)));
+
+  pr.setAllowRotation(true);
+  EXPECT_TRUE(pr.pack(Size(32, 16)));
+  EXPECT_FALSE(pr.isRotated(0));
+  EXPECT_TRUE(pr.isRotated(1));
+  EXPECT_EQ(Size(32, 8), pr[0].size());
+  EXPECT_EQ(Size(24, 8), pr[1].size());
+}
+
+TEST(PackingRects, ManyRectsDontOverlap)
+{
+  PackingRects pr;
+  pr.setShapePadding(1);
+  for (int i=0; i<2000; ++i)
+    pr.add(Size(1 + (i*7) % 31, 1 + (i*13) % 29));
+
+  Size sz = pr.bestFit();
+  EXPECT_EQ(sz, pr.bounds().size());
+
+  for (std::size_t i=0; i<pr.size(); ++i) {
+    ASSERT_TRUE(pr.bounds().contains(pr[i]));
+    Rect padded(pr[i].x, pr[i].y, pr[i].w+1, pr[i].h+1);
+    for (std::size_t j=i+1; j<pr.size(); ++j)
+      ASSERT_FALSE(padded.intersects(pr[j]));
+  }
+}
+
+TEST(PackingRects, Pages)
+{
+  PackingRects pr;
+  for (int i=0; i<6; ++i)
+    pr.add(Size(16, 16));
+
+  EXPECT_EQ(3, pr.packPages(Size(32, 16)));
+  EXPECT_EQ(Rect(0, 0, 32, 16), pr.bounds());
+
+  int count[3] = { 0, 0, 0 };
+  for (std::size_t i=0; i<pr.size(); ++i) {
+    ASSERT_TRUE(pr.page(i) >= 0 && pr.page(i) < 3);
+    ++count[pr.page(i)];
+  }
+  EXPECT_EQ(2, count[0]);
+  EXPECT_EQ(2, count[1]);
+  EXPECT_EQ(2, count[2]);
+}
+
+TEST(PackingRects, PagesAreBalanced)
+{
+  PackingRects pr;
+  for (int i=0; i<6; ++i)
+    pr.add(Size(16, 16));
+
+  // Four rectangles fit in the first page, but they are distributed
+  // to use a similar area in both pages.
+  EXPECT_EQ(2, pr.packPages(Size(32, 32)));
+
+  int count[2] = { 0, 0 };
+  for (std::size_t i=0; i<pr.size(); ++i)
+    ++count[pr.page(i)];
+  EXPECT_EQ(3, count[0]);
+  EXPECT_EQ(3, count[1]);
+}
+
+TEST(PackingRects, PagesBounds)
+{
+  PackingRects pr;
+  pr.setBorderPadding(1);
+  pr.add(Size(20, 10));
+
+  EXPECT_EQ(1, pr.packPages(Size(100, 100)));
+  EXPECT_EQ(Rect(1, 1, 20, 10), pr[0]);
+  EXPECT_EQ(Rect(0, 0, 32, 16), pr.bounds());
+}
+
+TEST(PackingRects, RectBiggerThanPage)
+{
+  PackingRects pr;
+  pr.add(Size(16, 16));
+  pr.add(Size(64, 16));
+  EXPECT_EQ(0, pr.packPages(Size(32, 32)));
+}
+
+TEST(PackingRects, ManyRectsInPages)
+{
+  PackingRects pr;
+  pr.setShapePadding(1);
+  for (int i=0; i<2000; ++i)
+    pr.add(Size(1 + (i*7) % 31, 1 + (i*13) % 29));
+
+  int pages = pr.packPages(Size(128, 128));
+  EXPECT_GT(pages, 1);
+  EXPECT_EQ(Rect(0, 0, 128, 128), pr.bounds());
+
+  for (std::size_t i=0; i<pr.size(); ++i) {
+    ASSERT_TRUE(pr.page(i) >= 0 && pr.page(i) < pages);
+    ASSERT_TRUE(pr.bounds().contains(pr[i]));
+    Rect padded(pr[i].x, pr[i].y, pr[i].w+1, pr[i].h+1);
+    for (std::size_t j=i+1; j<pr.size(); ++j) {
+      if (pr.page(i) == pr.page(j))
+        ASSERT_FALSE(padded.intersects(pr[j]));
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
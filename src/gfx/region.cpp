@@ -47,6 +47,20 @@ Region::Region(const Rect& rect)
     pixman_region32_init(&m_region);
 }
 
+Region::Region(const std::vector<Rect>& rects)
+{
+  std::vector<pixman_box32> boxes;
+  boxes.reserve(rects.size());
+  for (const auto& rc : rects) {
+    if (!rc.isEmpty())
+      boxes.push_back({ rc.x, rc.y, rc.x2(), rc.y2() });
+  }
+  if (!boxes.empty())
+    pixman_region32_init_rects(&m_region, &boxes[0], int(boxes.size()));
+  else
+    pixman_region32_init(&m_region);
+}
+
 Region::~Region()
 {
   pixman_region32_fini(&m_region);
@@ -84,6 +84,9 @@ namespace gfx {
     Region();
     Region(const Region& copy);
     explicit Region(const Rect& rect);
+    // Creates the union of all the given rectangles at once (faster
+    // than calling createUnion() for each rectangle).
+    explicit Region(const std::vector<Rect>& rects);
     Region& operator=(const Rect& rect);
     Region& operator=(const Region& copy);
     ~Region();
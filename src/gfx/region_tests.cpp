@@ -92,6 +92,19 @@ TEST(Region, Union)
   EXPECT_EQ(Rect(2, 3, 8, 5), Region().createUnion(b, a)[0]);
 }
 
+TEST(Region, UnionOfRects)
+{
+  std::vector<Rect> rects;
+  rects.push_back(Rect(0, 0, 32, 32));
+  rects.push_back(Rect(32, 0, 32, 32));
+  rects.push_back(Rect(0, 32, 64, 32));
+  rects.push_back(Rect(8, 8, 0, 0));
+  Region a(rects);
+  ASSERT_EQ(1, a.size());
+  EXPECT_EQ(Rect(0, 0, 64, 64), a[0]);
+  EXPECT_TRUE(Region(std::vector<Rect>()).isEmpty());
+}
+
 TEST(Region, ContainsPoint)
 {
   Region a(Rect(2, 3, 4, 5));
@@ -11,6 +11,7 @@
 
 #include "app/app.h"
 #include "app/app_options.h"
+#include "app/batch_server.h"
 #include "app/console.h"
 #include "app/resource_finder.h"
 #include "app/send_crash.h"
@@ -69,6 +70,11 @@ int app_main(int argc, char* argv[])
 
   try {
     static app::AppOptions options(argc, const_cast<const char**>(argv));
+
+    // Send the command line to a batch server (without starting the app)
+    if (options.connectToServer())
+      return app::run_batch_client(options);
+
     LIFETIME auto system = std::unique_ptr<she::System>(she::create_system());
     return system->run([]{
       try {
@@ -90,7 +96,7 @@ int app_main(int argc, char* argv[])
 	  systemConsole.prepareShell();
 
 	app.run();
-	return 0;
+	return app.exitCode();
       } catch (std::exception& e) {
 	std::cerr << e.what() << '\n';
 	she::error_message(e.what());